@@ -5,61 +5,70 @@
 #include "../utils.h"
 
 /*
- * Main method to multiply two EllpackMatrix and save it to the result pointer
+ * Main method to multiply two EllpackMatrix and save the product to the result pointer
+ * result is an EllpackMatrix allocated from the symbolic phase (allocate_result_matrix), this is the numeric phase
  */
 void matr_mult_ellpack(const void *a, const void *b, void *result)
 {
     EllpackMatrix *a_matrix = (EllpackMatrix *)a;
     EllpackMatrix *b_matrix = (EllpackMatrix *)b;
-    float **result_matrix = (float **)result;
+    EllpackMatrix *result_matrix = (EllpackMatrix *)result;
 
     if (a_matrix->cols != b_matrix->rows)
     {
         fprintf(stderr, ERR_INVALID_MATRIX_DIMENSIONS, a_matrix->cols, b_matrix->rows);
-        free_matrix_array(a_matrix->rows, result);
         free_ellpack_matrix((EllpackMatrix *)a);
         free_ellpack_matrix((EllpackMatrix *)b);
+        free_ellpack_matrix(result_matrix);
+        exit(EXIT_FAILURE);
+    }
+
+    // the naive version always accumulates into a dense row
+    SparseAccumulator *spa = allocate_sparse_accumulator(b_matrix->cols);
+    if (spa == NULL || spa_begin_row(spa, ACCUMULATOR_DENSE, 0) != 'S')
+    {
+        free_sparse_accumulator(spa);
+        free_ellpack_matrix((EllpackMatrix *)a);
+        free_ellpack_matrix((EllpackMatrix *)b);
+        free_ellpack_matrix(result_matrix);
         exit(EXIT_FAILURE);
     }
 
     for (uint64_t a_row = 0; a_row < a_matrix->rows; a_row++)
     {
-        for (uint64_t a_ellpack_col = 0; a_ellpack_col < a_matrix->ellpack_cols; a_ellpack_col++)
+        const float *a_row_values = ellpack_row_values(a_matrix, a_row);
+        const uint64_t *a_row_indices = ellpack_row_indices(a_matrix, a_row);
+        uint64_t a_length = ellpack_row_length(a_matrix, a_row);
+        for (uint64_t a_ellpack_col = 0; a_ellpack_col < a_length; a_ellpack_col++)
         {
-            float a_val = a_matrix->values[a_row][a_ellpack_col];
-            // break the row iteration once we encountered a zero entry
-            if (a_val == 0)
-            {
-                break;
-            }
-            uint64_t a_col = a_matrix->indices[a_row][a_ellpack_col];
+            float a_val = a_row_values[a_ellpack_col];
+            uint64_t a_col = a_row_indices[a_ellpack_col];
 
             // b_row_vector contains values in b_matrix that a_val can multiply
             // b_row_indices contains the column index of the values in b_matrix
-            float *b_row_vector = b_matrix->values[a_col];
-            uint64_t *b_row_indices = b_matrix->indices[a_col];
+            float *b_row_vector = ellpack_row_values(b_matrix, a_col);
+            uint64_t *b_row_indices = ellpack_row_indices(b_matrix, a_col);
 
             // result row would be a_row
             // result col would be b_col
-            scalar_multiplication_v0(a_val, b_row_vector, b_row_indices, result_matrix[a_row], b_matrix->ellpack_cols);
+            scalar_multiplication_v0(a_val, b_row_vector, b_row_indices, spa, ellpack_row_length(b_matrix, a_col));
         }
+
+        // move the finished row out of the accumulator
+        spa_store_row(spa, result_matrix, a_row);
     }
+
+    free_sparse_accumulator(spa);
 }
 
 /*
- * scalar multiplication a * b_row_vector
- * multiplication result is accumulated to each entry in result_row_vector
+ * scalar multiplication a * b_row_vector over the b_length valid entries of the B row
+ * multiplication result is accumulated to each entry of the current row in the accumulator
  */
-void scalar_multiplication_v0(float a_val, const float *b_row_vector, const uint64_t *b_row_indices, float *result_row_vector, uint64_t b_ellpack_cols)
+void scalar_multiplication_v0(float a_val, const float *b_row_vector, const uint64_t *b_row_indices, SparseAccumulator *accumulator, uint64_t b_length)
 {
-    for (uint64_t i = 0; i < b_ellpack_cols; i++)
+    for (uint64_t i = 0; i < b_length; i++)
     {
-        float b_val = b_row_vector[i];
-        if (b_val == 0)
-        {
-            break;
-        }
-        uint64_t b_col = b_row_indices[i];
-        result_row_vector[b_col] += a_val * b_val;
+        spa_accumulate(accumulator, b_row_indices[i], a_val * b_row_vector[i]);
     }
 }
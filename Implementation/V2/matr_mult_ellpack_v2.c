@@ -1,10 +1,48 @@
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <pthread.h>
+#include <time.h>
 #include "matr_mult_ellpack_v2.h"
 
-#define NUM_THREADS 5
+static RowPartition row_partition = PARTITION_FLOPS;
+static char report_thread_statistics = 0;
+
+/*
+ * Pick the row partitioning of parallel_multiplication and whether it prints the time, flops and rows of every worker
+ */
+void configure_parallel_multiplication(RowPartition partition, char report_statistics)
+{
+    row_partition = partition;
+    report_thread_statistics = report_statistics;
+}
+
+static double elapsed_seconds(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1.0e9;
+}
+
+/*
+ * Print the statistics of every worker and the imbalance, the slowest worker's time over the mean
+ */
+static void print_thread_statistics(const ThreadData *data, unsigned int num_threads)
+{
+    double max_seconds = 0.0;
+    double sum_seconds = 0.0;
+    for (unsigned int i = 0; i < num_threads; i++)
+    {
+        printf("Worker %u: %"PRIu64" rows, %"PRIu64" flops, %f seconds\n", i, data->worker_rows[i], data->worker_flops[i], data->worker_seconds[i]);
+        sum_seconds += data->worker_seconds[i];
+        if (data->worker_seconds[i] > max_seconds)
+        {
+            max_seconds = data->worker_seconds[i];
+        }
+    }
+    if (sum_seconds > 0.0)
+    {
+        printf("Worker imbalance (max / mean time): %.3f (%s partitioning)\n", max_seconds * num_threads / sum_seconds, row_partition == PARTITION_FLOPS ? "flop" : "row");
+    }
+}
 
 /*
  * Main function to multiply two EllpackMatrix and save it to the result pointer
@@ -12,7 +50,8 @@
 void matr_mult_ellpack_v2(const void *a, const void *b, void *result)
 {
     EllpackMatrix *a_matrix = (EllpackMatrix *)a;
-    if (a_matrix->rows <= 5 * NUM_THREADS)
+    unsigned int num_threads = thread_pool_size();
+    if (num_threads == 1 || a_matrix->rows <= 5 * num_threads)
     {
         sequential_multiplication(a, b, result);
     }
@@ -23,74 +62,174 @@ void matr_mult_ellpack_v2(const void *a, const void *b, void *result)
 }
 
 /*
- * Function to multiply matrices using threads.
+ * Function to multiply matrices using the thread pool.
+ * This is the numeric phase, result is an EllpackMatrix allocated from the symbolic phase.
+ * The rows are cut into blocks of about equal flop count (the cost of an A row is the sum of the B row lengths it
+ * touches, which varies by orders of magnitude on power-law inputs), the pool workers take the blocks from their own
+ * deque or steal from the others. Every worker gathers its rows with a private accumulator directly into the result rows.
  */
 void parallel_multiplication(const void *a, const void *b, void *result)
 {
     EllpackMatrix *a_matrix = (EllpackMatrix *)a;
     EllpackMatrix *b_matrix = (EllpackMatrix *)b;
-    float **result_matrix = (float **)result;
+    EllpackMatrix *result_matrix = (EllpackMatrix *)result;
 
     if (a_matrix->cols != b_matrix->rows)
     {
         fprintf(stderr, ERR_INVALID_MATRIX_DIMENSIONS, a_matrix->cols, b_matrix->rows);
-        free_matrix_array(a_matrix->rows, result);
         free_ellpack_matrix((EllpackMatrix *)a);
         free_ellpack_matrix((EllpackMatrix *)b);
+        free_ellpack_matrix(result_matrix);
         exit(EXIT_FAILURE);
     }
 
-    pthread_t threads[NUM_THREADS];
-    ThreadData thread_data[NUM_THREADS];
-    uint64_t chunk_size = a_matrix->rows / NUM_THREADS;
+    unsigned int num_threads = thread_pool_size();
+    ThreadData thread_data;
+    thread_data.a_matrix = a_matrix;
+    thread_data.b_matrix = b_matrix;
+    thread_data.result = result_matrix;
+    thread_data.accumulators = (SparseAccumulator **)calloc(num_threads, sizeof(SparseAccumulator *));
+    thread_data.status = (char *)malloc(num_threads * sizeof(char));
+    if (thread_data.accumulators == NULL || thread_data.status == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "thread data");
+        free(thread_data.accumulators);
+        free(thread_data.status);
+        free_ellpack_matrix((EllpackMatrix *)a);
+        free_ellpack_matrix((EllpackMatrix *)b);
+        free_ellpack_matrix(result_matrix);
+        exit(EXIT_FAILURE);
+    }
+    for (unsigned int i = 0; i < num_threads; i++)
+    {
+        thread_data.status[i] = 'S';
+    }
 
-    // thread creation
-    for (uint64_t i = 0; i < NUM_THREADS; i++)
+    // the statistics are optional, without memory for them the multiplication just runs without
+    thread_data.flop_prefix = NULL;
+    thread_data.worker_seconds = NULL;
+    thread_data.worker_flops = NULL;
+    thread_data.worker_rows = NULL;
+    if (report_thread_statistics)
+    {
+        thread_data.worker_seconds = (double *)calloc(num_threads, sizeof(double));
+        thread_data.worker_flops = (uint64_t *)calloc(num_threads, sizeof(uint64_t));
+        thread_data.worker_rows = (uint64_t *)calloc(num_threads, sizeof(uint64_t));
+    }
+    char statistics = thread_data.worker_seconds != NULL && thread_data.worker_flops != NULL && thread_data.worker_rows != NULL;
+
+    uint64_t *flop_prefix = NULL;
+    if (row_partition == PARTITION_FLOPS || statistics)
+    {
+        flop_prefix = row_flop_prefix(a_matrix, b_matrix);
+        statistics = statistics && flop_prefix != NULL;
+    }
+    if (statistics)
+    {
+        thread_data.flop_prefix = flop_prefix;
+    }
+    else
     {
-        thread_data[i].start = i * chunk_size;
-        thread_data[i].end = (i == NUM_THREADS - 1) ? a_matrix->rows : (i + 1) * chunk_size; // the last thread can maximum go to the end
-        thread_data[i].a_matrix = a_matrix;
-        thread_data[i].b_matrix = b_matrix;
-        thread_data[i].result = result_matrix;
-        pthread_create(&threads[i], NULL, matr_mult_one_thread, (void *)&thread_data[i]);
+        free(thread_data.worker_seconds);
+        free(thread_data.worker_flops);
+        free(thread_data.worker_rows);
+        thread_data.worker_seconds = NULL;
     }
 
-    for (int i = 0; i < NUM_THREADS; i++)
+    uint64_t block_count = (uint64_t)num_threads * THREAD_POOL_BLOCKS_PER_WORKER;
+    uint64_t *block_bounds = NULL;
+    if (row_partition == PARTITION_FLOPS && flop_prefix != NULL)
     {
-        pthread_join(threads[i], NULL);
+        block_bounds = (uint64_t *)malloc((block_count + 1) * sizeof(uint64_t));
+    }
+    if (block_bounds != NULL)
+    {
+        partition_rows_by_flops(flop_prefix, a_matrix->rows, block_count, block_bounds);
+        thread_pool_run(block_bounds, block_count, matr_mult_row_block, &thread_data);
+        free(block_bounds);
+    }
+    else
+    {
+        thread_pool_run_rows(a_matrix->rows, matr_mult_row_block, &thread_data);
+    }
+
+    if (statistics)
+    {
+        print_thread_statistics(&thread_data, num_threads);
+        free(thread_data.worker_seconds);
+        free(thread_data.worker_flops);
+        free(thread_data.worker_rows);
+    }
+    free(flop_prefix);
+
+    char status = 'S';
+    for (unsigned int i = 0; i < num_threads; i++)
+    {
+        free_sparse_accumulator(thread_data.accumulators[i]);
+        if (thread_data.status[i] != 'S')
+        {
+            status = 'F';
+        }
+    }
+    free(thread_data.accumulators);
+    free(thread_data.status);
+
+    if (status != 'S')
+    {
+        free_ellpack_matrix((EllpackMatrix *)a);
+        free_ellpack_matrix((EllpackMatrix *)b);
+        free_ellpack_matrix(result_matrix);
+        exit(EXIT_FAILURE);
     }
 }
 
 /*
- * matr_mult_one_thread is a function that gets executed by a single thread. arg: ThreadData.
- * main difference from sequential multiplication is that a_row starts starts not from 0 and ends at a_rows, but from data->start and ends before data->end.
+ * matr_mult_row_block is run by pool worker `worker` for one block of rows. arg: ThreadData.
+ * main difference from sequential multiplication is that a_row starts starts not from 0 and ends at a_rows, but from start and ends before end.
+ * data->status[worker] is 'F' if the worker could not allocate its accumulator buffers, its remaining blocks are skipped.
  */
-void *matr_mult_one_thread(void *arg)
+void matr_mult_row_block(void *arg, uint64_t start, uint64_t end, unsigned int worker)
 {
     ThreadData *data = (ThreadData *)arg;
     EllpackMatrix *a_matrix = data->a_matrix;
     EllpackMatrix *b_matrix = data->b_matrix;
-    float **result_matrix = data->result;
-    for (uint64_t a_row = data->start; a_row < data->end; a_row++)
+
+    if (data->status[worker] != 'S')
+    {
+        return;
+    }
+    if (data->accumulators[worker] == NULL)
+    {
+        data->accumulators[worker] = allocate_sparse_accumulator(b_matrix->cols);
+        if (data->accumulators[worker] == NULL)
+        {
+            data->status[worker] = 'F';
+            return;
+        }
+    }
+    SparseAccumulator *spa = data->accumulators[worker];
+
+    struct timespec block_start, block_end;
+    if (data->worker_seconds != NULL)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &block_start);
+    }
+
+    for (uint64_t a_row = start; a_row < end; a_row++)
     {
-        for (uint64_t a_ellpack_col = 0; a_ellpack_col < a_matrix->ellpack_cols; a_ellpack_col++)
+        if (accumulate_row_simd(a_matrix, b_matrix, a_row, spa) != 'S')
         {
-            float a_val = a_matrix->values[a_row][a_ellpack_col];
-            // break the row iteration once we encountered a zero entry
-            if (a_val == 0)
-            {
-                break;
-            }
-            uint64_t a_col = a_matrix->indices[a_row][a_ellpack_col];
-            // b_row_vector contains values in b_matrix that a_val can multiply
-            // b_row_indices contains the column index of the values in b_matrix
-            float *b_row_vector = b_matrix->values[a_col];
-            uint64_t *b_row_indices = b_matrix->indices[a_col];
-
-            // result row would be a_row
-            // result col would be b_col
-            scalar_multiplication_simd(a_val, b_row_vector, b_row_indices, result_matrix[a_row], b_matrix->ellpack_cols);
+            data->status[worker] = 'F';
+            return;
         }
+        spa_store_row(spa, data->result, a_row);
+    }
+
+    if (data->worker_seconds != NULL)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &block_end);
+        data->worker_seconds[worker] += elapsed_seconds(&block_start, &block_end);
+        data->worker_flops[worker] += data->flop_prefix[end] - data->flop_prefix[start];
+        data->worker_rows[worker] += end - start;
     }
-    return NULL;
 }
@@ -1,21 +1,36 @@
 #ifndef FINAL_MATR_MULT_ELLPACK_V2_H
 #define FINAL_MATR_MULT_ELLPACK_V2_H
 
-#include <pthread.h>
 #include "../utils.h"
 #include "../optimizations.h"
+#include "../thread_pool.h"
 
-// ThreadData struct
+// ThreadData struct, shared by all pool workers of one multiplication
 typedef struct
 {
-    uint64_t start;
-    uint64_t end;
     EllpackMatrix *a_matrix;
     EllpackMatrix *b_matrix;
-    float **result;
+    EllpackMatrix *result;
+    SparseAccumulator **accumulators; // one per pool worker, allocated by the worker on first use
+    char *status;                     // one per pool worker
+    const uint64_t *flop_prefix;      // row_flop_prefix of A * B, NULL if neither partitioning nor statistics need it
+
+    // per worker statistics, NULL unless enabled with configure_parallel_multiplication
+    double *worker_seconds;
+    uint64_t *worker_flops;
+    uint64_t *worker_rows;
 } ThreadData;
 
-void *matr_mult_one_thread(void *arg);
+// How the rows of A are cut into the blocks handed to the pool
+typedef enum
+{
+    PARTITION_ROWS,  // equal row counts
+    PARTITION_FLOPS  // equal upper-bound flop counts (default)
+} RowPartition;
+
+void configure_parallel_multiplication(RowPartition partition, char report_statistics);
+
+void matr_mult_row_block(void *arg, uint64_t start, uint64_t end, unsigned int worker);
 
 void parallel_multiplication(const void *a, const void *b, void *result);
 
@@ -0,0 +1,393 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "accumulator.h"
+
+#define HASH_MIN_CAPACITY 16
+
+/*
+ * Helper method to allocate a sparse accumulator for result rows of `cols` columns
+ * The buffers of the individual representations are allocated by spa_begin_row on first use
+ */
+SparseAccumulator *allocate_sparse_accumulator(uint64_t cols)
+{
+    SparseAccumulator *spa = (SparseAccumulator *)calloc(1, sizeof(SparseAccumulator));
+    if (spa == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "sparse accumulator");
+        return NULL;
+    }
+    spa->cols = cols;
+    spa->kind = ACCUMULATOR_DENSE;
+    spa->window_first = 0;
+    spa->window_end = cols;
+    return spa;
+}
+
+void free_sparse_accumulator(SparseAccumulator *spa)
+{
+    if (spa != NULL)
+    {
+        free(spa->values);
+        free(spa->occupied);
+        free(spa->touched);
+        free(spa->hash_keys);
+        free(spa->hash_values);
+        free(spa->entries);
+        free(spa);
+    }
+}
+
+/*
+ * Pick the accumulator for a row of `flops` products (upper bound of its output entries)
+ * - a handful of products is cheapest to sort and merge
+ * - a dense row wins while it is cache-resident or the output fills a good part of it
+ * - otherwise a hash table sized to the row keeps the scatter inside a few cache lines
+ */
+AccumulatorKind choose_accumulator(uint64_t cols, uint64_t flops)
+{
+    if (flops <= ACCUMULATOR_SORT_MAX_FLOPS)
+    {
+        return ACCUMULATOR_SORT;
+    }
+    if (cols <= ACCUMULATOR_DENSE_MAX_COLS || flops >= cols / ACCUMULATOR_DENSE_FLOP_RATIO)
+    {
+        return ACCUMULATOR_DENSE;
+    }
+    return ACCUMULATOR_HASH;
+}
+
+static char reserve_entries(SparseAccumulator *spa, uint64_t count)
+{
+    if (count <= spa->entry_capacity)
+    {
+        return 'S';
+    }
+    AccumulatorEntry *entries = (AccumulatorEntry *)realloc(spa->entries, count * sizeof(AccumulatorEntry));
+    if (entries == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "sort-merge accumulator");
+        return 'F';
+    }
+    spa->entries = entries;
+    spa->entry_capacity = count;
+    return 'S';
+}
+
+/*
+ * Prepare the accumulator for the next row, growing the buffers of `kind` if needed
+ * flops is an upper bound of the products accumulated into the row
+ */
+char spa_begin_row(SparseAccumulator *spa, AccumulatorKind kind, uint64_t flops)
+{
+    spa->kind = kind;
+    if (kind == ACCUMULATOR_DENSE)
+    {
+        if (spa->values == NULL)
+        {
+            spa->values = (float *)allocate_aligned_slab(spa->cols, sizeof(float));
+            spa->occupied = (char *)calloc(spa->cols, sizeof(char));
+            spa->touched = (uint64_t *)malloc(spa->cols * sizeof(uint64_t));
+            if (spa->values == NULL || spa->occupied == NULL || spa->touched == NULL)
+            {
+                fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "dense accumulator");
+                return 'F';
+            }
+        }
+        return 'S';
+    }
+
+    if (kind == ACCUMULATOR_HASH)
+    {
+        // the table only ever grows, a smaller row simply uses a sparser table
+        uint64_t capacity = HASH_MIN_CAPACITY;
+        while (capacity < 2 * flops)
+        {
+            capacity *= 2;
+        }
+        if (capacity > spa->hash_capacity)
+        {
+            free(spa->hash_keys);
+            free(spa->hash_values);
+            spa->hash_keys = (uint64_t *)malloc(capacity * sizeof(uint64_t));
+            spa->hash_values = (float *)calloc(capacity, sizeof(float));
+            if (spa->hash_keys == NULL || spa->hash_values == NULL)
+            {
+                fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "hash accumulator");
+                spa->hash_capacity = 0;
+                return 'F';
+            }
+            for (uint64_t i = 0; i < capacity; i++)
+            {
+                spa->hash_keys[i] = HASH_EMPTY_KEY;
+            }
+            spa->hash_capacity = capacity;
+            spa->hash_shift = 64;
+            for (uint64_t c = capacity; c > 1; c >>= 1)
+            {
+                spa->hash_shift--;
+            }
+        }
+        spa->hash_size = 0;
+    }
+
+    // the hash gather collects its entries into the sort-merge buffer
+    return reserve_entries(spa, flops);
+}
+
+/*
+ * Accumulate a_val * b_row_vector into the current row, entry by entry
+ */
+void spa_scale_row(SparseAccumulator *spa, float a_val, const float *b_row_vector, const uint64_t *b_row_indices, uint64_t length)
+{
+    for (uint64_t i = 0; i < length; i++)
+    {
+        spa_accumulate(spa, b_row_indices[i], a_val * b_row_vector[i]);
+    }
+}
+
+/*
+ * Remember the columns a dense scatter (e.g. scalar_multiplication_simd) wrote to
+ */
+void spa_mark(SparseAccumulator *spa, const uint64_t *indices, uint64_t count)
+{
+    for (uint64_t i = 0; i < count; i++)
+    {
+        uint64_t col = indices[i];
+        if (!spa->occupied[col])
+        {
+            spa->occupied[col] = 1;
+            spa->touched[spa->touched_count++] = col;
+        }
+    }
+}
+
+/*
+ * spa_scale_row and spa_mark for narrowed indices (see compact_indices.h)
+ */
+void spa_scale_row32(SparseAccumulator *spa, float a_val, const float *b_row_vector, const uint32_t *b_row_indices, uint64_t length)
+{
+    for (uint64_t i = 0; i < length; i++)
+    {
+        spa_accumulate(spa, b_row_indices[i], a_val * b_row_vector[i]);
+    }
+}
+
+void spa_mark32(SparseAccumulator *spa, const uint32_t *indices, uint64_t count)
+{
+    for (uint64_t i = 0; i < count; i++)
+    {
+        uint64_t col = indices[i];
+        if (!spa->occupied[col])
+        {
+            spa->occupied[col] = 1;
+            spa->touched[spa->touched_count++] = col;
+        }
+    }
+}
+
+void spa_scale_row16(SparseAccumulator *spa, float a_val, const float *b_row_vector, const uint32_t *b_block_bases, const uint16_t *b_row_deltas, uint64_t length)
+{
+    for (uint64_t i = 0; i < length; i++)
+    {
+        spa_accumulate(spa, (uint64_t)b_block_bases[i / INDEX_DELTA_BLOCK] + b_row_deltas[i], a_val * b_row_vector[i]);
+    }
+}
+
+void spa_mark16(SparseAccumulator *spa, const uint32_t *block_bases, const uint16_t *deltas, uint64_t count)
+{
+    for (uint64_t i = 0; i < count; i++)
+    {
+        uint64_t col = (uint64_t)block_bases[i / INDEX_DELTA_BLOCK] + deltas[i];
+        if (!spa->occupied[col])
+        {
+            spa->occupied[col] = 1;
+            spa->touched[spa->touched_count++] = col;
+        }
+    }
+}
+
+static int compare_uint64(const void *lhs, const void *rhs)
+{
+    uint64_t l = *(const uint64_t *)lhs;
+    uint64_t r = *(const uint64_t *)rhs;
+    return (l > r) - (l < r);
+}
+
+static int compare_entries(const void *lhs, const void *rhs)
+{
+    uint64_t l = ((const AccumulatorEntry *)lhs)->col;
+    uint64_t r = ((const AccumulatorEntry *)rhs)->col;
+    return (l > r) - (l < r);
+}
+
+/*
+ * Stable insertion sort by column: products of the same column keep their order,
+ * so merging sums them in the same order as the dense accumulator would
+ */
+static void sort_entries_stable(AccumulatorEntry *entries, uint64_t count)
+{
+    for (uint64_t i = 1; i < count; i++)
+    {
+        AccumulatorEntry entry = entries[i];
+        uint64_t j = i;
+        while (j > 0 && entries[j - 1].col > entry.col)
+        {
+            entries[j] = entries[j - 1];
+            j--;
+        }
+        entries[j] = entry;
+    }
+}
+
+static uint64_t gather_dense(SparseAccumulator *spa, float *out_values, uint64_t *out_indices)
+{
+    uint64_t count = 0;
+
+    // a nearly full window is cheaper to collect by scanning its flags than by sorting
+    if (spa->touched_count > (spa->window_end - spa->window_first) / 16)
+    {
+        for (uint64_t col = spa->window_first; col < spa->window_end; col++)
+        {
+            if (spa->occupied[col])
+            {
+                spa->touched[count++] = col;
+            }
+        }
+    }
+    else
+    {
+        qsort(spa->touched, spa->touched_count, sizeof(uint64_t), compare_uint64);
+        count = spa->touched_count;
+    }
+
+    uint64_t written = 0;
+    for (uint64_t i = 0; i < count; i++)
+    {
+        uint64_t col = spa->touched[i];
+        float value = spa->values[col];
+        // cancelled sums are not stored, same as zero cells of a dense result
+        if (value != 0)
+        {
+            out_values[written] = value;
+            out_indices[written] = col;
+            written++;
+        }
+        spa->values[col] = 0.0F;
+        spa->occupied[col] = 0;
+    }
+    spa->touched_count = 0;
+    return written;
+}
+
+static uint64_t gather_hash(SparseAccumulator *spa, float *out_values, uint64_t *out_indices)
+{
+    uint64_t count = 0;
+    for (uint64_t slot = 0; count < spa->hash_size; slot++)
+    {
+        if (spa->hash_keys[slot] != HASH_EMPTY_KEY)
+        {
+            spa->entries[count].col = spa->hash_keys[slot];
+            spa->entries[count].value = spa->hash_values[slot];
+            count++;
+            spa->hash_keys[slot] = HASH_EMPTY_KEY;
+            spa->hash_values[slot] = 0.0F;
+        }
+    }
+    spa->hash_size = 0;
+
+    // the keys are unique, so an unstable sort is fine here
+    qsort(spa->entries, count, sizeof(AccumulatorEntry), compare_entries);
+
+    uint64_t written = 0;
+    for (uint64_t i = 0; i < count; i++)
+    {
+        if (spa->entries[i].value != 0)
+        {
+            out_values[written] = spa->entries[i].value;
+            out_indices[written] = spa->entries[i].col;
+            written++;
+        }
+    }
+    return written;
+}
+
+static uint64_t gather_sort(SparseAccumulator *spa, float *out_values, uint64_t *out_indices)
+{
+    sort_entries_stable(spa->entries, spa->entry_count);
+
+    uint64_t written = 0;
+    uint64_t i = 0;
+    while (i < spa->entry_count)
+    {
+        uint64_t col = spa->entries[i].col;
+        float value = 0.0F;
+        for (; i < spa->entry_count && spa->entries[i].col == col; i++)
+        {
+            value += spa->entries[i].value;
+        }
+        if (value != 0)
+        {
+            out_values[written] = value;
+            out_indices[written] = col;
+            written++;
+        }
+    }
+    spa->entry_count = 0;
+    return written;
+}
+
+/*
+ * Restrict the following rows to the columns [first, end), the dense gather then only scans that window
+ */
+void spa_set_window(SparseAccumulator *spa, uint64_t first, uint64_t end)
+{
+    spa->window_first = first;
+    spa->window_end = end;
+}
+
+/*
+ * Write the non-zero entries of the current row in ascending column order to out_values/out_indices
+ * and reset the accumulator for the next row. Returns the number of entries written.
+ * out_values/out_indices must have room for every distinct column of the row.
+ */
+uint64_t spa_gather(SparseAccumulator *spa, float *out_values, uint64_t *out_indices)
+{
+    if (spa->kind == ACCUMULATOR_DENSE)
+    {
+        return gather_dense(spa, out_values, out_indices);
+    }
+    if (spa->kind == ACCUMULATOR_HASH)
+    {
+        return gather_hash(spa, out_values, out_indices);
+    }
+    return gather_sort(spa, out_values, out_indices);
+}
+
+/*
+ * Move the current accumulator row into row `row` of a result allocated from the symbolic phase
+ * The gathered entries never exceed the symbolic row nnz, the rest of the row is cleared
+ * so a result matrix can be reused for the next numeric pass
+ */
+void spa_store_row(SparseAccumulator *spa, EllpackMatrix *result, uint64_t row)
+{
+    float *row_values = ellpack_row_values(result, row);
+    uint64_t *row_indices = ellpack_row_indices(result, row);
+    uint64_t written = spa_gather(spa, row_values, row_indices);
+    result->row_lengths[row] = written;
+    for (uint64_t j = written; j < result->ellpack_cols; j++)
+    {
+        row_values[j] = 0.0F;
+        row_indices[j] = 0;
+    }
+}
+
+/*
+ * Append the current accumulator row behind the row_lengths[row] entries already stored in row `row`,
+ * for result rows accumulated in passes over increasing column ranges. The padding of the row is left as it is.
+ */
+void spa_append_row(SparseAccumulator *spa, EllpackMatrix *result, uint64_t row)
+{
+    uint64_t stored = result->row_lengths[row];
+    result->row_lengths[row] = stored + spa_gather(spa, ellpack_row_values(result, row) + stored, ellpack_row_indices(result, row) + stored);
+}
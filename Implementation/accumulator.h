@@ -0,0 +1,133 @@
+#ifndef FINAL_ACCUMULATOR_H
+#define FINAL_ACCUMULATOR_H
+
+#include <stdint.h>
+#include "utils.h"
+
+// Accumulator selection thresholds, see choose_accumulator(). Can be overridden with -D at build time.
+
+#ifndef ACCUMULATOR_SORT_MAX_FLOPS
+#define ACCUMULATOR_SORT_MAX_FLOPS 32      // rows with at most this many products are sorted and merged
+#endif
+#ifndef ACCUMULATOR_DENSE_MAX_COLS
+#define ACCUMULATOR_DENSE_MAX_COLS 16384   // a dense row of this many floats (64 KiB) stays in L2
+#endif
+#ifndef ACCUMULATOR_DENSE_FLOP_RATIO
+#define ACCUMULATOR_DENSE_FLOP_RATIO 16    // wider rows use the dense row once flops > cols / ratio
+#endif
+
+#define HASH_EMPTY_KEY UINT64_MAX
+
+typedef enum
+{
+    ACCUMULATOR_DENSE, // dense row of `cols` floats with occupancy flags (SPA)
+    ACCUMULATOR_HASH,  // open-addressing hash table sized to the row's flops
+    ACCUMULATOR_SORT   // list of products, sorted by column and merged at gather time
+} AccumulatorKind;
+
+typedef struct
+{
+    uint64_t col;
+    float value;
+} AccumulatorEntry;
+
+// SparseAccumulator structure
+// Accumulates one result row at a time. Before every row spa_begin_row picks the dense, hash
+// or sort-merge representation from the row's upper-bound flop count, the buffers of each
+// representation are allocated on first use and kept for the following rows.
+// Every thread owns its own accumulator.
+
+typedef struct
+{
+    uint64_t cols;
+    AccumulatorKind kind;       // representation of the current row
+    uint64_t window_first;      // the rows only touch the columns [window_first, window_end), the dense gather
+    uint64_t window_end;        // scans only those: 0 and cols unless a tiled multiplication narrows them (spa_set_window)
+
+    // dense
+    float *values;              // dense accumulator row, all zero between rows
+    char *occupied;             // 1 if the column was touched in the current row
+    uint64_t *touched;          // columns touched in the current row, in touch order
+    uint64_t touched_count;
+
+    // hash
+    uint64_t *hash_keys;        // column per slot, HASH_EMPTY_KEY if free
+    float *hash_values;
+    uint64_t hash_capacity;     // power of two, at least twice the row's flops
+    unsigned int hash_shift;    // 64 - log2(hash_capacity)
+    uint64_t hash_size;         // slots in use for the current row
+
+    // sort-merge (also used to collect the hash entries at gather time)
+    AccumulatorEntry *entries;
+    uint64_t entry_count;
+    uint64_t entry_capacity;
+} SparseAccumulator;
+
+/*
+ * Add value to column col of the current row
+ */
+static inline void spa_accumulate(SparseAccumulator *spa, uint64_t col, float value)
+{
+    if (spa->kind == ACCUMULATOR_DENSE)
+    {
+        if (!spa->occupied[col])
+        {
+            spa->occupied[col] = 1;
+            spa->touched[spa->touched_count++] = col;
+        }
+        spa->values[col] += value;
+    }
+    else if (spa->kind == ACCUMULATOR_HASH)
+    {
+        // fibonacci hashing, linear probing. The table holds at least twice the row's flops, so it never fills up.
+        uint64_t mask = spa->hash_capacity - 1;
+        uint64_t slot = (col * 0x9E3779B97F4A7C15ULL) >> spa->hash_shift;
+        while (spa->hash_keys[slot] != col)
+        {
+            if (spa->hash_keys[slot] == HASH_EMPTY_KEY)
+            {
+                spa->hash_keys[slot] = col;
+                spa->hash_size++;
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+        spa->hash_values[slot] += value;
+    }
+    else
+    {
+        spa->entries[spa->entry_count].col = col;
+        spa->entries[spa->entry_count].value = value;
+        spa->entry_count++;
+    }
+}
+
+SparseAccumulator *allocate_sparse_accumulator(uint64_t cols);
+
+void free_sparse_accumulator(SparseAccumulator *spa);
+
+AccumulatorKind choose_accumulator(uint64_t cols, uint64_t flops);
+
+char spa_begin_row(SparseAccumulator *spa, AccumulatorKind kind, uint64_t flops);
+
+void spa_scale_row(SparseAccumulator *spa, float a_val, const float *b_row_vector, const uint64_t *b_row_indices, uint64_t length);
+
+void spa_mark(SparseAccumulator *spa, const uint64_t *indices, uint64_t count);
+
+void spa_scale_row32(SparseAccumulator *spa, float a_val, const float *b_row_vector, const uint32_t *b_row_indices, uint64_t length);
+
+void spa_mark32(SparseAccumulator *spa, const uint32_t *indices, uint64_t count);
+
+void spa_scale_row16(SparseAccumulator *spa, float a_val, const float *b_row_vector, const uint32_t *b_block_bases, const uint16_t *b_row_deltas, uint64_t length);
+
+void spa_mark16(SparseAccumulator *spa, const uint32_t *block_bases, const uint16_t *deltas, uint64_t count);
+
+void spa_set_window(SparseAccumulator *spa, uint64_t first, uint64_t end);
+
+uint64_t spa_gather(SparseAccumulator *spa, float *out_values, uint64_t *out_indices);
+
+void spa_store_row(SparseAccumulator *spa, EllpackMatrix *result, uint64_t row);
+
+void spa_append_row(SparseAccumulator *spa, EllpackMatrix *result, uint64_t row);
+
+#endif
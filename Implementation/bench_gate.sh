@@ -0,0 +1,50 @@
+#!/bin/sh
+# Regression gate: compares the throughput (median GFLOP/s) of every run in the results file with the
+# same run (matrix, version, storage, kernel, threads) in the baseline and fails if any run lost more than
+# threshold percent. Baselines are only comparable on the machine that recorded them.
+#
+# usage: ./bench_gate.sh <baseline.csv> <results.csv> [threshold percent, default 10]
+
+baseline=$1
+results=$2
+threshold=${3:-10}
+
+if [ ! -f "$baseline" ]; then
+    echo "Error: no baseline $baseline, record one with 'make bench_baseline'" >&2
+    exit 1
+fi
+if [ ! -f "$results" ]; then
+    echo "Error: no results $results" >&2
+    exit 1
+fi
+
+awk -F, -v threshold="$threshold" '
+FNR == 1 {
+    for (i = 1; i <= NF; i++) column[$i] = i
+    next
+}
+{
+    key = $column["matrix_a"] " V" $column["version"] " " $column["storage"] " " $column["kernel"] " " $column["threads"] "t"
+    gflops = $column["gflops"]
+}
+NR == FNR {
+    base[key] = gflops
+    next
+}
+{
+    if (!(key in base)) {
+        printf "NEW         %-60s %10.3f GFLOP/s\n", key, gflops
+        next
+    }
+    change = base[key] > 0 ? (gflops - base[key]) / base[key] * 100 : 0
+    status = change < -threshold ? "REGRESSION" : "ok"
+    if (status == "REGRESSION") failed++
+    printf "%-11s %-60s %10.3f -> %10.3f GFLOP/s (%+.1f%%)\n", status, key, base[key], gflops, change
+}
+END {
+    if (failed > 0) {
+        printf "%d run(s) regressed by more than %s%%\n", failed, threshold
+        exit 1
+    }
+    printf "no run regressed by more than %s%%\n", threshold
+}' "$baseline" "$results"
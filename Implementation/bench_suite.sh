@@ -0,0 +1,56 @@
+#!/bin/sh
+# Benchmark suite: every kernel version over the InputData matrices and the synthetic families
+# (uniform, banded, power-law, R-MAT, block-diagonal) at the configured scales. Appends one CSV line per run
+# (see --report csv) to the results file, which is recreated on every invocation.
+#
+# usage: ./bench_suite.sh [results.csv]
+# environment:
+#   BENCH_VERSIONS    kernel versions to run (default "0 1 2")
+#   BENCH_STORAGES    operand storages of V1/V2 (default "ellpack sell hyb csr auto"), V0 always runs on ellpack
+#   BENCH_ITERATIONS  measured iterations per run (default 5)
+#   BENCH_WARMUPS     warm-up iterations per run (default 1)
+#   BENCH_SCALES      rows (= cols) of the synthetic matrices (default "10000 100000", up to millions)
+#   BENCH_ROW_LENGTH  row_length of the synthetic matrices (default 16)
+#   BENCH_DATA        directory the synthetic matrices are generated into once (default BenchData)
+
+set -e
+cd "$(dirname "$0")"
+
+results=${1:-bench_results.csv}
+versions=${BENCH_VERSIONS:-0 1 2}
+storages=${BENCH_STORAGES:-ellpack sell hyb csr auto}
+iterations=${BENCH_ITERATIONS:-5}
+warmups=${BENCH_WARMUPS:-1}
+scales=${BENCH_SCALES:-10000 100000}
+row_length=${BENCH_ROW_LENGTH:-16}
+data=${BENCH_DATA:-BenchData}
+
+rm -f "$results"
+
+run() {
+    for version in $versions; do
+        for storage in $storages; do
+            [ "$version" = 0 ] && [ "$storage" != ellpack ] && continue
+            echo "$1 x $2 [V$version, $storage]" >&2
+            out=$(./matrix_multiplication --matrix_a "$1" --matrix_b "$2" --output /dev/null -V"$version" --storage "$storage" -B"$iterations" -W"$warmups" --report csv)
+            [ -s "$results" ] || echo "$out" | head -n 1 > "$results"
+            echo "$out" | tail -n 1 >> "$results"
+        done
+    done
+}
+
+for a in InputData/matrix_*_a; do
+    run "$a" "${a%_a}_b"
+done
+
+mkdir -p "$data"
+for family in uniform banded powerlaw rmat blockdiag; do
+    for n in $scales; do
+        name="$data/${family}_${n}_${row_length}"
+        [ -f "${name}_a" ] || ./matrix_multiplication --generate "$family,$n,$n,$row_length,1" --format binary --output "${name}_a"
+        [ -f "${name}_b" ] || ./matrix_multiplication --generate "$family,$n,$n,$row_length,2" --format binary --output "${name}_b"
+        run "${name}_a" "${name}_b"
+    done
+done
+
+echo "results written to $results" >&2
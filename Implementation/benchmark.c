@@ -0,0 +1,159 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "benchmark.h"
+
+/*
+ * Monotonic clock in seconds
+ */
+double benchmark_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1.0e9;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Summarize count samples (sorted in place). p95 is the nearest-rank percentile,
+ * the median of an even count is the mean of the two middle samples.
+ */
+void compute_benchmark_stats(double *samples, uint64_t count, BenchmarkStats *stats)
+{
+    stats->count = count;
+    if (count == 0)
+    {
+        stats->min = stats->median = stats->p95 = stats->max = stats->mean = 0.0;
+        return;
+    }
+
+    qsort(samples, count, sizeof(double), compare_doubles);
+    double sum = 0.0;
+    for (uint64_t i = 0; i < count; i++)
+    {
+        sum += samples[i];
+    }
+    stats->min = samples[0];
+    stats->max = samples[count - 1];
+    stats->mean = sum / (double)count;
+    stats->median = count % 2 == 1 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2.0;
+    uint64_t p95_rank = (count * 95 + 99) / 100; // ceil(0.95 * count)
+    stats->p95 = samples[p95_rank - 1];
+}
+
+/*
+ * Number of stored entries (trailing padding excluded)
+ */
+uint64_t ellpack_nnz(const EllpackMatrix *matrix)
+{
+    uint64_t nnz = 0;
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        nnz += ellpack_row_length(matrix, row);
+    }
+    return nnz;
+}
+
+/*
+ * Bytes a multiplication has to move at least: every entry of A is read once, every product reads
+ * one value and one index of B (index_bits wide), and every result entry is written once (value and 64-bit index)
+ */
+uint64_t estimate_multiplication_bytes(uint64_t a_nnz, uint64_t flops, uint64_t result_nnz, unsigned int index_bits)
+{
+    uint64_t operand_entry_bytes = sizeof(float) + index_bits / 8;
+    uint64_t result_entry_bytes = sizeof(float) + sizeof(uint64_t);
+    return (a_nnz + flops) * operand_entry_bytes + result_nnz * result_entry_bytes;
+}
+
+/*
+ * Bytes a sparse x dense product has to move at least: every entry of A is read once (value and 64-bit index),
+ * every product reads one x value and every y value is written once
+ */
+uint64_t estimate_dense_bytes(uint64_t a_nnz, uint64_t flops, uint64_t result_values)
+{
+    return a_nnz * (sizeof(float) + sizeof(uint64_t)) + (flops + result_values) * sizeof(float);
+}
+
+/*
+ * Print a JSON string, quotes, backslashes and control characters escaped
+ */
+static void print_json_string(FILE *out, const char *text)
+{
+    fputc('"', out);
+    for (; *text != '\0'; text++)
+    {
+        unsigned char c = (unsigned char)*text;
+        if (c == '"' || c == '\\')
+        {
+            fprintf(out, "\\%c", c);
+        }
+        else if (c < 0x20)
+        {
+            fprintf(out, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/*
+ * Print the report of one run, rates are computed from the median multiplication time
+ */
+void print_benchmark_report(FILE *out, const BenchmarkReport *report, ReportFormat format)
+{
+    const BenchmarkStats *multiply = &report->multiply;
+    double gflops = multiply->median > 0.0 ? 2.0 * (double)report->flops / multiply->median / 1.0e9 : 0.0;
+    double bandwidth = multiply->median > 0.0 ? (double)report->bytes / multiply->median / 1.0e9 : 0.0;
+
+    switch (format)
+    {
+    case REPORT_JSON:
+        fprintf(out, "{\"matrix_a\":");
+        print_json_string(out, report->matrix_a);
+        fprintf(out, ",\"matrix_b\":");
+        print_json_string(out, report->matrix_b);
+        fprintf(out, ",\"version\":%u,\"storage\":\"%s\",\"kernel\":\"%s\",\"threads\":%u,"
+                     "\"warmups\":%u,\"iterations\":%"PRIu64",\"load_s\":%.9f,\"reorder_s\":%.9f,\"symbolic_s\":%.9f,\"dump_s\":%.9f,"
+                     "\"multiply_min_s\":%.9f,\"multiply_median_s\":%.9f,\"multiply_p95_s\":%.9f,\"multiply_max_s\":%.9f,"
+                     "\"multiply_mean_s\":%.9f,\"flops\":%"PRIu64",\"result_nnz\":%"PRIu64",\"gflops\":%.6f,\"bandwidth_gbs\":%.6f}\n",
+                report->version, report->storage, report->kernel, report->threads,
+                report->warmups, multiply->count, report->load_seconds, report->reorder_seconds, report->symbolic_seconds, report->dump_seconds,
+                multiply->min, multiply->median, multiply->p95, multiply->max,
+                multiply->mean, report->flops, report->result_nnz, gflops, bandwidth);
+        break;
+    case REPORT_CSV:
+        fprintf(out, "matrix_a,matrix_b,version,storage,kernel,threads,warmups,iterations,load_s,reorder_s,symbolic_s,dump_s,"
+                     "multiply_min_s,multiply_median_s,multiply_p95_s,multiply_max_s,multiply_mean_s,flops,result_nnz,gflops,bandwidth_gbs\n");
+        fprintf(out, "%s,%s,%u,%s,%s,%u,%u,%"PRIu64",%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%"PRIu64",%"PRIu64",%.6f,%.6f\n",
+                report->matrix_a, report->matrix_b, report->version, report->storage, report->kernel, report->threads,
+                report->warmups, multiply->count, report->load_seconds, report->reorder_seconds, report->symbolic_seconds, report->dump_seconds,
+                multiply->min, multiply->median, multiply->p95, multiply->max, multiply->mean,
+                report->flops, report->result_nnz, gflops, bandwidth);
+        break;
+    default:
+        fprintf(out, "Version %u (%s storage, %s kernel, %u threads), %"PRIu64" iterations after %u warm-ups\n",
+                report->version, report->storage, report->kernel, report->threads, multiply->count, report->warmups);
+        fprintf(out, "  load:     %f seconds\n", report->load_seconds);
+        if (report->reorder_seconds > 0)
+        {
+            fprintf(out, "  reorder:  %f seconds\n", report->reorder_seconds);
+        }
+        fprintf(out, "  symbolic: %f seconds\n", report->symbolic_seconds);
+        fprintf(out, "  multiply: min %f, median %f, p95 %f, max %f, mean %f seconds\n",
+                multiply->min, multiply->median, multiply->p95, multiply->max, multiply->mean);
+        fprintf(out, "  dump:     %f seconds\n", report->dump_seconds);
+        fprintf(out, "  %"PRIu64" multiply-adds, %"PRIu64" result entries: %.3f GFLOP/s, %.3f GB/s (median)\n",
+                report->flops, report->result_nnz, gflops, bandwidth);
+        break;
+    }
+}
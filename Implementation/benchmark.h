@@ -0,0 +1,62 @@
+#ifndef FINAL_BENCHMARK_H
+#define FINAL_BENCHMARK_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "utils.h"
+
+// Benchmark statistics and reports of main's -B mode
+// The load, reorder, symbolic and dump phases run once, the numeric phase runs the warm-up iterations (not measured)
+// and then the measured iterations, whose times are summarized by BenchmarkStats.
+
+typedef enum
+{
+    REPORT_TEXT,
+    REPORT_JSON, // one object per run on a single line, runs can be appended to a file
+    REPORT_CSV   // header line and one line per run
+} ReportFormat;
+
+// BenchmarkStats struct, summary of the per-iteration times of a phase in seconds
+typedef struct
+{
+    uint64_t count;
+    double min;
+    double median;
+    double p95;
+    double max;
+    double mean;
+} BenchmarkStats;
+
+// BenchmarkReport struct, everything printed for one run
+typedef struct
+{
+    const char *matrix_a;
+    const char *matrix_b;
+    unsigned int version;
+    const char *storage;      // storage of the operands in the numeric phase
+    const char *kernel;       // simd kernel of V1/V2, "scalar" for V0
+    unsigned int threads;
+    unsigned int warmups;
+    double load_seconds;      // both input files, including the conversion to the storage
+    double reorder_seconds;   // computing and applying the reordering and restoring the result order, 0 without one
+    double symbolic_seconds;
+    double dump_seconds;
+    BenchmarkStats multiply;  // numeric phase, per iteration
+    uint64_t flops;           // multiply-adds of one multiplication (upper bound, products of stored entries)
+    uint64_t bytes;           // estimated memory traffic of one multiplication
+    uint64_t result_nnz;
+} BenchmarkReport;
+
+double benchmark_now(void);
+
+void compute_benchmark_stats(double *samples, uint64_t count, BenchmarkStats *stats);
+
+uint64_t ellpack_nnz(const EllpackMatrix *matrix);
+
+uint64_t estimate_multiplication_bytes(uint64_t a_nnz, uint64_t flops, uint64_t result_nnz, unsigned int index_bits);
+
+uint64_t estimate_dense_bytes(uint64_t a_nnz, uint64_t flops, uint64_t result_values);
+
+void print_benchmark_report(FILE *out, const BenchmarkReport *report, ReportFormat format);
+
+#endif
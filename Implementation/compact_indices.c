@@ -0,0 +1,129 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compact_indices.h"
+
+/*
+ * Parse "auto", "64", "32" or "16"
+ */
+char parse_index_bits(const char *spec, unsigned int *bits)
+{
+    if (strcmp(spec, "auto") == 0)
+    {
+        *bits = INDEX_BITS_AUTO;
+        return 'S';
+    }
+    if (strcmp(spec, "64") == 0 || strcmp(spec, "32") == 0 || strcmp(spec, "16") == 0)
+    {
+        *bits = (unsigned int)atoi(spec);
+        return 'S';
+    }
+    fprintf(stderr, "Error: Invalid index width \"%s\", expected auto, 64, 32 or 16.\n", spec);
+    return 'F';
+}
+
+/*
+ * Release the 64-bit indices, a mapped slab stays with its mapping
+ */
+static void release_wide_indices(EllpackMatrix *matrix)
+{
+    if (matrix->mapping == NULL)
+    {
+        free(matrix->indices);
+    }
+    matrix->indices = NULL;
+}
+
+/*
+ * 32-bit copy of the indices, 'F' if it could not be allocated
+ */
+static char narrow_to_32_bits(EllpackMatrix *matrix)
+{
+    uint64_t entries = matrix->rows * matrix->stride;
+    uint32_t *indices32 = (uint32_t *)allocate_aligned_slab(entries, sizeof(uint32_t));
+    if (indices32 == NULL)
+    {
+        return 'F';
+    }
+    for (uint64_t i = 0; i < entries; i++)
+    {
+        indices32[i] = (uint32_t)matrix->indices[i];
+    }
+    release_wide_indices(matrix);
+    matrix->indices32 = indices32;
+    matrix->index_bits = 32;
+    return 'S';
+}
+
+/*
+ * Bases and 16-bit deltas of the indices, 'F' if a block spans 2^16 columns or more or the arrays could not be
+ * allocated. Entries past the row length (padding) get delta 0, their value is zero so they add nothing.
+ */
+static char narrow_to_16_bits(EllpackMatrix *matrix)
+{
+    uint64_t entries = matrix->rows * matrix->stride;
+    uint64_t blocks_per_row = matrix->stride / INDEX_DELTA_BLOCK;
+    uint32_t *bases = (uint32_t *)allocate_aligned_slab(matrix->rows * blocks_per_row, sizeof(uint32_t));
+    uint16_t *deltas = (uint16_t *)allocate_aligned_slab(entries, sizeof(uint16_t));
+    if (bases == NULL || deltas == NULL)
+    {
+        free(bases);
+        free(deltas);
+        return 'F';
+    }
+
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        const uint64_t *row_indices = ellpack_row_indices(matrix, row);
+        uint64_t length = ellpack_row_length(matrix, row);
+        for (uint64_t block = 0; block * INDEX_DELTA_BLOCK < length; block++)
+        {
+            uint64_t first = block * INDEX_DELTA_BLOCK;
+            uint64_t last = first + INDEX_DELTA_BLOCK < length ? first + INDEX_DELTA_BLOCK : length;
+            uint64_t low = row_indices[first];
+            uint64_t high = row_indices[first];
+            for (uint64_t j = first + 1; j < last; j++)
+            {
+                low = row_indices[j] < low ? row_indices[j] : low;
+                high = row_indices[j] > high ? row_indices[j] : high;
+            }
+            if (high - low > UINT16_MAX)
+            {
+                free(bases);
+                free(deltas);
+                return 'F';
+            }
+            bases[row * blocks_per_row + block] = (uint32_t)low;
+            for (uint64_t j = first; j < last; j++)
+            {
+                deltas[row * matrix->stride + j] = (uint16_t)(row_indices[j] - low);
+            }
+        }
+    }
+    release_wide_indices(matrix);
+    matrix->index_bases = bases;
+    matrix->index_deltas = deltas;
+    matrix->index_bits = 16;
+    return 'S';
+}
+
+/*
+ * Narrow the indices of an operand to `bits` (INDEX_BITS_AUTO: 32) and return the width it got. A width the
+ * matrix does not fit falls back to the next wider one (16 -> 32 -> 64), so does a width whose arrays could not
+ * be allocated. The simd gathers take signed 32-bit lanes, so only matrices with at most 2^31 columns are narrowed.
+ * Only the numeric phase of V1/V2 reads the narrowed indices.
+ */
+unsigned int compact_ellpack_indices(EllpackMatrix *matrix, unsigned int bits)
+{
+    if (matrix->index_bits != 64 || bits == 64 || matrix->cols - 1 > INT32_MAX)
+    {
+        return matrix->index_bits;
+    }
+    if (bits == 16 && narrow_to_16_bits(matrix) == 'S')
+    {
+        return 16;
+    }
+    narrow_to_32_bits(matrix);
+    return matrix->index_bits;
+}
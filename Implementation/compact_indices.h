@@ -0,0 +1,19 @@
+#ifndef FINAL_COMPACT_INDICES_H
+#define FINAL_COMPACT_INDICES_H
+
+#include <stdint.h>
+#include "utils.h"
+
+// Narrow column indices of the V1/V2 operands
+// The numeric phase reads one index per product, with 64-bit indices that is twice the bytes of the value.
+// 32-bit indices fit every matrix with at most 2^31 columns (the simd gathers take signed lanes). 16-bit indices store the column as a delta to a
+// 32-bit base per block of INDEX_DELTA_BLOCK entries, the base is the smallest column of the block; this fits
+// every block whose columns span less than 2^16, e.g. the blocks of sorted rows of banded or clustered matrices.
+
+#define INDEX_BITS_AUTO 0 // 32 bits whenever the columns fit
+
+char parse_index_bits(const char *spec, unsigned int *bits);
+
+unsigned int compact_ellpack_indices(EllpackMatrix *matrix, unsigned int bits);
+
+#endif
@@ -0,0 +1,247 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "csr.h"
+#include "optimizations.h"
+#include "accumulator.h"
+#include "thread_pool.h"
+
+/*
+ * Helper method to free memory of a CSR matrix
+ */
+void free_csr_matrix(CsrMatrix *matrix)
+{
+    if (matrix != NULL)
+    {
+        free(matrix->row_offsets);
+        free(matrix->indices);
+        free(matrix->values);
+        free(matrix);
+    }
+}
+
+/*
+ * Convert an ELLPACK matrix to CSR, the rows keep their valid entries
+ */
+CsrMatrix *ellpack_to_csr(const EllpackMatrix *matrix)
+{
+    CsrMatrix *csr = (CsrMatrix *)calloc(1, sizeof(CsrMatrix));
+    if (csr == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "CSR matrix structure");
+        return NULL;
+    }
+    csr->rows = matrix->rows;
+    csr->cols = matrix->cols;
+    csr->ellpack_cols = matrix->ellpack_cols;
+    csr->row_offsets = (uint64_t *)malloc((matrix->rows + 1) * sizeof(uint64_t));
+    if (csr->row_offsets == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "CSR row offsets");
+        free_csr_matrix(csr);
+        return NULL;
+    }
+
+    csr->row_offsets[0] = 0;
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        csr->row_offsets[row + 1] = csr->row_offsets[row] + ellpack_row_length(matrix, row);
+    }
+
+    uint64_t entries = csr->row_offsets[matrix->rows];
+    csr->values = (float *)allocate_aligned_slab(entries, sizeof(float));
+    csr->indices = (uint64_t *)allocate_aligned_slab(entries, sizeof(uint64_t));
+    if (csr->values == NULL || csr->indices == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "CSR values/indices array");
+        free_csr_matrix(csr);
+        return NULL;
+    }
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        uint64_t offset = csr->row_offsets[row];
+        uint64_t length = csr_row_length(csr, row);
+        memcpy(csr->values + offset, ellpack_row_values(matrix, row), length * sizeof(float));
+        memcpy(csr->indices + offset, ellpack_row_indices(matrix, row), length * sizeof(uint64_t));
+    }
+    return csr;
+}
+
+/*
+ * Convert a CSR matrix back to ELLPACK with the ellpack_cols of the original matrix,
+ * the slabs come zeroed so only the stored entries are copied
+ */
+EllpackMatrix *csr_to_ellpack(const CsrMatrix *matrix)
+{
+    EllpackMatrix *ellpack = allocate_ellpack_matrix(matrix->rows, matrix->cols, matrix->ellpack_cols);
+    if (ellpack == NULL)
+    {
+        return NULL;
+    }
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        uint64_t offset = matrix->row_offsets[row];
+        uint64_t length = csr_row_length(matrix, row);
+        memcpy(ellpack_row_values(ellpack, row), matrix->values + offset, length * sizeof(float));
+        memcpy(ellpack_row_indices(ellpack, row), matrix->indices + offset, length * sizeof(uint64_t));
+        ellpack->row_lengths[row] = length;
+    }
+    return ellpack;
+}
+
+/*
+ * Prefetch the first PREFETCH_ROW_LINES cache lines of the values and indices of B row b_row
+ */
+static inline void prefetch_csr_row(const CsrMatrix *b_matrix, uint64_t b_row)
+{
+    uint64_t offset = b_matrix->row_offsets[b_row];
+    for (unsigned int line = 0; line < PREFETCH_ROW_LINES; line++)
+    {
+        __builtin_prefetch((const char *)(b_matrix->values + offset) + line * 64, 0, 3);
+        __builtin_prefetch((const char *)(b_matrix->indices + offset) + line * 64, 0, 3);
+    }
+}
+
+/*
+ * Scale the B rows of the a_length entries of an A row into the accumulator, same products in the same order
+ * as accumulate_row_simd. The B rows have no padding, so the dense path only runs over the stored entries.
+ */
+static char accumulate_csr_rows(const float *a_row_values, const uint64_t *a_row_indices, uint64_t a_length, const CsrMatrix *b_matrix, SparseAccumulator *spa)
+{
+    uint64_t flops = 0;
+    for (uint64_t a_entry = 0; a_entry < a_length; a_entry++)
+    {
+        flops += csr_row_length(b_matrix, a_row_indices[a_entry]);
+    }
+
+    AccumulatorKind kind = choose_accumulator(b_matrix->cols, flops);
+    if (spa_begin_row(spa, kind, flops) != 'S')
+    {
+        return 'F';
+    }
+    ScaleRowKernel scale_row = current_simd_kernel()->kernel;
+
+    // prefetch pipeline as in accumulate_row_simd: B rows `distance` entries ahead, result cells half as far
+    uint64_t distance = current_prefetch_distance();
+    uint64_t cell_distance = kind == ACCUMULATOR_DENSE ? distance / 2 : 0;
+    for (uint64_t a_entry = 0; a_entry < distance && a_entry < a_length; a_entry++)
+    {
+        prefetch_csr_row(b_matrix, a_row_indices[a_entry]);
+    }
+
+    for (uint64_t a_entry = 0; a_entry < a_length; a_entry++)
+    {
+        if (distance != 0 && a_entry + distance < a_length)
+        {
+            prefetch_csr_row(b_matrix, a_row_indices[a_entry + distance]);
+        }
+        if (cell_distance != 0 && a_entry + cell_distance < a_length)
+        {
+            uint64_t b_offset = b_matrix->row_offsets[a_row_indices[a_entry + cell_distance]];
+            uint64_t cells = csr_row_length(b_matrix, a_row_indices[a_entry + cell_distance]);
+            cells = cells < PREFETCH_RESULT_CELLS ? cells : PREFETCH_RESULT_CELLS;
+            for (uint64_t i = 0; i < cells; i++)
+            {
+                __builtin_prefetch(spa->values + b_matrix->indices[b_offset + i], 1, 3);
+            }
+        }
+        uint64_t a_col = a_row_indices[a_entry];
+        uint64_t b_offset = b_matrix->row_offsets[a_col];
+        uint64_t b_length = csr_row_length(b_matrix, a_col);
+        if (kind == ACCUMULATOR_DENSE)
+        {
+            scale_row(a_row_values[a_entry], b_matrix->values + b_offset, b_matrix->indices + b_offset, spa->values, b_length);
+            spa_mark(spa, b_matrix->indices + b_offset, b_length);
+        }
+        else
+        {
+            spa_scale_row(spa, a_row_values[a_entry], b_matrix->values + b_offset, b_matrix->indices + b_offset, b_length);
+        }
+    }
+    return 'S';
+}
+
+/*
+ * Accumulate row a_row of A * B with A and B in CSR
+ */
+static char accumulate_row_csr(const void *a, const void *b, uint64_t a_row, SparseAccumulator *spa)
+{
+    const CsrMatrix *a_matrix = (const CsrMatrix *)a;
+    uint64_t a_offset = a_matrix->row_offsets[a_row];
+    return accumulate_csr_rows(a_matrix->values + a_offset, a_matrix->indices + a_offset, csr_row_length(a_matrix, a_row), (const CsrMatrix *)b, spa);
+}
+
+/*
+ * Accumulate row a_row of A * B with A in ELLPACK and B in CSR
+ */
+static char accumulate_row_ell_csr(const void *a, const void *b, uint64_t a_row, SparseAccumulator *spa)
+{
+    const EllpackMatrix *a_matrix = (const EllpackMatrix *)a;
+    return accumulate_csr_rows(ellpack_row_values(a_matrix, a_row), ellpack_row_indices(a_matrix, a_row), ellpack_row_length(a_matrix, a_row), (const CsrMatrix *)b, spa);
+}
+
+/*
+ * Numeric phase of A * B with B in CSR and A in CSR (a_csr) or ELLPACK, on the calling thread (workers == 1)
+ * or on the thread pool
+ */
+static void csr_multiplication(const void *a, char a_csr, const CsrMatrix *b_matrix, EllpackMatrix *result, unsigned int workers)
+{
+    uint64_t a_rows = a_csr ? ((const CsrMatrix *)a)->rows : ((const EllpackMatrix *)a)->rows;
+    uint64_t a_cols = a_csr ? ((const CsrMatrix *)a)->cols : ((const EllpackMatrix *)a)->cols;
+    if (a_cols != b_matrix->rows)
+    {
+        fprintf(stderr, ERR_INVALID_MATRIX_DIMENSIONS, a_cols, b_matrix->rows);
+    }
+    else if (multiply_rows(a, b_matrix, b_matrix->cols, a_rows, NULL, a_csr ? accumulate_row_csr : accumulate_row_ell_csr, result, workers) == 'S')
+    {
+        return;
+    }
+    if (a_csr)
+    {
+        free_csr_matrix((CsrMatrix *)a);
+    }
+    else
+    {
+        free_ellpack_matrix((EllpackMatrix *)a);
+    }
+    free_csr_matrix((CsrMatrix *)b_matrix);
+    free_ellpack_matrix(result);
+    exit(EXIT_FAILURE);
+}
+
+/*
+ * function to multiply two CsrMatrix on the calling thread and save it to the result pointer (EllpackMatrix)
+ */
+void matr_mult_csr(const void *a, const void *b, void *result)
+{
+    csr_multiplication(a, 1, (const CsrMatrix *)b, (EllpackMatrix *)result, 1);
+}
+
+/*
+ * function to multiply two CsrMatrix on the thread pool
+ */
+void matr_mult_csr_parallel(const void *a, const void *b, void *result)
+{
+    const CsrMatrix *a_matrix = (const CsrMatrix *)a;
+    unsigned int workers = thread_pool_size();
+    csr_multiplication(a_matrix, 1, (const CsrMatrix *)b, (EllpackMatrix *)result, a_matrix->rows <= 5 * workers ? 1 : workers);
+}
+
+/*
+ * function to multiply an EllpackMatrix by a CsrMatrix on the calling thread
+ */
+void matr_mult_ell_csr(const void *a, const void *b, void *result)
+{
+    csr_multiplication(a, 0, (const CsrMatrix *)b, (EllpackMatrix *)result, 1);
+}
+
+/*
+ * function to multiply an EllpackMatrix by a CsrMatrix on the thread pool
+ */
+void matr_mult_ell_csr_parallel(const void *a, const void *b, void *result)
+{
+    const EllpackMatrix *a_matrix = (const EllpackMatrix *)a;
+    unsigned int workers = thread_pool_size();
+    csr_multiplication(a_matrix, 0, (const CsrMatrix *)b, (EllpackMatrix *)result, a_matrix->rows <= 5 * workers ? 1 : workers);
+}
@@ -0,0 +1,42 @@
+#ifndef FINAL_CSR_H
+#define FINAL_CSR_H
+
+#include <stdint.h>
+#include "utils.h"
+
+// Compressed sparse row (CSR)
+// The entries of all rows one after the other without padding, row_offsets[row] is the first entry of a row and
+// row_offsets[row + 1] the first one after it. A row keeps its valid entries (ellpack_row_length), so an explicit
+// zero inside a row survives the round trip to ELLPACK.
+
+// CsrMatrix struct
+typedef struct
+{
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t ellpack_cols;   // ellpack_cols of the ELLPACK matrix it was converted from
+    uint64_t *row_offsets;   // rows + 1 entries
+    uint64_t *indices;
+    float *values;
+} CsrMatrix;
+
+static inline uint64_t csr_row_length(const CsrMatrix *matrix, uint64_t row)
+{
+    return matrix->row_offsets[row + 1] - matrix->row_offsets[row];
+}
+
+CsrMatrix *ellpack_to_csr(const EllpackMatrix *matrix);
+
+EllpackMatrix *csr_to_ellpack(const CsrMatrix *matrix);
+
+void free_csr_matrix(CsrMatrix *matrix);
+
+void matr_mult_csr(const void *a, const void *b, void *result);
+
+void matr_mult_csr_parallel(const void *a, const void *b, void *result);
+
+void matr_mult_ell_csr(const void *a, const void *b, void *result);
+
+void matr_mult_ell_csr_parallel(const void *a, const void *b, void *result);
+
+#endif
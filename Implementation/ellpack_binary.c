@@ -0,0 +1,501 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include "ellpack_binary.h"
+#include "thread_pool.h"
+
+_Static_assert(sizeof(EllpackBinaryHeader) == 128, "EllpackBinaryHeader must not contain padding");
+
+/*
+ * Check the magic number at the start of a file
+ */
+char is_ellpack_binary(const void *data, size_t size)
+{
+    return size >= sizeof(ELLPACK_BINARY_MAGIC) && memcmp(data, ELLPACK_BINARY_MAGIC, sizeof(ELLPACK_BINARY_MAGIC)) == 0;
+}
+
+/*
+ * Fletcher-64 checksum over the 32-bit words of a block, fed in pieces whose sizes are multiples of 4.
+ * The sums are reduced every 92679 words, the most that can be added before sum2 overflows.
+ */
+void ellpack_checksum_init(EllpackChecksum *checksum)
+{
+    checksum->sum1 = 0xffffffffu;
+    checksum->sum2 = 0xffffffffu;
+    checksum->pending = 0;
+}
+
+void ellpack_checksum_update(EllpackChecksum *checksum, const void *data, uint64_t size)
+{
+    const uint32_t *words = (const uint32_t *)data;
+    uint64_t count = size / sizeof(uint32_t);
+    uint64_t sum1 = checksum->sum1;
+    uint64_t sum2 = checksum->sum2;
+
+    while (count > 0)
+    {
+        uint64_t chunk = count < 92679 - checksum->pending ? count : 92679 - checksum->pending;
+        count -= chunk;
+        for (uint64_t i = 0; i < chunk; i++)
+        {
+            sum1 += words[i];
+            sum2 += sum1;
+        }
+        words += chunk;
+        checksum->pending += chunk;
+        if (checksum->pending == 92679)
+        {
+            sum1 = (sum1 & 0xffffffffu) + (sum1 >> 32);
+            sum2 = (sum2 & 0xffffffffu) + (sum2 >> 32);
+            checksum->pending = 0;
+        }
+    }
+    checksum->sum1 = sum1;
+    checksum->sum2 = sum2;
+}
+
+uint64_t ellpack_checksum_final(const EllpackChecksum *checksum)
+{
+    uint64_t sum1 = checksum->sum1;
+    uint64_t sum2 = checksum->sum2;
+    if (checksum->pending > 0)
+    {
+        sum1 = (sum1 & 0xffffffffu) + (sum1 >> 32);
+        sum2 = (sum2 & 0xffffffffu) + (sum2 >> 32);
+    }
+    sum1 = (sum1 & 0xffffffffu) + (sum1 >> 32);
+    sum2 = (sum2 & 0xffffffffu) + (sum2 >> 32);
+    return (sum2 << 32) | sum1;
+}
+
+/*
+ * Checksum of a whole block, size must be a multiple of 4
+ */
+uint64_t ellpack_checksum(const void *data, uint64_t size)
+{
+    EllpackChecksum checksum;
+    ellpack_checksum_init(&checksum);
+    ellpack_checksum_update(&checksum, data, size);
+    return ellpack_checksum_final(&checksum);
+}
+
+static uint64_t align_up(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+/*
+ * Check the header against the file it came from, returns the reason it is invalid or NULL
+ */
+static const char *validate_header(const EllpackBinaryHeader *header, size_t mapping_size)
+{
+    if (header->version != ELLPACK_BINARY_VERSION)
+    {
+        return "unsupported version";
+    }
+    if (header->byte_order != ELLPACK_BINARY_BYTE_ORDER)
+    {
+        return "written with a different byte order";
+    }
+    if (header->header_size != sizeof(EllpackBinaryHeader))
+    {
+        return "unexpected header size";
+    }
+    if (header->header_checksum != ellpack_checksum(header, offsetof(EllpackBinaryHeader, header_checksum)))
+    {
+        return "header checksum mismatch";
+    }
+    if (header->rows == 0 || header->cols == 0)
+    {
+        return "the dimensions of the matrix cannot be 0";
+    }
+    if (header->ellpack_cols > header->cols)
+    {
+        return "ellpack_cols larger than the column dimension";
+    }
+    if (header->stride != ellpack_row_stride(header->ellpack_cols))
+    {
+        return "unexpected row stride";
+    }
+    // a multiple of ELLPACK_ALIGNMENT and at least that, before anything is taken modulo it
+    if (header->alignment < ELLPACK_ALIGNMENT || header->alignment % ELLPACK_ALIGNMENT != 0)
+    {
+        return "invalid block alignment";
+    }
+    if (header->values_offset % header->alignment != 0 || header->indices_offset % header->alignment != 0
+        || header->row_lengths_offset % header->alignment != 0)
+    {
+        return "misaligned blocks";
+    }
+    if (header->file_size != mapping_size)
+    {
+        return "truncated file";
+    }
+
+    // the blocks must lie inside the file and must not overlap
+    if (header->stride != 0 && header->rows > UINT64_MAX / sizeof(uint64_t) / header->stride)
+    {
+        return "blocks too large";
+    }
+    uint64_t values_size = header->rows * header->stride * sizeof(float);
+    uint64_t indices_size = header->rows * header->stride * sizeof(uint64_t);
+    uint64_t row_lengths_size = header->rows * sizeof(uint64_t);
+    if (header->values_offset < sizeof(EllpackBinaryHeader) || header->values_offset > mapping_size
+        || values_size > mapping_size - header->values_offset)
+    {
+        return "values block out of bounds";
+    }
+    if (header->indices_offset < header->values_offset + values_size || header->indices_offset > mapping_size
+        || indices_size > mapping_size - header->indices_offset)
+    {
+        return "indices block out of bounds";
+    }
+    if (header->row_lengths_offset < header->indices_offset + indices_size || header->row_lengths_offset > mapping_size
+        || row_lengths_size > mapping_size - header->row_lengths_offset)
+    {
+        return "row lengths block out of bounds";
+    }
+    return NULL;
+}
+
+/*
+ * Check one row against the invariants the text loader enforces while parsing: it is not longer than
+ * ellpack_cols, the values of its valid entries are finite, their indices are in bounds and distinct
+ * (the AVX2 kernel scatters lane by lane and needs them distinct), and the slots after the valid entries
+ * are zero up to the stride. appeared is the text loader's duplicate check: appeared[index] == row + 1
+ * if index already occurred in the row. Returns the reason the row is invalid or NULL.
+ */
+static const char *validate_row(const EllpackMatrix *matrix, uint64_t row, uint64_t length, uint64_t *appeared)
+{
+    const float *row_values = ellpack_row_values(matrix, row);
+    const uint64_t *row_indices = ellpack_row_indices(matrix, row);
+    if (length > matrix->ellpack_cols)
+    {
+        return "row longer than ellpack_cols";
+    }
+    for (uint64_t col = 0; col < length; col++)
+    {
+        if (!isfinite(row_values[col]))
+        {
+            return "value is not finite";
+        }
+        if (row_indices[col] >= matrix->cols)
+        {
+            return "index out of bounds";
+        }
+        if (appeared[row_indices[col]] == row + 1)
+        {
+            return "duplicate index in a row";
+        }
+        appeared[row_indices[col]] = row + 1;
+    }
+    for (uint64_t col = length; col < matrix->stride; col++)
+    {
+        if (row_values[col] != 0 || row_indices[col] != 0)
+        {
+            return "row padding is not zero";
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Check the blocks against their checksums and every row with validate_row.
+ * Returns the reason the blocks are invalid or NULL.
+ */
+static const char *validate_blocks(const EllpackBinaryHeader *header, const EllpackMatrix *matrix, const uint64_t *row_lengths)
+{
+    uint64_t entries = matrix->rows * matrix->stride;
+    if (ellpack_checksum(matrix->values, entries * sizeof(float)) != header->values_checksum)
+    {
+        return "values checksum mismatch";
+    }
+    if (ellpack_checksum(matrix->indices, entries * sizeof(uint64_t)) != header->indices_checksum)
+    {
+        return "indices checksum mismatch";
+    }
+    if (ellpack_checksum(row_lengths, matrix->rows * sizeof(uint64_t)) != header->row_lengths_checksum)
+    {
+        return "row lengths checksum mismatch";
+    }
+
+    uint64_t *appeared = (uint64_t *)calloc(matrix->cols, sizeof(uint64_t));
+    if (appeared == NULL)
+    {
+        return "not enough memory to check for duplicate indices";
+    }
+    const char *reason = NULL;
+    for (uint64_t row = 0; row < matrix->rows && reason == NULL; row++)
+    {
+        reason = validate_row(matrix, row, row_lengths[row], appeared);
+    }
+    free(appeared);
+    return reason;
+}
+
+/*
+ * Use a read-only mapping of a binary ELLPACK file as a matrix. The slabs of the returned matrix point
+ * into the mapping, which is owned by the matrix from then on and unmapped by free_ellpack_matrix.
+ * Returns NULL (the mapping stays with the caller) if the file is invalid.
+ */
+EllpackMatrix *map_ellpack_binary(void *mapping, size_t mapping_size, const char *filename)
+{
+    const EllpackBinaryHeader *header = (const EllpackBinaryHeader *)mapping;
+    if (mapping_size < sizeof(EllpackBinaryHeader))
+    {
+        fprintf(stderr, ERR_INVALID_BINARY_FILE, filename, "truncated header");
+        return NULL;
+    }
+    const char *reason = validate_header(header, mapping_size);
+    if (reason != NULL)
+    {
+        fprintf(stderr, ERR_INVALID_BINARY_FILE, filename, reason);
+        return NULL;
+    }
+
+    EllpackMatrix *matrix = (EllpackMatrix *)malloc(sizeof(EllpackMatrix));
+    if (matrix == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "matrix structure");
+        return NULL;
+    }
+    matrix->rows = header->rows;
+    matrix->cols = header->cols;
+    matrix->ellpack_cols = header->ellpack_cols;
+    matrix->stride = header->stride;
+    matrix->values = (float *)((char *)mapping + header->values_offset);
+    matrix->indices = (uint64_t *)((char *)mapping + header->indices_offset);
+    matrix->mapping = NULL;
+    matrix->mapping_size = 0;
+    matrix->index_bits = 64;
+    matrix->indices32 = NULL;
+    matrix->index_bases = NULL;
+    matrix->index_deltas = NULL;
+
+    const uint64_t *row_lengths = (const uint64_t *)((char *)mapping + header->row_lengths_offset);
+    reason = validate_blocks(header, matrix, row_lengths);
+    if (reason != NULL)
+    {
+        fprintf(stderr, ERR_INVALID_BINARY_FILE, filename, reason);
+        free(matrix);
+        return NULL;
+    }
+
+    // the row lengths are copied, free_ellpack_matrix frees them like those of any other matrix
+    matrix->row_lengths = (uint64_t *)malloc(matrix->rows * sizeof(uint64_t));
+    if (matrix->row_lengths == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "row lengths");
+        free(matrix);
+        return NULL;
+    }
+    memcpy(matrix->row_lengths, row_lengths, matrix->rows * sizeof(uint64_t));
+
+    matrix->mapping = mapping;
+    matrix->mapping_size = mapping_size;
+    return matrix;
+}
+
+/*
+ * Write zero bytes up to offset
+ */
+static char pad_to(FILE *file, uint64_t *position, uint64_t offset)
+{
+    static const char zeros[ELLPACK_BINARY_ALIGNMENT] = {0};
+    while (*position < offset)
+    {
+        uint64_t chunk = offset - *position < sizeof(zeros) ? offset - *position : sizeof(zeros);
+        if (fwrite(zeros, 1, chunk, file) != chunk)
+        {
+            return 'F';
+        }
+        *position += chunk;
+    }
+    return 'S';
+}
+
+typedef enum
+{
+    BINARY_VALUES_BLOCK,
+    BINARY_INDICES_BLOCK,
+    BINARY_ROW_LENGTHS_BLOCK
+} BinaryBlock;
+
+// BinaryWriterContext struct, one batch of rows of a block
+typedef struct
+{
+    const EllpackRowStream *stream;
+    uint64_t stride;
+    uint64_t batch_start;  // first row of the batch
+    BinaryBlock block;
+    void *buffer;          // rows of the batch, stride entries each (one row length each for the row lengths block)
+} BinaryWriterContext;
+
+/*
+ * Copy the rows [start, end) of the batch into the buffer, the slots after the valid entries of a row
+ * zeroed up to the stride, run on the thread pool
+ */
+static void copy_row_block(void *arg, uint64_t start, uint64_t end, unsigned int worker)
+{
+    BinaryWriterContext *context = (BinaryWriterContext *)arg;
+    const EllpackRowStream *stream = context->stream;
+    for (uint64_t row = start; row < end; row++)
+    {
+        const float *row_values;
+        const uint64_t *row_indices;
+        uint64_t length;
+        stream->get_row(stream->context, context->batch_start + row, worker, &row_values, &row_indices, &length);
+        if (context->block == BINARY_ROW_LENGTHS_BLOCK)
+        {
+            ((uint64_t *)context->buffer)[row] = length;
+        }
+        else if (context->block == BINARY_INDICES_BLOCK)
+        {
+            uint64_t *out = (uint64_t *)context->buffer + row * context->stride;
+            memcpy(out, row_indices, length * sizeof(uint64_t));
+            memset(out + length, 0, (context->stride - length) * sizeof(uint64_t));
+        }
+        else
+        {
+            float *out = (float *)context->buffer + row * context->stride;
+            memcpy(out, row_values, length * sizeof(float));
+            memset(out + length, 0, (context->stride - length) * sizeof(float));
+        }
+    }
+}
+
+/*
+ * Write one block batch by batch and checksum it on the way
+ */
+static char write_block(FILE *file, BinaryWriterContext *context, uint64_t rows_per_batch, uint64_t *position, uint64_t *checksum)
+{
+    uint64_t row_size = context->block == BINARY_ROW_LENGTHS_BLOCK ? sizeof(uint64_t)
+                        : context->block == BINARY_INDICES_BLOCK   ? context->stride * sizeof(uint64_t)
+                                                                   : context->stride * sizeof(float);
+    EllpackChecksum sum;
+    ellpack_checksum_init(&sum);
+    for (uint64_t batch_start = 0; row_size != 0 && batch_start < context->stream->rows; batch_start += rows_per_batch)
+    {
+        uint64_t batch_rows = context->stream->rows - batch_start < rows_per_batch ? context->stream->rows - batch_start : rows_per_batch;
+        context->batch_start = batch_start;
+        thread_pool_run_rows(batch_rows, copy_row_block, context);
+
+        uint64_t size = batch_rows * row_size;
+        ellpack_checksum_update(&sum, context->buffer, size);
+        if (fwrite(context->buffer, 1, size, file) != size)
+        {
+            return 'F';
+        }
+        *position += size;
+    }
+    *checksum = ellpack_checksum_final(&sum);
+    return 'S';
+}
+
+/*
+ * Write the rows of the stream as a binary ELLPACK file. The blocks are written first, the header with
+ * their checksums last, so the rows are requested once per block and never held in memory as a whole.
+ */
+char dump_ellpack_binary_stream(const char *filename, const EllpackRowStream *stream)
+{
+    uint64_t stride = ellpack_row_stride(stream->ellpack_cols);
+    uint64_t entries = stream->rows * stride;
+
+    EllpackBinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ELLPACK_BINARY_MAGIC, sizeof(ELLPACK_BINARY_MAGIC));
+    header.version = ELLPACK_BINARY_VERSION;
+    header.byte_order = ELLPACK_BINARY_BYTE_ORDER;
+    header.header_size = sizeof(EllpackBinaryHeader);
+    header.rows = stream->rows;
+    header.cols = stream->cols;
+    header.ellpack_cols = stream->ellpack_cols;
+    header.stride = stride;
+    header.alignment = ELLPACK_BINARY_ALIGNMENT;
+    header.values_offset = align_up(sizeof(EllpackBinaryHeader), ELLPACK_BINARY_ALIGNMENT);
+    header.indices_offset = align_up(header.values_offset + entries * sizeof(float), ELLPACK_BINARY_ALIGNMENT);
+    header.row_lengths_offset = align_up(header.indices_offset + entries * sizeof(uint64_t), ELLPACK_BINARY_ALIGNMENT);
+    header.file_size = header.row_lengths_offset + stream->rows * sizeof(uint64_t);
+
+    // a matrix without entries (ellpack_cols == 0, stride 0) has no values and no indices to write,
+    // its batches are sized by the row lengths block alone
+    uint64_t row_bytes = (stride != 0 ? stride : 1) * sizeof(uint64_t);
+    uint64_t rows_per_batch = BINARY_WRITER_BATCH_BYTES / row_bytes;
+    if (rows_per_batch == 0)
+    {
+        rows_per_batch = 1;
+    }
+    BinaryWriterContext context;
+    context.stream = stream;
+    context.stride = stride;
+    context.buffer = malloc(rows_per_batch * row_bytes);
+    if (context.buffer == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "output buffer");
+        return 'F';
+    }
+
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL)
+    {
+        fprintf(stderr, ERR_OPEN_FILE_FAILED, filename);
+        free(context.buffer);
+        return 'F';
+    }
+
+    // zeros in place of the header until the checksums are known
+    uint64_t position = 0;
+    char status = pad_to(file, &position, header.values_offset);
+    if (status == 'S')
+    {
+        context.block = BINARY_VALUES_BLOCK;
+        status = write_block(file, &context, rows_per_batch, &position, &header.values_checksum);
+    }
+    if (status == 'S')
+    {
+        status = pad_to(file, &position, header.indices_offset);
+    }
+    if (status == 'S')
+    {
+        context.block = BINARY_INDICES_BLOCK;
+        status = write_block(file, &context, rows_per_batch, &position, &header.indices_checksum);
+    }
+    if (status == 'S')
+    {
+        status = pad_to(file, &position, header.row_lengths_offset);
+    }
+    if (status == 'S')
+    {
+        context.block = BINARY_ROW_LENGTHS_BLOCK;
+        status = write_block(file, &context, rows_per_batch, &position, &header.row_lengths_checksum);
+    }
+    header.header_checksum = ellpack_checksum(&header, offsetof(EllpackBinaryHeader, header_checksum));
+    if (status == 'S' && (fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1))
+    {
+        status = 'F';
+    }
+    if (fclose(file) != 0)
+    {
+        status = 'F';
+    }
+    free(context.buffer);
+
+    if (status != 'S')
+    {
+        fprintf(stderr, ERR_WRITE_FILE_FAILED, filename);
+    }
+    return status;
+}
+
+/*
+ * Write a matrix as a binary ELLPACK file
+ */
+char dump_ellpack_binary(const char *filename, const EllpackMatrix *matrix)
+{
+    EllpackRowStream stream;
+    ellpack_matrix_rows(matrix, matrix->ellpack_cols, &stream);
+    return dump_ellpack_binary_stream(filename, &stream);
+}
@@ -0,0 +1,68 @@
+#ifndef FINAL_ELLPACK_BINARY_H
+#define FINAL_ELLPACK_BINARY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "utils.h"
+#include "ellpack_writer.h"
+
+// Binary ELLPACK container (version 2)
+// A fixed header followed by the values and the indices slab exactly as EllpackMatrix keeps them in memory:
+// rows * stride entries each, rows padded to the stride with zeros, and the row lengths (rows uint64_t, the
+// number of valid entries of every row, the slots after them are zero). The blocks start on a multiple of
+// ELLPACK_BINARY_ALIGNMENT, so a read-only mapping of the file is used as the matrix without any copy.
+// Version 1 files (no row lengths) are rejected, they have to be written again from their text files.
+// All fields are stored in the byte order of the machine that wrote the file, byte_order tells which one.
+
+#define ELLPACK_BINARY_MAGIC "ELLPBIN" // 7 characters and the terminating 0, text files start with a digit
+#define ELLPACK_BINARY_VERSION 2
+#define ELLPACK_BINARY_BYTE_ORDER 0x01020304u
+#define ELLPACK_BINARY_ALIGNMENT 4096 // page size, the blocks are mapped where the file puts them
+#define BINARY_WRITER_BATCH_BYTES (4 << 20) // rows are written in batches of about this many bytes of indices
+
+typedef struct
+{
+    char magic[8];                 // ELLPACK_BINARY_MAGIC
+    uint32_t version;              // ELLPACK_BINARY_VERSION
+    uint32_t byte_order;           // ELLPACK_BINARY_BYTE_ORDER as stored by the writer
+    uint64_t header_size;          // sizeof(EllpackBinaryHeader)
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t ellpack_cols;
+    uint64_t stride;               // ellpack_row_stride(ellpack_cols)
+    uint64_t alignment;            // the block offsets are multiples of it
+    uint64_t values_offset;        // rows * stride floats
+    uint64_t indices_offset;       // rows * stride uint64_t
+    uint64_t row_lengths_offset;   // rows uint64_t
+    uint64_t file_size;
+    uint64_t values_checksum;      // ellpack_checksum of the values block
+    uint64_t indices_checksum;     // ellpack_checksum of the indices block
+    uint64_t row_lengths_checksum; // ellpack_checksum of the row lengths block
+    uint64_t header_checksum;      // ellpack_checksum of all header fields before this one
+} EllpackBinaryHeader;
+
+char is_ellpack_binary(const void *data, size_t size);
+
+// EllpackChecksum struct, running state of ellpack_checksum for a block written in pieces
+typedef struct
+{
+    uint64_t sum1;
+    uint64_t sum2;
+    uint64_t pending; // words added since the last reduction
+} EllpackChecksum;
+
+void ellpack_checksum_init(EllpackChecksum *checksum);
+
+void ellpack_checksum_update(EllpackChecksum *checksum, const void *data, uint64_t size);
+
+uint64_t ellpack_checksum_final(const EllpackChecksum *checksum);
+
+uint64_t ellpack_checksum(const void *data, uint64_t size);
+
+EllpackMatrix *map_ellpack_binary(void *mapping, size_t mapping_size, const char *filename);
+
+char dump_ellpack_binary_stream(const char *filename, const EllpackRowStream *stream);
+
+char dump_ellpack_binary(const char *filename, const EllpackMatrix *matrix);
+
+#endif
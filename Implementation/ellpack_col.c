@@ -0,0 +1,184 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ellpack_col.h"
+#include "optimizations.h"
+#include "accumulator.h"
+#include "thread_pool.h"
+
+#define ELLCOL_MAX_COLS ((uint64_t)INT32_MAX) // the gathers take signed 32-bit indices, row lengths compare signed
+
+/*
+ * Helper method to free memory of a column-major ELLPACK matrix
+ */
+void free_ellcol_matrix(EllColMatrix *matrix)
+{
+    if (matrix != NULL)
+    {
+        free(matrix->block_widths);
+        free(matrix->row_lengths);
+        free(matrix->values);
+        free(matrix->indices);
+        free(matrix);
+    }
+}
+
+/*
+ * Convert an EllpackMatrix to column-major ELLPACK.
+ * Returns NULL if it has 2^31 or more columns or does not fit into memory.
+ */
+EllColMatrix *ellpack_to_ellcol(const EllpackMatrix *matrix)
+{
+    if (matrix->cols > ELLCOL_MAX_COLS)
+    {
+        fprintf(stderr, "Error: Column-major ELLPACK takes fewer than 2^31 columns, the matrix has %" PRIu64 "\n", matrix->cols);
+        return NULL;
+    }
+    EllColMatrix *ellcol = (EllColMatrix *)calloc(1, sizeof(EllColMatrix));
+    if (ellcol == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "column-major ELLPACK matrix structure");
+        return NULL;
+    }
+    ellcol->rows = matrix->rows;
+    ellcol->cols = matrix->cols;
+    ellcol->ellpack_cols = matrix->ellpack_cols;
+    ellcol->padded_rows = (matrix->rows + ELLCOL_BLOCK_ROWS - 1) / ELLCOL_BLOCK_ROWS * ELLCOL_BLOCK_ROWS;
+    uint64_t blocks = ellcol->padded_rows / ELLCOL_BLOCK_ROWS;
+    ellcol->block_widths = (uint64_t *)calloc(blocks + 1, sizeof(uint64_t));
+    ellcol->row_lengths = (uint32_t *)allocate_aligned_slab(ellcol->padded_rows, sizeof(uint32_t));
+    if (ellcol->ellpack_cols == 0 || ellcol->padded_rows <= UINT64_MAX / ellcol->ellpack_cols)
+    {
+        ellcol->values = (float *)allocate_aligned_slab(ellcol->ellpack_cols * ellcol->padded_rows, sizeof(float));
+        ellcol->indices = (uint32_t *)allocate_aligned_slab(ellcol->ellpack_cols * ellcol->padded_rows, sizeof(uint32_t));
+    }
+    if (ellcol->block_widths == NULL || ellcol->row_lengths == NULL || ellcol->values == NULL || ellcol->indices == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "column-major ELLPACK matrix");
+        free_ellcol_matrix(ellcol);
+        return NULL;
+    }
+
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        const float *row_values = ellpack_row_values(matrix, row);
+        const uint64_t *row_indices = ellpack_row_indices(matrix, row);
+        uint64_t length = ellpack_row_length(matrix, row);
+        for (uint64_t slot = 0; slot < length; slot++)
+        {
+            ellcol->values[slot * ellcol->padded_rows + row] = row_values[slot];
+            ellcol->indices[slot * ellcol->padded_rows + row] = (uint32_t)row_indices[slot];
+        }
+        ellcol->row_lengths[row] = (uint32_t)length;
+        uint64_t *width = &ellcol->block_widths[row / ELLCOL_BLOCK_ROWS];
+        *width = length > *width ? length : *width;
+    }
+    return ellcol;
+}
+
+/*
+ * Convert a column-major ELLPACK matrix back to an EllpackMatrix
+ */
+EllpackMatrix *ellcol_to_ellpack(const EllColMatrix *matrix)
+{
+    EllpackMatrix *ellpack = allocate_ellpack_matrix(matrix->rows, matrix->cols, matrix->ellpack_cols);
+    if (ellpack == NULL)
+    {
+        return NULL;
+    }
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        float *row_values = ellpack_row_values(ellpack, row);
+        uint64_t *row_indices = ellpack_row_indices(ellpack, row);
+        for (uint64_t slot = 0; slot < matrix->row_lengths[row]; slot++)
+        {
+            row_values[slot] = matrix->values[slot * matrix->padded_rows + row];
+            row_indices[slot] = matrix->indices[slot * matrix->padded_rows + row];
+        }
+        ellpack->row_lengths[row] = matrix->row_lengths[row];
+    }
+    return ellpack;
+}
+
+/*
+ * Accumulate row a_row of A * B into the accumulator (A column-major, B ELLPACK),
+ * same products in the same order as accumulate_row_simd
+ */
+static char accumulate_row_ellcol(const void *a, const void *b, uint64_t a_row, SparseAccumulator *spa)
+{
+    const EllColMatrix *a_matrix = (const EllColMatrix *)a;
+    const EllpackMatrix *b_matrix = (const EllpackMatrix *)b;
+    uint64_t a_length = a_matrix->row_lengths[a_row];
+    uint64_t flops = 0;
+    for (uint64_t slot = 0; slot < a_length; slot++)
+    {
+        flops += ellpack_row_length(b_matrix, a_matrix->indices[slot * a_matrix->padded_rows + a_row]);
+    }
+
+    AccumulatorKind kind = choose_accumulator(b_matrix->cols, flops);
+    if (spa_begin_row(spa, kind, flops) != 'S')
+    {
+        return 'F';
+    }
+    ScaleRowKernel scale_row = current_simd_kernel()->kernel;
+
+    for (uint64_t slot = 0; slot < a_length; slot++)
+    {
+        float a_val = a_matrix->values[slot * a_matrix->padded_rows + a_row];
+        uint64_t a_col = a_matrix->indices[slot * a_matrix->padded_rows + a_row];
+        const float *b_row_vector = ellpack_row_values(b_matrix, a_col);
+        const uint64_t *b_row_indices = ellpack_row_indices(b_matrix, a_col);
+        uint64_t b_length = ellpack_row_length(b_matrix, a_col);
+        if (kind == ACCUMULATOR_DENSE)
+        {
+            scale_row(a_val, b_row_vector, b_row_indices, spa->values, b_length);
+            spa_mark(spa, b_row_indices, b_length);
+        }
+        else
+        {
+            spa_scale_row(spa, a_val, b_row_vector, b_row_indices, b_length);
+        }
+    }
+    return 'S';
+}
+
+/*
+ * Numeric phase of A * B with A column-major and B ELLPACK, on the calling thread (workers == 1) or on the thread pool
+ */
+static void ellcol_multiplication(const EllColMatrix *a_matrix, const EllpackMatrix *b_matrix, EllpackMatrix *result, unsigned int workers)
+{
+    if (a_matrix->cols != b_matrix->rows)
+    {
+        fprintf(stderr, ERR_INVALID_MATRIX_DIMENSIONS, a_matrix->cols, b_matrix->rows);
+        free_ellcol_matrix((EllColMatrix *)a_matrix);
+        free_ellpack_matrix((EllpackMatrix *)b_matrix);
+        free_ellpack_matrix(result);
+        exit(EXIT_FAILURE);
+    }
+    if (multiply_rows(a_matrix, b_matrix, b_matrix->cols, a_matrix->rows, NULL, accumulate_row_ellcol, result, workers) != 'S')
+    {
+        free_ellcol_matrix((EllColMatrix *)a_matrix);
+        free_ellpack_matrix((EllpackMatrix *)b_matrix);
+        free_ellpack_matrix(result);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * function to multiply a column-major ELLPACK matrix by an EllpackMatrix on the calling thread
+ */
+void matr_mult_ellcol(const void *a, const void *b, void *result)
+{
+    ellcol_multiplication((const EllColMatrix *)a, (const EllpackMatrix *)b, (EllpackMatrix *)result, 1);
+}
+
+/*
+ * function to multiply a column-major ELLPACK matrix by an EllpackMatrix on the thread pool
+ */
+void matr_mult_ellcol_parallel(const void *a, const void *b, void *result)
+{
+    const EllColMatrix *a_matrix = (const EllColMatrix *)a;
+    unsigned int workers = thread_pool_size();
+    ellcol_multiplication(a_matrix, (const EllpackMatrix *)b, (EllpackMatrix *)result, a_matrix->rows <= 5 * workers ? 1 : workers);
+}
@@ -0,0 +1,41 @@
+#ifndef FINAL_ELLPACK_COL_H
+#define FINAL_ELLPACK_COL_H
+
+#include <stdint.h>
+#include "utils.h"
+
+// Column-major ELLPACK
+// Slot k of all rows is stored contiguously (values[k * padded_rows + row]), the layout of ELLPACK on GPUs: one
+// vector load of slot k covers ELLCOL_BLOCK_ROWS consecutive rows, so a multiplication by a dense x runs one lane
+// per row and writes a column of y with one contiguous store. All ellpack_cols slots of every row are allocated,
+// but the kernels only run a block up to its longest row (block_widths) and never read the slots after it; a lane
+// skips the slots after the end of its row, so every y element sums the same products in the same order as with
+// EllpackMatrix. Indices are 32 bits (the gathers take signed 32-bit indices), so the matrix has fewer than 2^31
+// columns. As operand A of A * B (STORAGE_ELL_COL) B stays ELLPACK.
+
+#define ELLCOL_BLOCK_ROWS 16 // rows per block, one AVX-512 register of floats; padded_rows is a multiple of it
+
+// EllColMatrix struct
+typedef struct
+{
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t ellpack_cols;   // ellpack_cols of the ELLPACK matrix it was converted from
+    uint64_t padded_rows;    // rows rounded up to ELLCOL_BLOCK_ROWS, the padding rows are empty
+    uint64_t *block_widths;  // longest row of every block of ELLCOL_BLOCK_ROWS rows, the slots the kernels run over
+    uint32_t *row_lengths;   // valid entries of every row (padded_rows of them, loaded one block at a time)
+    float *values;           // ellpack_cols * padded_rows slots, slot k of row r at k * padded_rows + r
+    uint32_t *indices;
+} EllColMatrix;
+
+EllColMatrix *ellpack_to_ellcol(const EllpackMatrix *matrix);
+
+EllpackMatrix *ellcol_to_ellpack(const EllColMatrix *matrix);
+
+void free_ellcol_matrix(EllColMatrix *matrix);
+
+void matr_mult_ellcol(const void *a, const void *b, void *result);
+
+void matr_mult_ellcol_parallel(const void *a, const void *b, void *result);
+
+#endif
@@ -0,0 +1,340 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ellpack_plan.h"
+#include "symbolic.h"
+#include "optimizations.h"
+#include "accumulator.h"
+#include "compact_indices.h"
+#include "thread_pool.h"
+
+#define ACCUMULATOR_KIND_COUNT 3
+
+// EllpackPlan struct, everything ellpack_execute needs besides the values
+struct EllpackPlan
+{
+    EllpackMatrix *a;                 // copies of the patterns, values stays NULL
+    EllpackMatrix *b;
+    uint64_t result_ellpack_cols;     // from the symbolic phase
+    unsigned int workers;             // 1: the numeric phase runs on the calling thread
+    uint64_t block_count;
+    uint64_t *block_bounds;           // block_count + 1 row bounds of the pool blocks
+    SparseAccumulator **accumulators; // one per worker, sized for the largest row of every kind
+    char *status;                     // one per worker, 'F' if accumulating a row failed
+};
+
+// PlanExecution struct, shared by the workers of one ellpack_execute
+typedef struct
+{
+    EllpackPlan *plan;
+    const EllpackMatrix *a;
+    const EllpackMatrix *b;
+    EllpackMatrix *result;
+} PlanExecution;
+
+void default_plan_options(EllpackPlanOptions *options)
+{
+    options->parallel = true;
+    options->index_bits = INDEX_BITS_AUTO;
+}
+
+const char *ellpack_status_message(EllpackStatus status)
+{
+    switch (status)
+    {
+    case ELLPACK_SUCCESS:
+        return "success";
+    case ELLPACK_INVALID_ARGUMENT:
+        return "invalid argument";
+    case ELLPACK_INVALID_DIMENSIONS:
+        return "columns of A != rows of B";
+    case ELLPACK_INVALID_RESULT:
+        return "result matrix does not have the shape of the product";
+    case ELLPACK_OUT_OF_MEMORY:
+        return "out of memory";
+    default:
+        return "unknown status";
+    }
+}
+
+/*
+ * Check a caller's pattern against the invariants the loaders enforce (see validate_row in ellpack_binary.c):
+ * rows fit the stride and are not longer than ellpack_cols, their indices are in bounds and distinct. Out of bounds
+ * indices would write outside the accumulator, repeated ones lose products in the AVX2 kernel, which stores its
+ * lanes one by one. appeared[index] == row + 1 if index already occurred in the row, as in the text loader.
+ */
+static EllpackStatus check_pattern(const EllpackMatrix *pattern)
+{
+    if (pattern->ellpack_cols > pattern->stride)
+    {
+        return ELLPACK_INVALID_ARGUMENT;
+    }
+    uint64_t *appeared = (uint64_t *)calloc(pattern->cols, sizeof(uint64_t));
+    if (appeared == NULL && pattern->cols != 0)
+    {
+        return ELLPACK_OUT_OF_MEMORY;
+    }
+    EllpackStatus status = ELLPACK_SUCCESS;
+    for (uint64_t row = 0; row < pattern->rows && status == ELLPACK_SUCCESS; row++)
+    {
+        uint64_t length = ellpack_row_length(pattern, row);
+        if (length > pattern->ellpack_cols)
+        {
+            status = ELLPACK_INVALID_ARGUMENT;
+        }
+        for (uint64_t entry = 0; entry < length && status == ELLPACK_SUCCESS; entry++)
+        {
+            uint64_t index = ellpack_index(pattern, row, entry);
+            if (index >= pattern->cols || appeared[index] == row + 1)
+            {
+                status = ELLPACK_INVALID_ARGUMENT;
+            }
+            else
+            {
+                appeared[index] = row + 1;
+            }
+        }
+    }
+    free(appeared);
+    return status;
+}
+
+/*
+ * Copy the indices and row lengths of a matrix (in any index width) into a new matrix with 64-bit indices
+ * and the same stride, without values. Returns NULL if it does not fit into memory.
+ */
+static EllpackMatrix *copy_pattern(const EllpackMatrix *pattern)
+{
+    EllpackMatrix *copy = (EllpackMatrix *)calloc(1, sizeof(EllpackMatrix));
+    if (copy == NULL)
+    {
+        return NULL;
+    }
+    copy->rows = pattern->rows;
+    copy->cols = pattern->cols;
+    copy->ellpack_cols = pattern->ellpack_cols;
+    copy->stride = pattern->stride;
+    copy->index_bits = 64;
+    copy->indices = (uint64_t *)allocate_aligned_slab(pattern->rows * pattern->stride, sizeof(uint64_t));
+    copy->row_lengths = (uint64_t *)calloc(pattern->rows + 1, sizeof(uint64_t));
+    if (copy->indices == NULL || copy->row_lengths == NULL)
+    {
+        free_ellpack_matrix(copy);
+        return NULL;
+    }
+
+    for (uint64_t row = 0; row < pattern->rows; row++)
+    {
+        uint64_t length = ellpack_row_length(pattern, row);
+        uint64_t *row_indices = ellpack_row_indices(copy, row);
+        for (uint64_t entry = 0; entry < length; entry++)
+        {
+            row_indices[entry] = ellpack_index(pattern, row, entry);
+        }
+        copy->row_lengths[row] = length;
+    }
+    return copy;
+}
+
+/*
+ * Allocate one accumulator per worker and grow the buffers of every accumulator kind to the largest row that
+ * uses it, any worker may get any row. Returns 'F' if they do not fit into memory.
+ */
+static char size_accumulators(EllpackPlan *plan, const uint64_t *flop_prefix)
+{
+    uint64_t max_flops[ACCUMULATOR_KIND_COUNT] = {0};
+    bool used[ACCUMULATOR_KIND_COUNT] = {false};
+    for (uint64_t row = 0; row < plan->a->rows; row++)
+    {
+        uint64_t flops = flop_prefix[row + 1] - flop_prefix[row];
+        AccumulatorKind kind = choose_accumulator(plan->b->cols, flops);
+        used[kind] = true;
+        max_flops[kind] = flops > max_flops[kind] ? flops : max_flops[kind];
+    }
+
+    for (unsigned int worker = 0; worker < plan->workers; worker++)
+    {
+        plan->accumulators[worker] = allocate_sparse_accumulator(plan->b->cols);
+        if (plan->accumulators[worker] == NULL)
+        {
+            return 'F';
+        }
+        for (int kind = 0; kind < ACCUMULATOR_KIND_COUNT; kind++)
+        {
+            if (used[kind] && spa_begin_row(plan->accumulators[worker], (AccumulatorKind)kind, max_flops[kind]) != 'S')
+            {
+                return 'F';
+            }
+        }
+    }
+    return 'S';
+}
+
+/*
+ * Analyse the patterns of A and B for ellpack_execute: pattern copies with narrowed indices, the symbolic phase,
+ * the flop-balanced row blocks and the accumulators. options == NULL takes default_plan_options.
+ * A pattern with a row longer than ellpack_cols, an index out of bounds or an index repeated within a row
+ * is an invalid argument. On success *plan gets the plan (free it with free_ellpack_plan), otherwise NULL.
+ */
+EllpackStatus ellpack_plan(const EllpackMatrix *a_pattern, const EllpackMatrix *b_pattern, const EllpackPlanOptions *options, EllpackPlan **plan)
+{
+    if (a_pattern == NULL || b_pattern == NULL || plan == NULL)
+    {
+        return ELLPACK_INVALID_ARGUMENT;
+    }
+    *plan = NULL;
+    if (a_pattern->cols != b_pattern->rows)
+    {
+        return ELLPACK_INVALID_DIMENSIONS;
+    }
+    EllpackStatus status = check_pattern(a_pattern);
+    if (status == ELLPACK_SUCCESS)
+    {
+        status = check_pattern(b_pattern);
+    }
+    if (status != ELLPACK_SUCCESS)
+    {
+        return status;
+    }
+    EllpackPlanOptions defaults;
+    if (options == NULL)
+    {
+        default_plan_options(&defaults);
+        options = &defaults;
+    }
+
+    EllpackPlan *new_plan = (EllpackPlan *)calloc(1, sizeof(EllpackPlan));
+    if (new_plan == NULL)
+    {
+        return ELLPACK_OUT_OF_MEMORY;
+    }
+    new_plan->a = copy_pattern(a_pattern);
+    new_plan->b = new_plan->a != NULL ? copy_pattern(b_pattern) : NULL;
+    SymbolicProduct *symbolic = new_plan->b != NULL ? symbolic_multiplication(new_plan->a, new_plan->b, options->parallel) : NULL;
+    if (symbolic == NULL)
+    {
+        free_ellpack_plan(new_plan);
+        return ELLPACK_OUT_OF_MEMORY;
+    }
+    new_plan->result_ellpack_cols = symbolic->ellpack_cols;
+    free_symbolic_product(symbolic);
+    compact_ellpack_indices(new_plan->a, options->index_bits);
+    compact_ellpack_indices(new_plan->b, options->index_bits);
+
+    // same cut-off as matr_mult_ellpack_v2: a few rows per worker are not worth the pool
+    unsigned int workers = options->parallel ? thread_pool_size() : 1;
+    new_plan->workers = workers == 1 || new_plan->a->rows <= 5 * workers ? 1 : workers;
+    new_plan->block_count = new_plan->workers == 1 ? 1 : (uint64_t)new_plan->workers * THREAD_POOL_BLOCKS_PER_WORKER;
+    new_plan->block_bounds = (uint64_t *)malloc((new_plan->block_count + 1) * sizeof(uint64_t));
+    new_plan->accumulators = (SparseAccumulator **)calloc(new_plan->workers, sizeof(SparseAccumulator *));
+    new_plan->status = (char *)malloc(new_plan->workers * sizeof(char));
+    uint64_t *flop_prefix = row_flop_prefix(new_plan->a, new_plan->b);
+    if (new_plan->block_bounds == NULL || new_plan->accumulators == NULL || new_plan->status == NULL || flop_prefix == NULL ||
+        size_accumulators(new_plan, flop_prefix) != 'S')
+    {
+        free(flop_prefix);
+        free_ellpack_plan(new_plan);
+        return ELLPACK_OUT_OF_MEMORY;
+    }
+    partition_rows_by_flops(flop_prefix, new_plan->a->rows, new_plan->block_count, new_plan->block_bounds);
+    free(flop_prefix);
+
+    *plan = new_plan;
+    return ELLPACK_SUCCESS;
+}
+
+/*
+ * Allocate a result matrix for ellpack_execute, the shape of the plan's product.
+ * On success *result gets the matrix (free it with free_ellpack_matrix), otherwise NULL.
+ */
+EllpackStatus ellpack_plan_allocate_result(const EllpackPlan *plan, EllpackMatrix **result)
+{
+    if (plan == NULL || result == NULL)
+    {
+        return ELLPACK_INVALID_ARGUMENT;
+    }
+    *result = allocate_ellpack_matrix(plan->a->rows, plan->b->cols, plan->result_ellpack_cols);
+    return *result != NULL ? ELLPACK_SUCCESS : ELLPACK_OUT_OF_MEMORY;
+}
+
+/*
+ * Multiply the rows [start, end) with the accumulator of pool worker `worker`
+ */
+static void plan_row_block(void *context, uint64_t start, uint64_t end, unsigned int worker)
+{
+    PlanExecution *execution = (PlanExecution *)context;
+    SparseAccumulator *spa = execution->plan->accumulators[worker];
+    for (uint64_t a_row = start; a_row < end; a_row++)
+    {
+        if (accumulate_row_simd(execution->a, execution->b, a_row, spa) != 'S')
+        {
+            execution->plan->status[worker] = 'F';
+            return;
+        }
+        spa_store_row(spa, execution->result, a_row);
+    }
+}
+
+/*
+ * Numeric phase of the plan for the values of A and B (the values slabs of matrices with the planned patterns),
+ * into result (from ellpack_plan_allocate_result, or any EllpackMatrix of that shape with allocated 64-bit indices).
+ * Allocates nothing; the result is the same as the one of V1/V2 for these matrices.
+ */
+EllpackStatus ellpack_execute(EllpackPlan *plan, const float *a_values, const float *b_values, EllpackMatrix *result)
+{
+    if (plan == NULL || a_values == NULL || b_values == NULL || result == NULL)
+    {
+        return ELLPACK_INVALID_ARGUMENT;
+    }
+    if (result->rows != plan->a->rows || result->cols != plan->b->cols || result->ellpack_cols < plan->result_ellpack_cols ||
+        result->indices == NULL || result->mapping != NULL)
+    {
+        return ELLPACK_INVALID_RESULT;
+    }
+
+    // the planned patterns with the values of this execution
+    EllpackMatrix a_matrix = *plan->a;
+    EllpackMatrix b_matrix = *plan->b;
+    a_matrix.values = (float *)a_values;
+    b_matrix.values = (float *)b_values;
+    PlanExecution execution = {plan, &a_matrix, &b_matrix, result};
+    memset(plan->status, 'S', plan->workers);
+    if (plan->workers == 1)
+    {
+        plan_row_block(&execution, 0, a_matrix.rows, 0);
+    }
+    else
+    {
+        thread_pool_run(plan->block_bounds, plan->block_count, plan_row_block, &execution);
+    }
+
+    for (unsigned int worker = 0; worker < plan->workers; worker++)
+    {
+        if (plan->status[worker] != 'S')
+        {
+            return ELLPACK_OUT_OF_MEMORY;
+        }
+    }
+    return ELLPACK_SUCCESS;
+}
+
+void free_ellpack_plan(EllpackPlan *plan)
+{
+    if (plan != NULL)
+    {
+        free_ellpack_matrix(plan->a);
+        free_ellpack_matrix(plan->b);
+        if (plan->accumulators != NULL)
+        {
+            for (unsigned int worker = 0; worker < plan->workers; worker++)
+            {
+                free_sparse_accumulator(plan->accumulators[worker]);
+            }
+        }
+        free(plan->accumulators);
+        free(plan->block_bounds);
+        free(plan->status);
+        free(plan);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef FINAL_ELLPACK_PLAN_H
+#define FINAL_ELLPACK_PLAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "utils.h"
+
+// Plan / execute API of the library (make lib)
+// ellpack_plan does everything that only depends on the patterns of A and B once: it copies the patterns (narrowing
+// their indices, see compact_indices.h), runs the symbolic phase, cuts the rows into blocks of equal flops for the
+// thread pool and sizes one accumulator per worker for the largest row of every accumulator kind. ellpack_execute
+// then runs the numeric phase for new values without allocating anything, so the same plan serves any number of
+// multiplications of matrices with these patterns. The values are passed as the values slab of an EllpackMatrix
+// of the pattern (row r, entry k at r * stride + k), only the row_lengths[r] valid entries of a row are read.
+// Errors come back as EllpackStatus, nothing is freed behind the caller's back and nothing exits.
+// A plan runs one ellpack_execute at a time (its accumulators are reused); the thread pool is shared by all plans.
+
+typedef enum
+{
+    ELLPACK_SUCCESS = 0,
+    ELLPACK_INVALID_ARGUMENT,   // NULL pointer, or a pattern that breaks the ELLPACK invariants (see ellpack_plan)
+    ELLPACK_INVALID_DIMENSIONS, // columns of A != rows of B
+    ELLPACK_INVALID_RESULT,     // the result matrix does not have the shape of the plan's product
+    ELLPACK_OUT_OF_MEMORY
+} EllpackStatus;
+
+// EllpackPlanOptions struct
+typedef struct
+{
+    bool parallel;           // run on the thread pool (small products run on the calling thread anyway)
+    unsigned int index_bits; // index width of the pattern copies, see compact_indices.h
+} EllpackPlanOptions;
+
+typedef struct EllpackPlan EllpackPlan;
+
+void default_plan_options(EllpackPlanOptions *options);
+
+const char *ellpack_status_message(EllpackStatus status);
+
+EllpackStatus ellpack_plan(const EllpackMatrix *a_pattern, const EllpackMatrix *b_pattern, const EllpackPlanOptions *options, EllpackPlan **plan);
+
+EllpackStatus ellpack_plan_allocate_result(const EllpackPlan *plan, EllpackMatrix **result);
+
+EllpackStatus ellpack_execute(EllpackPlan *plan, const float *a_values, const float *b_values, EllpackMatrix *result);
+
+void free_ellpack_plan(EllpackPlan *plan);
+
+#endif
@@ -0,0 +1,324 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ellpack_writer.h"
+#include "thread_pool.h"
+
+// TextBuffer struct, the text of one row block
+typedef struct
+{
+    char *data;
+    size_t size;
+    size_t capacity;
+} TextBuffer;
+
+// WriterContext struct, one line (values or indices) of one batch of row blocks
+typedef struct
+{
+    const EllpackRowStream *stream;
+    EllpackTextStyle style;
+    char indices_line;         // 0: values line, 1: indices line
+    uint64_t batch_start;      // first row of the batch
+    uint64_t rows_per_block;
+    TextBuffer *buffers;       // one per block of the batch
+    char *status;              // one per block of the batch
+} WriterContext;
+
+/*
+ * Write value in decimal, returns the end of the text
+ */
+char *format_uint64(char *out, uint64_t value)
+{
+    char digits[20];
+    int count = 0;
+    do
+    {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (count > 0)
+    {
+        *out++ = digits[--count];
+    }
+    return out;
+}
+
+/*
+ * Same text as printf("%.1f", value) for finite values, returns the end of the text.
+ * A float times 10 is exact in a double (24 + 4 bits), so rounding that product to an integer
+ * (ties to even, like printf) gives the printed tenths. Values of 1e17 and more go through snprintf.
+ */
+char *format_float_1(char *out, float value)
+{
+    double scaled = fabs((double)value) * 10.0;
+    if (!(scaled < 1e18))
+    {
+        return out + snprintf(out, WRITER_MAX_TOKEN, "%.1f", value);
+    }
+    uint64_t tenths = (uint64_t)nearbyint(scaled);
+    if (signbit(value))
+    {
+        *out++ = '-';
+    }
+    out = format_uint64(out, tenths / 10);
+    *out++ = '.';
+    *out++ = (char)('0' + tenths % 10);
+    return out;
+}
+
+/*
+ * Shortest text that the loader reads back to the same float, returns the end of the text.
+ * Values with one decimal are the common case: the loader converts "d.d" with one exact float division,
+ * so if dividing the rounded tenths by 10 gives the value back, the %.1f text is enough.
+ */
+char *format_float_shortest(char *out, float value)
+{
+    double tenths = nearbyint(fabs((double)value) * 10.0);
+    if (tenths <= (double)(1 << 24) && (float)tenths / 10.0f == fabsf(value))
+    {
+        return format_float_1(out, value);
+    }
+
+    char text[WRITER_MAX_TOKEN];
+    int length = 0;
+    for (int precision = 1; precision <= 9; precision++)
+    {
+        length = snprintf(text, sizeof(text), "%.*g", precision, value);
+        if (strtof(text, NULL) == value)
+        {
+            break;
+        }
+    }
+    memcpy(out, text, (size_t)length);
+    return out + length;
+}
+
+static void get_matrix_row(void *context, uint64_t row, unsigned int worker, const float **values, const uint64_t **indices, uint64_t *length)
+{
+    (void)worker;
+    const EllpackMatrix *matrix = (const EllpackMatrix *)context;
+    *values = ellpack_row_values(matrix, row);
+    *indices = ellpack_row_indices(matrix, row);
+    *length = ellpack_row_length(matrix, row);
+}
+
+/*
+ * Stream over the rows of a matrix in memory, ellpack_cols (at most matrix->ellpack_cols) entries per row
+ */
+void ellpack_matrix_rows(const EllpackMatrix *matrix, uint64_t ellpack_cols, EllpackRowStream *stream)
+{
+    stream->rows = matrix->rows;
+    stream->cols = matrix->cols;
+    stream->ellpack_cols = ellpack_cols;
+    stream->get_row = get_matrix_row;
+    stream->context = (void *)matrix;
+}
+
+/*
+ * Append the entries of one row to the text, every entry but the very first of the line is preceded by a comma
+ */
+static char *format_row(const WriterContext *context, uint64_t row, unsigned int worker, char *out)
+{
+    const float *row_values;
+    const uint64_t *row_indices;
+    uint64_t length;
+    context->stream->get_row(context->stream->context, row, worker, &row_values, &row_indices, &length);
+    for (uint64_t j = 0; j < context->stream->ellpack_cols; j++)
+    {
+        if (row > 0 || j > 0)
+        {
+            *out++ = ',';
+        }
+        char padding = context->style == ELLPACK_TEXT_RESULT ? row_values[j] == 0 : j >= length;
+        if (padding)
+        {
+            *out++ = '*';
+        }
+        else if (context->indices_line)
+        {
+            out = format_uint64(out, row_indices[j]);
+        }
+        else if (context->style == ELLPACK_TEXT_RESULT)
+        {
+            out = format_float_1(out, row_values[j]);
+        }
+        else
+        {
+            out = format_float_shortest(out, row_values[j]);
+        }
+    }
+    return out;
+}
+
+/*
+ * Format the rows [start, end) of the batch into the buffer of their block, run on the thread pool
+ */
+static void format_row_block(void *arg, uint64_t start, uint64_t end, unsigned int worker)
+{
+    WriterContext *context = (WriterContext *)arg;
+    uint64_t block = (start - context->batch_start) / context->rows_per_block;
+    TextBuffer *buffer = &context->buffers[block];
+    size_t row_capacity = (size_t)context->stream->ellpack_cols * (WRITER_MAX_TOKEN + 1);
+
+    buffer->size = 0;
+    for (uint64_t row = start; row < end; row++)
+    {
+        if (buffer->capacity - buffer->size < row_capacity)
+        {
+            size_t capacity = buffer->capacity * 2 > buffer->size + row_capacity ? buffer->capacity * 2 : buffer->size + row_capacity;
+            char *data = (char *)realloc(buffer->data, capacity);
+            if (data == NULL)
+            {
+                context->status[block] = 'F';
+                return;
+            }
+            buffer->data = data;
+            buffer->capacity = capacity;
+        }
+        buffer->size = (size_t)(format_row(context, row, worker, buffer->data + buffer->size) - buffer->data);
+    }
+}
+
+/*
+ * write() until all of data is written
+ */
+static char write_all(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = write(fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return 'F';
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    return 'S';
+}
+
+/*
+ * Write one line (values or indices) of the file batch by batch
+ */
+static char write_line(int fd, WriterContext *context, uint64_t blocks_per_batch, uint64_t *block_bounds)
+{
+    uint64_t rows = context->stream->rows;
+    for (uint64_t batch_start = 0; batch_start < rows; batch_start += blocks_per_batch * context->rows_per_block)
+    {
+        uint64_t block_count = 0;
+        context->batch_start = batch_start;
+        for (uint64_t row = batch_start; row < rows && block_count < blocks_per_batch; row += context->rows_per_block)
+        {
+            block_bounds[block_count] = row;
+            context->status[block_count] = 'S';
+            block_count++;
+        }
+        uint64_t batch_end = batch_start + block_count * context->rows_per_block;
+        block_bounds[block_count] = batch_end < rows ? batch_end : rows;
+
+        thread_pool_run(block_bounds, block_count, format_row_block, context);
+
+        for (uint64_t block = 0; block < block_count; block++)
+        {
+            if (context->status[block] != 'S')
+            {
+                fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "output buffer");
+                return 'F';
+            }
+            if (write_all(fd, context->buffers[block].data, context->buffers[block].size) != 'S')
+            {
+                return 'F';
+            }
+        }
+    }
+    return write_all(fd, "\n", 1);
+}
+
+/*
+ * Write the rows of the stream as an ELLPACK text file
+ */
+char write_ellpack_text_stream(const char *filename, const EllpackRowStream *stream, EllpackTextStyle style)
+{
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1)
+    {
+        fprintf(stderr, ERR_OPEN_FILE_FAILED, filename);
+        return 'F';
+    }
+
+    // write <noRows>,<noCols>,<noEllpackCol> to the first line
+    char header[3 * 21 + 3];
+    char *end = format_uint64(header, stream->rows);
+    *end++ = ',';
+    end = format_uint64(end, stream->cols);
+    *end++ = ',';
+    end = format_uint64(end, stream->ellpack_cols);
+    *end++ = '\n';
+    char status = write_all(fd, header, (size_t)(end - header));
+
+    // about WRITER_BLOCK_BYTES of text per block, assuming 8 bytes per entry
+    uint64_t rows_per_block = WRITER_BLOCK_BYTES / (8 * stream->ellpack_cols + 1);
+    if (rows_per_block == 0)
+    {
+        rows_per_block = 1;
+    }
+    uint64_t blocks_per_batch = (uint64_t)thread_pool_size() * WRITER_BLOCKS_PER_WORKER;
+
+    WriterContext context;
+    context.stream = stream;
+    context.style = style;
+    context.rows_per_block = rows_per_block;
+    context.buffers = (TextBuffer *)calloc(blocks_per_batch, sizeof(TextBuffer));
+    context.status = (char *)malloc(blocks_per_batch * sizeof(char));
+    uint64_t *block_bounds = (uint64_t *)malloc((blocks_per_batch + 1) * sizeof(uint64_t));
+    if (context.buffers == NULL || context.status == NULL || block_bounds == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "output buffers");
+        free(context.buffers);
+        free(context.status);
+        free(block_bounds);
+        close(fd);
+        return 'F';
+    }
+
+    // values on the second line, indices on the third
+    for (char indices_line = 0; status == 'S' && indices_line <= 1; indices_line++)
+    {
+        context.indices_line = indices_line;
+        status = write_line(fd, &context, blocks_per_batch, block_bounds);
+    }
+
+    for (uint64_t block = 0; block < blocks_per_batch; block++)
+    {
+        free(context.buffers[block].data);
+    }
+    free(context.buffers);
+    free(context.status);
+    free(block_bounds);
+
+    if (close(fd) != 0 || status != 'S')
+    {
+        fprintf(stderr, ERR_WRITE_FILE_FAILED, filename);
+        return 'F';
+    }
+    return 'S';
+}
+
+/*
+ * Write the matrix as an ELLPACK text file with ellpack_cols entries per row (at most matrix->ellpack_cols)
+ */
+char write_ellpack_text(const char *filename, const EllpackMatrix *matrix, uint64_t ellpack_cols, EllpackTextStyle style)
+{
+    EllpackRowStream stream;
+    ellpack_matrix_rows(matrix, ellpack_cols, &stream);
+    return write_ellpack_text_stream(filename, &stream, style);
+}
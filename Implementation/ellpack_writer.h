@@ -0,0 +1,47 @@
+#ifndef FINAL_ELLPACK_WRITER_H
+#define FINAL_ELLPACK_WRITER_H
+
+#include <stdint.h>
+#include "utils.h"
+
+// Buffered text writer for ELLPACK files
+// The rows are formatted into one buffer per row block, the blocks of a batch are formatted in parallel on the
+// thread pool and then written to the file in order with large write calls. A batch holds
+// WRITER_BLOCKS_PER_WORKER blocks per pool worker of about WRITER_BLOCK_BYTES of text each.
+
+#define WRITER_BLOCK_BYTES (1 << 20)
+#define WRITER_BLOCKS_PER_WORKER 4
+#define WRITER_MAX_TOKEN 48 // longest token: %.1f of FLT_MAX is 39 digits, sign, point and decimal
+
+typedef enum
+{
+    ELLPACK_TEXT_RESULT, // values as printf("%.1f"), zero values and their indices as *
+    ELLPACK_TEXT_INPUT   // values with the shortest text that loads back to the same float, * for the slots past the row length
+} EllpackTextStyle;
+
+// EllpackRowStream struct, the rows of a matrix for the writers, which does not have to be held in memory.
+// get_row points values and indices at the ellpack_cols entries of a row and sets length to its number of valid
+// entries (the slots after them are padding: value 0 at index 0). values and indices stay valid until the next call
+// by the same pool worker. Every row is requested once per written block or line.
+typedef struct
+{
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t ellpack_cols;
+    void (*get_row)(void *context, uint64_t row, unsigned int worker, const float **values, const uint64_t **indices, uint64_t *length);
+    void *context;
+} EllpackRowStream;
+
+char *format_uint64(char *out, uint64_t value);
+
+char *format_float_1(char *out, float value);
+
+char *format_float_shortest(char *out, float value);
+
+void ellpack_matrix_rows(const EllpackMatrix *matrix, uint64_t ellpack_cols, EllpackRowStream *stream);
+
+char write_ellpack_text_stream(const char *filename, const EllpackRowStream *stream, EllpackTextStyle style);
+
+char write_ellpack_text(const char *filename, const EllpackMatrix *matrix, uint64_t ellpack_cols, EllpackTextStyle style);
+
+#endif
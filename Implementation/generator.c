@@ -0,0 +1,452 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "generator.h"
+#include "thread_pool.h"
+#include "ellpack_writer.h"
+#include "ellpack_binary.h"
+
+#define ERR_INVALID_GENERATOR_SPEC "Error: Invalid generator spec '%s', expected <uniform|banded|powerlaw|rmat|blockdiag>,<rows>,<cols>,<row_length>[,<seed>]\n"
+
+static const char *family_names[] = {"uniform", "banded", "powerlaw", "rmat", "blockdiag"};
+
+// quadrant probabilities of the R-MAT recursion (Graph500): top left, top right, bottom left, bottom right
+#define RMAT_A 0.57
+#define RMAT_B 0.19
+#define RMAT_C 0.19
+#define RMAT_D 0.05
+#define RMAT_ATTEMPTS 16 // R-MAT draws per entry before a duplicate column is replaced by a uniform one
+
+/*
+ * splitmix64, small and fast with a 64 bit state, every seed gives a full-period sequence
+ */
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static uint64_t random_below(uint64_t *state, uint64_t bound)
+{
+    return next_random(state) % bound;
+}
+
+static double random_unit(uint64_t *state)
+{
+    return (double)(next_random(state) >> 11) / 9007199254740992.0; // [0, 1)
+}
+
+/*
+ * Every row has its own random sequence derived from the seed, so rows can be generated in any order,
+ * in parallel and more than once with the same result
+ */
+static uint64_t row_random_state(uint64_t seed, uint64_t row)
+{
+    uint64_t state = seed ^ (row * 0xd1b54a32d192ed03ull);
+    return next_random(&state);
+}
+
+/*
+ * Value with one decimal from [-100, 100] without 0 (a zero would read as padding)
+ */
+static float random_value(uint64_t *state)
+{
+    int64_t tenths = (int64_t)random_below(state, 2000);
+    tenths = tenths < 1000 ? tenths - 1000 : tenths - 999;
+    return (float)tenths / 10.0f;
+}
+
+static int compare_uint64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// ColumnSampler struct, open-addressing set of the columns already taken by the current row
+typedef struct
+{
+    uint64_t *slots;   // UINT64_MAX marks an empty slot
+    uint64_t capacity; // power of two, at least twice the longest row
+} ColumnSampler;
+
+static uint64_t sampler_find(const ColumnSampler *sampler, uint64_t col)
+{
+    uint64_t slot = (col * 0x9e3779b97f4a7c15ull) & (sampler->capacity - 1);
+    while (sampler->slots[slot] != UINT64_MAX && sampler->slots[slot] != col)
+    {
+        slot = (slot + 1) & (sampler->capacity - 1);
+    }
+    return slot;
+}
+
+static char sampler_insert(ColumnSampler *sampler, uint64_t col)
+{
+    uint64_t slot = sampler_find(sampler, col);
+    if (sampler->slots[slot] == col)
+    {
+        return 0;
+    }
+    sampler->slots[slot] = col;
+    return 1;
+}
+
+/*
+ * Empty the set for the next row. Removing the columns in reverse insertion order never cuts the probe
+ * sequence of a column that is still in the set, so only the row's own slots are touched.
+ */
+static void sampler_clear(ColumnSampler *sampler, const uint64_t *columns, uint64_t count)
+{
+    while (count > 0)
+    {
+        sampler->slots[sampler_find(sampler, columns[--count])] = UINT64_MAX;
+    }
+}
+
+/*
+ * count distinct ascending columns from [0, cols) with Floyd's algorithm, O(count) expected time
+ */
+static void sample_columns(ColumnSampler *sampler, uint64_t *state, uint64_t cols, uint64_t count, uint64_t *columns)
+{
+    uint64_t taken = 0;
+    for (uint64_t j = cols - count; j < cols; j++)
+    {
+        // j itself can not be in the set yet, all earlier picks are smaller
+        uint64_t col = random_below(state, j + 1);
+        if (!sampler_insert(sampler, col))
+        {
+            col = j;
+            sampler_insert(sampler, col);
+        }
+        columns[taken++] = col;
+    }
+    sampler_clear(sampler, columns, count);
+    qsort(columns, count, sizeof(uint64_t), compare_uint64);
+}
+
+/*
+ * Number of bits of the largest index below count
+ */
+static unsigned int index_bits(uint64_t count)
+{
+    unsigned int bits = 0;
+    while (bits < 64 && (count - 1) >> bits != 0)
+    {
+        bits++;
+    }
+    return bits;
+}
+
+/*
+ * Row length of the R-MAT family. The recursion picks the top half of the rows with probability a + b on
+ * every level, so the expected share of a row is the product over its bits; scaled such that the average
+ * row of a power-of-two matrix has row_length / 4 entries before the lengths are capped at row_length.
+ */
+static uint64_t rmat_length(uint64_t *state, const GeneratorOptions *options, uint64_t row)
+{
+    unsigned int levels = index_bits(options->rows);
+    double expected = (double)options->row_length / 4.0;
+    for (unsigned int level = 0; level < levels; level++)
+    {
+        expected *= (row >> level) & 1 ? 2.0 * (RMAT_C + RMAT_D) : 2.0 * (RMAT_A + RMAT_B);
+    }
+    if (expected >= (double)options->row_length)
+    {
+        return options->row_length;
+    }
+    uint64_t length = (uint64_t)expected;
+    return random_unit(state) < expected - (double)length ? length + 1 : length;
+}
+
+/*
+ * One column of an R-MAT row: the column bits are chosen from the most significant one down, each with the
+ * probability of the right half given the half the row bit of the same level chose. Levels the row does not
+ * have (more columns than rows) use the unconditional b + d.
+ */
+static uint64_t rmat_column(uint64_t *state, const GeneratorOptions *options, uint64_t row)
+{
+    unsigned int row_levels = index_bits(options->rows);
+    unsigned int col_levels = index_bits(options->cols);
+    uint64_t col;
+    do
+    {
+        col = 0;
+        for (unsigned int level = 0; level < col_levels; level++)
+        {
+            double right;
+            if (level < row_levels)
+            {
+                right = (row >> (row_levels - 1 - level)) & 1 ? RMAT_D / (RMAT_C + RMAT_D) : RMAT_B / (RMAT_A + RMAT_B);
+            }
+            else
+            {
+                right = RMAT_B + RMAT_D;
+            }
+            col = (col << 1) | (random_unit(state) < right);
+        }
+    } while (col >= options->cols);
+    return col;
+}
+
+/*
+ * count distinct ascending R-MAT columns, a column drawn again is retried and after RMAT_ATTEMPTS
+ * draws replaced by a uniform one, so even rows as long as the matrix is wide finish
+ */
+static void sample_rmat_columns(ColumnSampler *sampler, uint64_t *state, const GeneratorOptions *options, uint64_t row,
+                                uint64_t count, uint64_t *columns)
+{
+    for (uint64_t taken = 0; taken < count; taken++)
+    {
+        uint64_t col = rmat_column(state, options, row);
+        for (int attempt = 1; !sampler_insert(sampler, col); attempt++)
+        {
+            col = attempt < RMAT_ATTEMPTS ? rmat_column(state, options, row) : random_below(state, options->cols);
+        }
+        columns[taken] = col;
+    }
+    sampler_clear(sampler, columns, count);
+    qsort(columns, count, sizeof(uint64_t), compare_uint64);
+}
+
+/*
+ * Parse "<family>,<rows>,<cols>,<row_length>[,<seed>]", the seed defaults to 1
+ */
+char parse_generator_options(const char *spec, GeneratorOptions *options)
+{
+    char family[16];
+    unsigned long long rows, cols, row_length, seed = 1;
+    char trailing;
+    int fields = sscanf(spec, "%15[a-z],%llu,%llu,%llu,%llu%c", family, &rows, &cols, &row_length, &seed, &trailing);
+    if (fields != 4 && fields != 5)
+    {
+        fprintf(stderr, ERR_INVALID_GENERATOR_SPEC, spec);
+        return 'F';
+    }
+
+    options->family = (MatrixFamily)-1;
+    for (unsigned int i = 0; i < sizeof(family_names) / sizeof(family_names[0]); i++)
+    {
+        if (strcmp(family, family_names[i]) == 0)
+        {
+            options->family = (MatrixFamily)i;
+        }
+    }
+    if (options->family == (MatrixFamily)-1 || rows == 0 || cols == 0 || row_length == 0)
+    {
+        fprintf(stderr, ERR_INVALID_GENERATOR_SPEC, spec);
+        return 'F';
+    }
+    options->rows = rows;
+    options->cols = cols;
+    options->row_length = row_length < cols ? row_length : cols;
+    options->seed = seed;
+    return 'S';
+}
+
+/*
+ * First column of a row of the banded and block-diagonal families, the row_length columns from there are the row
+ */
+static uint64_t contiguous_row_start(const GeneratorOptions *options, uint64_t row)
+{
+    uint64_t length = options->row_length;
+    uint64_t start;
+    if (options->family == GENERATE_BANDED)
+    {
+        uint64_t centre = (uint64_t)((double)row * (double)options->cols / (double)options->rows);
+        start = centre > length / 2 ? centre - length / 2 : 0;
+    }
+    else
+    {
+        start = (row / length * length) % options->cols;
+    }
+    return start + length > options->cols ? options->cols - length : start;
+}
+
+/*
+ * Row length of the power-law family: inverse transform of the density ~ x^-2 on [1, row_length + 1)
+ */
+static uint64_t power_law_length(uint64_t *state, uint64_t max_length)
+{
+    double u = random_unit(state);
+    double x = 1.0 / (1.0 - u * (1.0 - 1.0 / (double)(max_length + 1)));
+    uint64_t length = (uint64_t)x;
+    return length < 1 ? 1 : length > max_length ? max_length : length;
+}
+
+/*
+ * Fill the row_length entries of one row (padding: value 0 at index 0), returns the number of stored entries
+ */
+static uint64_t generate_row(const GeneratorOptions *options, ColumnSampler *sampler, uint64_t row, float *row_values, uint64_t *row_indices)
+{
+    uint64_t state = row_random_state(options->seed, row);
+    uint64_t length = options->row_length;
+
+    switch (options->family)
+    {
+    case GENERATE_UNIFORM:
+        sample_columns(sampler, &state, options->cols, length, row_indices);
+        break;
+    case GENERATE_POWER_LAW:
+        length = power_law_length(&state, options->row_length);
+        sample_columns(sampler, &state, options->cols, length, row_indices);
+        break;
+    case GENERATE_RMAT:
+        length = rmat_length(&state, options, row);
+        sample_rmat_columns(sampler, &state, options, row, length, row_indices);
+        break;
+    default:
+    {
+        uint64_t start = contiguous_row_start(options, row);
+        for (uint64_t j = 0; j < length; j++)
+        {
+            row_indices[j] = start + j;
+        }
+        break;
+    }
+    }
+    for (uint64_t j = 0; j < length; j++)
+    {
+        row_values[j] = random_value(&state);
+    }
+    for (uint64_t j = length; j < options->row_length; j++)
+    {
+        row_values[j] = 0.0f;
+        row_indices[j] = 0;
+    }
+    return length;
+}
+
+// GeneratorContext struct, options and per-worker scratch of a generation
+typedef struct
+{
+    GeneratorOptions options;
+    unsigned int workers;
+    ColumnSampler *samplers; // one per pool worker
+    float *values;           // row_length per worker, the rows handed out by a stream
+    uint64_t *indices;
+    EllpackMatrix *matrix;   // target of generate_ellpack_matrix
+} GeneratorContext;
+
+static void free_generator_context(GeneratorContext *context)
+{
+    if (context->samplers != NULL)
+    {
+        for (unsigned int worker = 0; worker < context->workers; worker++)
+        {
+            free(context->samplers[worker].slots);
+        }
+    }
+    free(context->samplers);
+    free(context->values);
+    free(context->indices);
+    free(context);
+}
+
+static GeneratorContext *create_generator_context(const GeneratorOptions *options)
+{
+    GeneratorContext *context = (GeneratorContext *)calloc(1, sizeof(GeneratorContext));
+    if (context == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "generator");
+        return NULL;
+    }
+    context->options = *options;
+    context->workers = thread_pool_size();
+
+    uint64_t capacity = 16;
+    while (capacity < 2 * options->row_length)
+    {
+        capacity *= 2;
+    }
+    context->samplers = (ColumnSampler *)calloc(context->workers, sizeof(ColumnSampler));
+    context->values = (float *)malloc(context->workers * options->row_length * sizeof(float));
+    context->indices = (uint64_t *)malloc(context->workers * options->row_length * sizeof(uint64_t));
+    char failed = context->samplers == NULL || context->values == NULL || context->indices == NULL;
+    for (unsigned int worker = 0; !failed && worker < context->workers; worker++)
+    {
+        context->samplers[worker].capacity = capacity;
+        context->samplers[worker].slots = (uint64_t *)malloc(capacity * sizeof(uint64_t));
+        if (context->samplers[worker].slots == NULL)
+        {
+            failed = 1;
+            break;
+        }
+        memset(context->samplers[worker].slots, 0xff, capacity * sizeof(uint64_t));
+    }
+    if (failed)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "generator column sets");
+        free_generator_context(context);
+        return NULL;
+    }
+    return context;
+}
+
+/*
+ * Generate the rows [start, end) into the matrix, run on the thread pool
+ */
+static void generate_row_block(void *arg, uint64_t start, uint64_t end, unsigned int worker)
+{
+    GeneratorContext *context = (GeneratorContext *)arg;
+    for (uint64_t row = start; row < end; row++)
+    {
+        context->matrix->row_lengths[row] = generate_row(&context->options, &context->samplers[worker], row,
+                                                         ellpack_row_values(context->matrix, row), ellpack_row_indices(context->matrix, row));
+    }
+}
+
+/*
+ * Generate the matrix described by options in memory, returns NULL if it does not fit into memory
+ */
+EllpackMatrix *generate_ellpack_matrix(const GeneratorOptions *options)
+{
+    GeneratorContext *context = create_generator_context(options);
+    if (context == NULL)
+    {
+        return NULL;
+    }
+    context->matrix = allocate_ellpack_matrix(options->rows, options->cols, options->row_length);
+    if (context->matrix != NULL)
+    {
+        thread_pool_run_rows(options->rows, generate_row_block, context);
+    }
+    EllpackMatrix *matrix = context->matrix;
+    free_generator_context(context);
+    return matrix;
+}
+
+static void get_generated_row(void *arg, uint64_t row, unsigned int worker, const float **values, const uint64_t **indices, uint64_t *length)
+{
+    GeneratorContext *context = (GeneratorContext *)arg;
+    float *row_values = context->values + worker * context->options.row_length;
+    uint64_t *row_indices = context->indices + worker * context->options.row_length;
+    *length = generate_row(&context->options, &context->samplers[worker], row, row_values, row_indices);
+    *values = row_values;
+    *indices = row_indices;
+}
+
+/*
+ * Stream the matrix described by options into an ELLPACK file (text or binary) without holding it in memory,
+ * every row is generated again for each line or block it is written to
+ */
+char write_generated_matrix(const char *filename, const GeneratorOptions *options, char binary)
+{
+    GeneratorContext *context = create_generator_context(options);
+    if (context == NULL)
+    {
+        return 'F';
+    }
+    EllpackRowStream stream;
+    stream.rows = options->rows;
+    stream.cols = options->cols;
+    stream.ellpack_cols = options->row_length;
+    stream.get_row = get_generated_row;
+    stream.context = context;
+
+    char status = binary ? dump_ellpack_binary_stream(filename, &stream) : write_ellpack_text_stream(filename, &stream, ELLPACK_TEXT_INPUT);
+    free_generator_context(context);
+    return status;
+}
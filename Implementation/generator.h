@@ -0,0 +1,38 @@
+#ifndef FINAL_GENERATOR_H
+#define FINAL_GENERATOR_H
+
+#include <stdint.h>
+#include "utils.h"
+
+// Synthetic ELLPACK matrices for benchmarks
+// Every matrix is fully determined by its GeneratorOptions (seed included); each row has its own random sequence,
+// so rows are generated in parallel and streamed to a file without the matrix ever being in memory.
+// Values are drawn with one decimal from [-100, 100] without 0, the columns of a row are distinct and ascending.
+
+typedef enum
+{
+    GENERATE_UNIFORM,        // every row has row_length entries at random columns
+    GENERATE_BANDED,         // row i covers the row_length columns centred on column i * cols / rows
+    GENERATE_POWER_LAW,      // row lengths follow P(length) ~ length^-2 on [1, row_length], random columns
+    GENERATE_RMAT,           // R-MAT (a, b, c, d = 0.57, 0.19, 0.19, 0.05): skewed rows and columns, row_length / 4
+                             // entries per row on average before the long rows are cut to row_length, empty rows possible
+    GENERATE_BLOCK_DIAGONAL  // dense row_length x row_length blocks along the diagonal
+} MatrixFamily;
+
+// GeneratorOptions struct
+typedef struct
+{
+    MatrixFamily family;
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t row_length; // entries per row (maximum for power-law)
+    uint64_t seed;
+} GeneratorOptions;
+
+char parse_generator_options(const char *spec, GeneratorOptions *options);
+
+EllpackMatrix *generate_ellpack_matrix(const GeneratorOptions *options);
+
+char write_generated_matrix(const char *filename, const GeneratorOptions *options, char binary);
+
+#endif
@@ -0,0 +1,301 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hyb.h"
+#include "optimizations.h"
+#include "accumulator.h"
+#include "thread_pool.h"
+
+#define HYB_ELL_ENTRY_BYTES (sizeof(float) + sizeof(uint64_t))                     // value, column
+#define HYB_COO_ENTRY_BYTES (sizeof(float) + sizeof(uint64_t) + sizeof(uint64_t))  // value, column, row
+
+/*
+ * Width of the ELLPACK part that moves the fewest bytes: every row pays for its padded ELLPACK slots
+ * (stride, not width, is what is stored), every entry past the width for a COO entry. Only multiples of
+ * the row padding are tried, a narrower width would store the same slab; the result is cut to the longest row.
+ */
+uint64_t choose_hyb_width(const EllpackMatrix *matrix)
+{
+    // rows_longer[l]: rows with more than l entries
+    uint64_t *rows_longer = (uint64_t *)calloc(matrix->ellpack_cols + 1, sizeof(uint64_t));
+    if (rows_longer == NULL)
+    {
+        return matrix->ellpack_cols;
+    }
+    uint64_t longest = 0;
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        uint64_t length = ellpack_row_length(matrix, row);
+        if (length > 0)
+        {
+            rows_longer[length - 1]++;
+        }
+        longest = length > longest ? length : longest;
+    }
+    for (uint64_t l = matrix->ellpack_cols; l > 0; l--)
+    {
+        rows_longer[l - 1] += rows_longer[l];
+    }
+
+    // overflow(w) = sum of rows_longer[l] for l >= w, walked from the widest candidate down
+    uint64_t top = ellpack_row_stride(longest);
+    uint64_t overflow = 0;
+    uint64_t best_width = longest;
+    uint64_t best_bytes = UINT64_MAX;
+    for (uint64_t width = top;; width -= ELLPACK_ROW_PAD)
+    {
+        for (uint64_t l = width; l < top && l < longest; l++)
+        {
+            overflow += rows_longer[l];
+        }
+        top = width;
+        uint64_t bytes = matrix->rows * ellpack_row_stride(width) * HYB_ELL_ENTRY_BYTES + overflow * HYB_COO_ENTRY_BYTES;
+        if (bytes < best_bytes)
+        {
+            best_bytes = bytes;
+            best_width = width < longest ? width : longest;
+        }
+        if (width == 0)
+        {
+            break;
+        }
+    }
+    free(rows_longer);
+    return best_width;
+}
+
+/*
+ * Helper method to free memory of a HYB matrix
+ */
+void free_hyb_matrix(HybMatrix *matrix)
+{
+    if (matrix != NULL)
+    {
+        free_ellpack_matrix(matrix->ell);
+        free(matrix->overflows);
+        free(matrix->coo_rows);
+        free(matrix->coo_cols);
+        free(matrix->coo_values);
+        free(matrix);
+    }
+}
+
+/*
+ * Convert an ELLPACK matrix to HYB with `width` entries per row in the ELLPACK part (HYB_AUTO_WIDTH: choose_hyb_width)
+ */
+HybMatrix *ellpack_to_hyb(const EllpackMatrix *matrix, uint64_t width)
+{
+    if (width == HYB_AUTO_WIDTH)
+    {
+        width = choose_hyb_width(matrix);
+    }
+    width = width < matrix->ellpack_cols ? width : matrix->ellpack_cols;
+
+    HybMatrix *hyb = (HybMatrix *)calloc(1, sizeof(HybMatrix));
+    if (hyb == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "HYB matrix structure");
+        return NULL;
+    }
+    hyb->rows = matrix->rows;
+    hyb->cols = matrix->cols;
+    hyb->ellpack_cols = matrix->ellpack_cols;
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        uint64_t length = ellpack_row_length(matrix, row);
+        hyb->coo_count += length > width ? length - width : 0;
+    }
+
+    hyb->ell = allocate_ellpack_matrix(matrix->rows, matrix->cols, width);
+    hyb->overflows = (char *)calloc(matrix->rows, sizeof(char));
+    hyb->coo_rows = (uint64_t *)malloc(hyb->coo_count * sizeof(uint64_t) + 1);
+    hyb->coo_cols = (uint64_t *)malloc(hyb->coo_count * sizeof(uint64_t) + 1);
+    hyb->coo_values = (float *)malloc(hyb->coo_count * sizeof(float) + 1);
+    if (hyb->ell == NULL || hyb->overflows == NULL || hyb->coo_rows == NULL || hyb->coo_cols == NULL || hyb->coo_values == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "HYB values/indices arrays");
+        free_hyb_matrix(hyb);
+        return NULL;
+    }
+
+    uint64_t coo = 0;
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        const float *row_values = ellpack_row_values(matrix, row);
+        const uint64_t *row_indices = ellpack_row_indices(matrix, row);
+        uint64_t length = ellpack_row_length(matrix, row);
+        uint64_t ell_length = length < width ? length : width;
+        memcpy(ellpack_row_values(hyb->ell, row), row_values, ell_length * sizeof(float));
+        memcpy(ellpack_row_indices(hyb->ell, row), row_indices, ell_length * sizeof(uint64_t));
+        hyb->ell->row_lengths[row] = ell_length;
+        hyb->overflows[row] = length > width;
+        for (uint64_t j = ell_length; j < length; j++)
+        {
+            hyb->coo_rows[coo] = row;
+            hyb->coo_cols[coo] = row_indices[j];
+            hyb->coo_values[coo] = row_values[j];
+            coo++;
+        }
+    }
+    return hyb;
+}
+
+/*
+ * First COO entry of a row and the number of its entries, the binary search only runs for rows that overflow
+ */
+static uint64_t hyb_coo_range(const HybMatrix *matrix, uint64_t row, uint64_t *first)
+{
+    if (!matrix->overflows[row])
+    {
+        *first = 0;
+        return 0;
+    }
+    uint64_t low = 0;
+    uint64_t high = matrix->coo_count;
+    while (low < high)
+    {
+        uint64_t middle = low + (high - low) / 2;
+        if (matrix->coo_rows[middle] < row)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    uint64_t end = low;
+    while (end < matrix->coo_count && matrix->coo_rows[end] == row)
+    {
+        end++;
+    }
+    *first = low;
+    return end - low;
+}
+
+/*
+ * Convert a HYB matrix back to ELLPACK with the ellpack_cols of the original matrix
+ */
+EllpackMatrix *hyb_to_ellpack(const HybMatrix *matrix)
+{
+    EllpackMatrix *ellpack = allocate_ellpack_matrix(matrix->rows, matrix->cols, matrix->ellpack_cols);
+    if (ellpack == NULL)
+    {
+        return NULL;
+    }
+    uint64_t width = matrix->ell->ellpack_cols;
+    uint64_t coo = 0;
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        float *row_values = ellpack_row_values(ellpack, row);
+        uint64_t *row_indices = ellpack_row_indices(ellpack, row);
+        memcpy(row_values, ellpack_row_values(matrix->ell, row), width * sizeof(float));
+        memcpy(row_indices, ellpack_row_indices(matrix->ell, row), width * sizeof(uint64_t));
+        // only rows with a full ELLPACK part have COO entries
+        uint64_t length = ellpack_row_length(matrix->ell, row);
+        for (; coo < matrix->coo_count && matrix->coo_rows[coo] == row; length++, coo++)
+        {
+            row_values[length] = matrix->coo_values[coo];
+            row_indices[length] = matrix->coo_cols[coo];
+        }
+        ellpack->row_lengths[row] = length;
+    }
+    return ellpack;
+}
+
+/*
+ * Accumulate row a_row of A * B into the accumulator, same products in the same order as accumulate_row_simd:
+ * the A row is its ELLPACK part followed by its COO entries, every B row is scaled over the valid entries of
+ * its ELLPACK part and then over its COO entries with the same row-scaling kernel
+ */
+static char accumulate_row_hyb(const void *a, const void *b, uint64_t a_row, SparseAccumulator *spa)
+{
+    const HybMatrix *a_matrix = (const HybMatrix *)a;
+    const HybMatrix *b_matrix = (const HybMatrix *)b;
+    const float *a_ell_values = ellpack_row_values(a_matrix->ell, a_row);
+    const uint64_t *a_ell_indices = ellpack_row_indices(a_matrix->ell, a_row);
+    uint64_t a_ell_length = ellpack_row_length(a_matrix->ell, a_row);
+    uint64_t a_coo_first = 0;
+    uint64_t a_coo_length = hyb_coo_range(a_matrix, a_row, &a_coo_first);
+
+    uint64_t flops = 0;
+    for (uint64_t j = 0; j < a_ell_length + a_coo_length; j++)
+    {
+        uint64_t a_col = j < a_ell_length ? a_ell_indices[j] : a_matrix->coo_cols[a_coo_first + j - a_ell_length];
+        uint64_t b_coo_first;
+        flops += ellpack_row_length(b_matrix->ell, a_col) + hyb_coo_range(b_matrix, a_col, &b_coo_first);
+    }
+
+    AccumulatorKind kind = choose_accumulator(b_matrix->cols, flops);
+    if (spa_begin_row(spa, kind, flops) != 'S')
+    {
+        return 'F';
+    }
+    ScaleRowKernel scale_row = current_simd_kernel()->kernel;
+
+    for (uint64_t j = 0; j < a_ell_length + a_coo_length; j++)
+    {
+        float a_val = j < a_ell_length ? a_ell_values[j] : a_matrix->coo_values[a_coo_first + j - a_ell_length];
+        uint64_t a_col = j < a_ell_length ? a_ell_indices[j] : a_matrix->coo_cols[a_coo_first + j - a_ell_length];
+
+        const float *b_row_vector = ellpack_row_values(b_matrix->ell, a_col);
+        const uint64_t *b_row_indices = ellpack_row_indices(b_matrix->ell, a_col);
+        uint64_t b_coo_first = 0;
+        uint64_t b_coo_count = hyb_coo_range(b_matrix, a_col, &b_coo_first);
+        uint64_t b_ell_length = ellpack_row_length(b_matrix->ell, a_col);
+        if (kind == ACCUMULATOR_DENSE)
+        {
+            scale_row(a_val, b_row_vector, b_row_indices, spa->values, b_ell_length);
+            spa_mark(spa, b_row_indices, b_ell_length);
+            scale_row(a_val, b_matrix->coo_values + b_coo_first, b_matrix->coo_cols + b_coo_first, spa->values, b_coo_count);
+            spa_mark(spa, b_matrix->coo_cols + b_coo_first, b_coo_count);
+        }
+        else
+        {
+            spa_scale_row(spa, a_val, b_row_vector, b_row_indices, b_ell_length);
+            spa_scale_row(spa, a_val, b_matrix->coo_values + b_coo_first, b_matrix->coo_cols + b_coo_first, b_coo_count);
+        }
+    }
+    return 'S';
+}
+
+/*
+ * Numeric phase of A * B with both operands in HYB, on the calling thread (workers == 1) or on the thread pool
+ */
+static void hyb_multiplication(const HybMatrix *a_matrix, const HybMatrix *b_matrix, EllpackMatrix *result, unsigned int workers)
+{
+    if (a_matrix->cols != b_matrix->rows)
+    {
+        fprintf(stderr, ERR_INVALID_MATRIX_DIMENSIONS, a_matrix->cols, b_matrix->rows);
+        free_hyb_matrix((HybMatrix *)a_matrix);
+        free_hyb_matrix((HybMatrix *)b_matrix);
+        free_ellpack_matrix(result);
+        exit(EXIT_FAILURE);
+    }
+    if (multiply_rows(a_matrix, b_matrix, b_matrix->cols, a_matrix->rows, NULL, accumulate_row_hyb, result, workers) != 'S')
+    {
+        free_hyb_matrix((HybMatrix *)a_matrix);
+        free_hyb_matrix((HybMatrix *)b_matrix);
+        free_ellpack_matrix(result);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * function to multiply two HybMatrix on the calling thread and save it to the result pointer (EllpackMatrix)
+ */
+void matr_mult_hyb(const void *a, const void *b, void *result)
+{
+    hyb_multiplication((const HybMatrix *)a, (const HybMatrix *)b, (EllpackMatrix *)result, 1);
+}
+
+/*
+ * function to multiply two HybMatrix on the thread pool
+ */
+void matr_mult_hyb_parallel(const void *a, const void *b, void *result)
+{
+    const HybMatrix *a_matrix = (const HybMatrix *)a;
+    unsigned int workers = thread_pool_size();
+    hyb_multiplication(a_matrix, (const HybMatrix *)b, (EllpackMatrix *)result, a_matrix->rows <= 5 * workers ? 1 : workers);
+}
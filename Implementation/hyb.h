@@ -0,0 +1,40 @@
+#ifndef FINAL_HYB_H
+#define FINAL_HYB_H
+
+#include <stdint.h>
+#include "utils.h"
+
+// Hybrid ELLPACK + COO (HYB)
+// The first `width` entries of every row are kept in an ELLPACK part, the entries past them in a COO part
+// sorted by row (in row order, so row i's overflow follows its ELLPACK entries). A few very long rows then
+// only cost their own entries instead of widening every row of the matrix to their length.
+
+#define HYB_AUTO_WIDTH UINT64_MAX // ellpack_to_hyb picks the width with choose_hyb_width
+
+// HybMatrix struct
+typedef struct
+{
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t ellpack_cols;  // ellpack_cols of the ELLPACK matrix it was converted from
+    EllpackMatrix *ell;     // ellpack_cols == width
+    char *overflows;        // 1 for the rows with COO entries
+    uint64_t coo_count;
+    uint64_t *coo_rows;     // ascending
+    uint64_t *coo_cols;
+    float *coo_values;
+} HybMatrix;
+
+uint64_t choose_hyb_width(const EllpackMatrix *matrix);
+
+HybMatrix *ellpack_to_hyb(const EllpackMatrix *matrix, uint64_t width);
+
+EllpackMatrix *hyb_to_ellpack(const HybMatrix *matrix);
+
+void free_hyb_matrix(HybMatrix *matrix);
+
+void matr_mult_hyb(const void *a, const void *b, void *result);
+
+void matr_mult_hyb_parallel(const void *a, const void *b, void *result);
+
+#endif
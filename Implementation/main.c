@@ -3,14 +3,21 @@
 #include <stdint.h>
 #include <getopt.h>
 #include <string.h>
-#include <time.h>
-#include <unistd.h>
 #include "utils.h"
 #include "V0/matr_mult_ellpack.h"
 #include "V1/matr_mult_ellpack_v1.h"
 #include "V2/matr_mult_ellpack_v2.h"
 #include "testing_functions.h"
-
+#include "symbolic.h"
+#include "thread_pool.h"
+#include "ellpack_binary.h"
+#include "benchmark.h"
+#include "generator.h"
+#include "storage.h"
+#include "compact_indices.h"
+#include "reorder.h"
+#include "spmm.h"
+#include "server.h"
 
 static struct option long_options[] = {
     {"iterations", optional_argument, 0, 'B'},
@@ -20,6 +27,24 @@ static struct option long_options[] = {
     {"output", required_argument, 0, 'o'},
     {"help", no_argument, 0, 'h'},
     {"test", no_argument, 0, 't'},
+    {"simd", required_argument, 0, 's'},
+    {"threads", required_argument, 0, 'T'},
+    {"partition", required_argument, 0, 'P'},
+    {"thread-stats", no_argument, 0, 'R'},
+    {"convert", required_argument, 0, 'C'},
+    {"warmup", required_argument, 0, 'W'},
+    {"report", required_argument, 0, 'r'},
+    {"generate", required_argument, 0, 'G'},
+    {"format", required_argument, 0, 'F'},
+    {"storage", required_argument, 0, 'S'},
+    {"index-width", required_argument, 0, 'I'},
+    {"prefetch", required_argument, 0, 'D'},
+    {"reorder", required_argument, 0, 'O'},
+    {"dense", required_argument, 0, 'x'},
+    {"dense-layout", required_argument, 0, 'L'},
+    {"serve", required_argument, 0, 'U'},
+    {"connect", required_argument, 0, 'c'},
+    {"shutdown", no_argument, 0, 'k'},
     {0, 0, 0, 0}};
 
 void print_usage(void)
@@ -27,15 +52,126 @@ void print_usage(void)
     printf("Here is the command usage documentation: ");
     printf("./matrix_multiplication --matrix_a <file> --matrix_b <file> --output <file> --version [0-2]\n");
     printf("options:\n");
-    printf("  -B, --iterations=[N]     The number of iterations for benchmarking\n");
+    printf("  -B, --iterations=[N]     The number of measured iterations for benchmarking (default: 1, 5 without N)\n");
     printf("  -V, --version [0-2]  The implementation version\n");
     printf("  -a, --matrix_a <file>    Input file for matrix A\n");
     printf("  -b, --matrix_b <file>    Input file for matrix B\n");
     printf("  -o, --output <file>      Output file for the result matrix\n");
     printf("  -t, --test               Run multiplication tests\n");
+    printf("  -s, --simd <kernel>      Row-scaling kernel for V1/V2: avx512, avx2 or scalar (default: best supported by the CPU)\n");
+    printf("  -T, --threads <N>        Number of worker threads of V2 (default: one per core)\n");
+    printf("  -P, --partition <mode>   Row partitioning of V2: flops (equal work, default) or rows (equal row counts)\n");
+    printf("  -R, --thread-stats       Print the rows, flops and time of every V2 worker\n");
+    printf("  -W, --warmup <N>         Number of unmeasured iterations before the -B iterations (default: 0)\n");
+    printf("  -r, --report <format>    Benchmark report format: text (default), json or csv\n");
+    printf("  -C, --convert <file>     Convert an ELLPACK file from text to binary or back (by its format) into --output\n");
+    printf("  -G, --generate <spec>    Write a synthetic matrix to --output, spec: <uniform|banded|powerlaw|rmat|blockdiag>,<rows>,<cols>,<row_length>[,<seed>]\n");
+    printf("  -F, --format <format>    File format of --generate and of the --connect output: text (default) or binary\n");
+    printf("  -S, --storage <format>   Storage of the operands in V1/V2: ellpack (default), sell[,<C>,<sigma>] (sliced ELLPACK, default 8,1024),\n");
+    printf("                           hyb[,<width>] (ELLPACK + COO, width chosen per matrix by default), csr,\n");
+    printf("                           ellcsr (A in ELLPACK, B in CSR), tiled[,<cols>[,<rows>]] (A in ELLPACK, B cut into column tiles of\n");
+    printf("                           <cols> columns, A into blocks of <rows> rows, both sized from the cache sizes by default)\n");
+    printf("                           ellcol (A in column-major ELLPACK, one SIMD lane per row) or auto (chosen from the row lengths\n");
+    printf("                           of the operands); --dense runs on ellpack (default) or ellcol\n");
+    printf("  -I, --index-width <bits> Column indices of ELLPACK operands in V1/V2: auto (32 bits if the columns fit, default), 64, 32\n");
+    printf("                           or 16 (16-bit deltas to a base column per 16 entries, where the columns of the blocks are close)\n");
+    printf("  -D, --prefetch <entries> How many A entries ahead V1/V2 prefetch the B rows (ELLPACK and CSR storages),\n");
+    printf("                           0 turns prefetching off (default: %d)\n", PREFETCH_DEFAULT_DISTANCE);
+    printf("  -O, --reorder <method>   Renumber the operands before the multiplication: none (default), rcm (reverse Cuthill-McKee)\n");
+    printf("                           or cluster (A rows with similar columns together), the result keeps the original order\n");
+    printf("  -x, --dense <file>       Multiply --matrix_a by a dense vector or matrix (\"<rows>,<cols>\" and the values row by row)\n");
+    printf("                           instead of --matrix_b, --output gets the dense product in the same format\n");
+    printf("  -L, --dense-layout <layout> Layout of the dense operands in memory: row (row-major, default) or col (column-major)\n");
+    printf("  -U, --serve <socket>     Serve V1/V2 multiplications on a Unix domain socket, the matrices, plans and results of\n");
+    printf("                           earlier requests stay resident (files are loaded again when they change)\n");
+    printf("  -c, --connect <socket>   Let the server on <socket> multiply --matrix_a and --matrix_b into --output (V1 or V2)\n");
+    printf("  -k, --shutdown           With --connect: stop the server instead\n");
     printf("  -h, --help               Display this help message\n");
 }
 
+/*
+ * Sparse x dense mode (--dense): y = A * x with the kernels of spmm.h, measured and reported like A * B.
+ * There is no symbolic phase, allocating y counts as loading. Returns the exit status.
+ */
+static int run_dense_product(const char *a_filename, const char *x_filename, const char *output_filename, DenseLayout layout,
+                             MatrixStorage storage, unsigned int version, const SimdKernel *simd_kernel, unsigned int iterations,
+                             unsigned int warmups, ReportFormat report_format)
+{
+    if (storage != STORAGE_ELLPACK && storage != STORAGE_ELL_COL && storage != STORAGE_AUTO)
+    {
+        fprintf(stderr, "Error: --dense runs on ellpack or ellcol storage, not %s.\n", storage_name(storage));
+        return EXIT_FAILURE;
+    }
+    MultiplyFunction multiply = version == 0 ? matr_mult_dense : version == 1 ? matr_mult_dense_simd : matr_mult_dense_parallel;
+    if (storage == STORAGE_ELL_COL)
+    {
+        multiply = version == 0 ? matr_mult_dense_ellcol : version == 1 ? matr_mult_dense_ellcol_simd : matr_mult_dense_ellcol_parallel;
+    }
+    char storage_label[32];
+    snprintf(storage_label, sizeof(storage_label), "%sdense:%s", storage == STORAGE_ELL_COL ? "ellcol/" : "",
+             layout == DENSE_ROW_MAJOR ? "row" : "col");
+    BenchmarkReport report;
+    memset(&report, 0, sizeof(report));
+    report.matrix_a = a_filename;
+    report.matrix_b = x_filename;
+    report.version = version;
+    report.storage = storage_label;
+    report.kernel = version == 0 ? "scalar" : simd_kernel->name;
+    report.threads = version == 2 ? thread_pool_size() : 1;
+    report.warmups = warmups;
+
+    double phase_start = benchmark_now();
+    EllpackMatrix *a = load_ellpack_matrix(a_filename);
+    DenseMatrix *x = a != NULL ? load_dense_matrix(x_filename, layout) : NULL;
+    DenseMatrix *y = x != NULL ? allocate_dense_product(a, x) : NULL;
+    double *samples = (double *)malloc(iterations * sizeof(double));
+    // converting A counts as loading, the ELLPACK matrix is kept for the report
+    void *a_operand = y != NULL && storage == STORAGE_ELL_COL ? (void *)ellpack_to_ellcol(a) : (void *)a;
+    report.load_seconds = benchmark_now() - phase_start;
+    if (y == NULL || samples == NULL || a_operand == NULL)
+    {
+        free(samples);
+        free_dense_matrix(y);
+        free_dense_matrix(x);
+        free_ellpack_matrix(a);
+        return EXIT_FAILURE;
+    }
+
+    for (unsigned int i = 0; i < warmups; i++)
+    {
+        multiply(a_operand, x, y);
+    }
+    for (unsigned int i = 0; i < iterations; i++)
+    {
+        phase_start = benchmark_now();
+        multiply(a_operand, x, y);
+        samples[i] = benchmark_now() - phase_start;
+    }
+    compute_benchmark_stats(samples, iterations, &report.multiply);
+    free(samples);
+    if (a_operand != a)
+    {
+        free_ellcol_matrix((EllColMatrix *)a_operand);
+    }
+
+    phase_start = benchmark_now();
+    char dumped = dump_dense_matrix(output_filename, y);
+    report.dump_seconds = benchmark_now() - phase_start;
+    if (dumped == 'S')
+    {
+        uint64_t a_nnz = ellpack_nnz(a);
+        report.flops = a_nnz * x->cols;
+        report.result_nnz = y->rows * y->cols;
+        report.bytes = estimate_dense_bytes(a_nnz, report.flops, report.result_nnz);
+        print_benchmark_report(stdout, &report, report_format);
+    }
+
+    free_dense_matrix(y);
+    free_dense_matrix(x);
+    free_ellpack_matrix(a);
+    return dumped == 'S' ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int main(int argc, char **argv)
 {
     int opt;
@@ -45,6 +181,22 @@ int main(int argc, char **argv)
     char *output_filename = NULL;
     unsigned int version = 0;    // use implementation 0 by default (naive algorithm)
     unsigned int iterations = 1; // iterate only once by default
+    char *simd_name = NULL;      // pick the simd kernel via CPUID by default
+    RowPartition partition = PARTITION_FLOPS;
+    char thread_stats = 0;
+    char *convert_filename = NULL;
+    char *generator_spec = NULL;
+    char generate_binary = 0;
+    StorageOptions storage;
+    default_storage_options(&storage);
+    unsigned int warmups = 0;
+    ReportFormat report_format = REPORT_TEXT;
+    ReorderMethod reorder_method = REORDER_NONE;
+    char *dense_filename = NULL;
+    DenseLayout dense_layout = DENSE_ROW_MAJOR;
+    char *serve_socket = NULL;
+    char *connect_socket = NULL;
+    bool stop_server = false;
 
     if (strcmp(argv[0], "./matrix_multiplication") != 0)
     {
@@ -54,7 +206,7 @@ int main(int argc, char **argv)
     }
 
     // parse the options
-    while ((opt = getopt_long(argc, argv, "B::V:a:b:o:h:t", long_options, &option_index)) != -1)
+    while ((opt = getopt_long(argc, argv, "B::V:a:b:o:h:ts:T:P:RC:W:r:G:F:S:I:D:O:x:L:U:c:k", long_options, &option_index)) != -1)
     {
         switch (opt)
         {
@@ -66,8 +218,19 @@ int main(int argc, char **argv)
         }
         case 'B':
         {
+            // the count is optional: "-B5", "--iterations=5", and "-B 5" / "--iterations 5"
+            const char *count = optarg;
+            if (count == NULL && optind < argc && argv[optind][0] >= '0' && argv[optind][0] <= '9')
+            {
+                count = argv[optind++];
+            }
             char *i_endptr;
-            iterations = strtol(optarg, &i_endptr, 10);
+            iterations = count != NULL ? strtol(count, &i_endptr, 10) : 5;
+            if (iterations == 0)
+            {
+                fprintf(stderr, "Error: The number of iterations must be at least 1.\n");
+                exit(EXIT_FAILURE);
+            }
             break;
         }
         case 'a':
@@ -79,6 +242,136 @@ int main(int argc, char **argv)
         case 'o':
             output_filename = optarg;
             break;
+        case 's':
+            simd_name = optarg;
+            break;
+        case 'T':
+        {
+            // start the pool right away so that a following -t runs on it as well
+            char *t_endptr;
+            long threads = strtol(optarg, &t_endptr, 10);
+            if (*t_endptr != '\0' || threads < 1 || thread_pool_init((unsigned int)threads) != 'S')
+            {
+                fprintf(stderr, "Error: Invalid number of threads \"%s\".\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        }
+        case 'P':
+            if (strcmp(optarg, "flops") == 0)
+            {
+                partition = PARTITION_FLOPS;
+            }
+            else if (strcmp(optarg, "rows") == 0)
+            {
+                partition = PARTITION_ROWS;
+            }
+            else
+            {
+                fprintf(stderr, "Error: Invalid partitioning \"%s\".\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            configure_parallel_multiplication(partition, thread_stats);
+            break;
+        case 'R':
+            thread_stats = 1;
+            configure_parallel_multiplication(partition, thread_stats);
+            break;
+        case 'C':
+            convert_filename = optarg;
+            break;
+        case 'G':
+            generator_spec = optarg;
+            break;
+        case 'S':
+            if (parse_storage_options(optarg, &storage) != 'S')
+            {
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'I':
+            if (parse_index_bits(optarg, &storage.index_bits) != 'S')
+            {
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'D':
+        {
+            char *d_endptr;
+            long distance = strtol(optarg, &d_endptr, 10);
+            if (*d_endptr != '\0' || distance < 0 || distance > 1024)
+            {
+                fprintf(stderr, "Error: Invalid prefetch distance \"%s\".\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            configure_prefetch((unsigned int)distance);
+            break;
+        }
+        case 'O':
+            if (parse_reorder_method(optarg, &reorder_method) != 'S')
+            {
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'x':
+            dense_filename = optarg;
+            break;
+        case 'L':
+            if (strcmp(optarg, "row") == 0 || strcmp(optarg, "col") == 0)
+            {
+                dense_layout = strcmp(optarg, "row") == 0 ? DENSE_ROW_MAJOR : DENSE_COL_MAJOR;
+            }
+            else
+            {
+                fprintf(stderr, "Error: Invalid dense layout \"%s\".\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'F':
+            if (strcmp(optarg, "text") == 0 || strcmp(optarg, "binary") == 0)
+            {
+                generate_binary = strcmp(optarg, "binary") == 0;
+            }
+            else
+            {
+                fprintf(stderr, "Error: Invalid file format \"%s\".\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'U':
+            serve_socket = optarg;
+            break;
+        case 'c':
+            connect_socket = optarg;
+            break;
+        case 'k':
+            stop_server = true;
+            break;
+        case 'W':
+        {
+            char *w_endptr;
+            warmups = strtol(optarg, &w_endptr, 10);
+            break;
+        }
+        case 'r':
+            if (strcmp(optarg, "text") == 0)
+            {
+                report_format = REPORT_TEXT;
+            }
+            else if (strcmp(optarg, "json") == 0)
+            {
+                report_format = REPORT_JSON;
+            }
+            else if (strcmp(optarg, "csv") == 0)
+            {
+                report_format = REPORT_CSV;
+            }
+            else
+            {
+                fprintf(stderr, "Error: Invalid report format \"%s\".\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
         case 'h':
             print_usage();
             exit(EXIT_SUCCESS);
@@ -94,13 +387,98 @@ int main(int argc, char **argv)
         }
     }
 
-    if (!a_filename || !b_filename || !output_filename)
+    // converter mode: text input is written as a binary file, binary input as text
+    if (convert_filename != NULL)
+    {
+        if (!output_filename)
+        {
+            fprintf(stderr, "Error: Missing required arguments.\n");
+            exit(EXIT_FAILURE);
+        }
+        EllpackMatrix *matrix = load_ellpack_matrix(convert_filename);
+        if (matrix == NULL)
+        {
+            exit(EXIT_FAILURE);
+        }
+        char status = matrix->mapping != NULL ? dump_ellpack_matrix(output_filename, matrix) : dump_ellpack_binary(output_filename, matrix);
+        free_ellpack_matrix(matrix);
+        exit(status == 'S' ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    // generator mode, the rows are streamed into the file
+    if (generator_spec != NULL)
+    {
+        GeneratorOptions generator_options;
+        if (!output_filename || parse_generator_options(generator_spec, &generator_options) != 'S')
+        {
+            fprintf(stderr, "Error: Missing required arguments.\n");
+            exit(EXIT_FAILURE);
+        }
+        char status = write_generated_matrix(output_filename, &generator_options, generate_binary);
+        exit(status == 'S' ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    // client mode: the server loads, plans and multiplies
+    if (connect_socket != NULL)
+    {
+        if (!stop_server && (!a_filename || !b_filename || !output_filename))
+        {
+            fprintf(stderr, "Error: Missing required arguments.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (!stop_server && version != 1 && version != 2)
+        {
+            fprintf(stderr, "Error: The server runs version 1 or 2.\n");
+            exit(EXIT_FAILURE);
+        }
+        ServerRequest request = {a_filename, b_filename, output_filename, version, generate_binary, stop_server};
+        exit(run_client(connect_socket, &request));
+    }
+
+    if (serve_socket == NULL && (!a_filename || (!b_filename && !dense_filename) || !output_filename))
     {
         fprintf(stderr, "Error: Missing required arguments.\n");
         exit(EXIT_FAILURE);
     }
 
-    // run the matrix multiplication for a certain amount of iterations
+    // select the simd kernel once, before any multiplication runs
+    const SimdKernel *simd_kernel = select_simd_kernel(simd_name);
+    if (simd_kernel == NULL)
+    {
+        fprintf(stderr, "Error: The simd kernel \"%s\" is unknown or not supported by this CPU.\n", simd_name);
+        exit(EXIT_FAILURE);
+    }
+
+    if (version > 2)
+    {
+        fprintf(stderr, "Error: The version number \"%d\" is invalid.\n", version);
+        exit(EXIT_FAILURE);
+    }
+    // server mode, with the simd kernel, threads and index width of the command line
+    if (serve_socket != NULL)
+    {
+        exit(run_server(serve_socket, storage.index_bits));
+    }
+    if (dense_filename != NULL)
+    {
+        exit(run_dense_product(a_filename, dense_filename, output_filename, dense_layout, storage.storage, version, simd_kernel, iterations, warmups, report_format));
+    }
+    MultiplyFunction multiply = storage_multiplication(storage.storage, version);
+    if (multiply == NULL && storage.storage != STORAGE_AUTO)
+    {
+        fprintf(stderr, "Error: The storage \"%s\" requires version 1 or 2.\n", storage_name(storage.storage));
+        exit(EXIT_FAILURE);
+    }
+
+    BenchmarkReport report;
+    report.matrix_a = a_filename;
+    report.matrix_b = b_filename;
+    report.version = version;
+    report.kernel = version == 0 ? "scalar" : simd_kernel->name;
+    report.threads = version == 2 ? thread_pool_size() : 1;
+    report.warmups = warmups;
+
+    double phase_start = benchmark_now();
     EllpackMatrix *m1 = load_ellpack_matrix(a_filename);
     if (m1 == NULL) 
     {
@@ -114,66 +492,162 @@ int main(int argc, char **argv)
         fprintf(stderr, "Error: Failed to allocate m2 matrix\n");
         exit(EXIT_FAILURE);
     }
+    report.load_seconds = benchmark_now() - phase_start;
+    // the report keeps "auto:" in front of the chosen storage, so its benchmark rows do not mix with forced ones
+    char storage_label[32];
+    snprintf(storage_label, sizeof(storage_label), "%s", storage_name(storage.storage));
+    if (storage.storage == STORAGE_AUTO)
+    {
+        storage.storage = select_storage(m1, m2, version);
+        multiply = storage_multiplication(storage.storage, version);
+        snprintf(storage_label, sizeof(storage_label), "auto:%s", storage_name(storage.storage));
+    }
+    report.storage = storage_label;
 
-
-    struct timespec start, end;
-
-    unsigned int counter = 0;
-    double elapsed_time = 0;
-    while (counter < iterations)
+    // reordering: the operands are renumbered before the symbolic phase, its cost is reported on its own
+    Reordering *reordering = NULL;
+    report.reorder_seconds = 0;
+    if (reorder_method != REORDER_NONE)
     {
-        if (version > 2) 
+        phase_start = benchmark_now();
+        reordering = compute_reordering(m1, m2, reorder_method);
+        if (reordering == NULL || apply_reordering(reordering, &m1, &m2) != 'S')
         {
-            fprintf(stderr, "Error: The version number \"%d\" is invalid.\n", version);
+            free_reordering(reordering);
             free_ellpack_matrix(m1);
             free_ellpack_matrix(m2);
             exit(EXIT_FAILURE);
         }
+        report.reorder_seconds = benchmark_now() - phase_start;
+        size_t used = strlen(storage_label);
+        snprintf(storage_label + used, sizeof(storage_label) - used, "+%s", reorder_method_name(reorder_method));
+    }
 
-        float **res = allocate_matrix_array(m1->rows, m2->cols);
-        if (res == NULL)
+    // symbolic phase: the sparsity of the product only depends on the patterns of m1 and m2,
+    // so it is computed once and every iteration reuses the same preallocated result
+    phase_start = benchmark_now();
+    SymbolicProduct *symbolic = symbolic_multiplication(m1, m2, version == 2);
+    if (symbolic == NULL)
+    {
+        free_ellpack_matrix(m1);
+        free_ellpack_matrix(m2);
+        exit(EXIT_FAILURE);
+    }
+    EllpackMatrix *res = allocate_result_matrix(symbolic);
+    free_symbolic_product(symbolic);
+    report.symbolic_seconds = benchmark_now() - phase_start;
+    double *samples = (double *)malloc(iterations * sizeof(double));
+    if (res == NULL || samples == NULL)
+    {
+        fprintf(stderr, "Error: Failed to allocate res.\n");
+        free(samples);
+        free_ellpack_matrix(res);
+        free_ellpack_matrix(m1);
+        free_ellpack_matrix(m2);
+        exit(EXIT_FAILURE);
+    }
+
+    // the flop count and traffic estimate come from the ELLPACK operands, which other storages do not keep
+    uint64_t *flop_prefix = row_flop_prefix(m1, m2);
+    report.flops = flop_prefix != NULL ? flop_prefix[m1->rows] : 0;
+    free(flop_prefix);
+    uint64_t a_nnz = ellpack_nnz(m1);
+
+    // operands of the numeric phase, converting them counts as loading; an ELLPACK operand is the loaded matrix
+    MatrixStorage a_storage = operand_storage(storage.storage, 'A');
+    MatrixStorage b_storage = operand_storage(storage.storage, 'B');
+    void *a_operand = m1;
+    void *b_operand = m2;
+    if (storage.storage != STORAGE_ELLPACK)
+    {
+        phase_start = benchmark_now();
+        a_operand = convert_operand(m1, &storage, a_storage);
+        b_operand = a_operand != NULL ? convert_operand(m2, &storage, b_storage) : NULL;
+        report.load_seconds += benchmark_now() - phase_start;
+        if (a_operand != m1)
         {
-            fprintf(stderr, "Error: Failed to allocate res.\n");
             free_ellpack_matrix(m1);
-            free_ellpack_matrix(m2);
-            exit(EXIT_FAILURE);
         }
-        if (version == 0)
+        if (b_operand != m2)
         {
-            clock_gettime(CLOCK_MONOTONIC, &start);
-            matr_mult_ellpack(m1, m2, res);
-            sleep(1);
-            clock_gettime(CLOCK_MONOTONIC, &end);
+            free_ellpack_matrix(m2);
         }
-        else if (version == 1)
+        m1 = NULL;
+        m2 = NULL;
+        if (b_operand == NULL)
         {
-            clock_gettime(CLOCK_MONOTONIC, &start);
-            matr_mult_ellpack_v1(m1, m2, res);
-            sleep(1);
-            clock_gettime(CLOCK_MONOTONIC, &end);
+            free_operand(a_operand, a_storage);
+            free(samples);
+            free_ellpack_matrix(res);
+            exit(EXIT_FAILURE);
         }
-        else if (version == 2)
+    }
+
+    // V1/V2 read ELLPACK operands through narrowed indices where they fit, the width of B goes into the report
+    unsigned int index_bits = 64;
+    if (storage.storage == STORAGE_ELLPACK && version != 0)
+    {
+        phase_start = benchmark_now();
+        compact_ellpack_indices(m1, storage.index_bits);
+        index_bits = compact_ellpack_indices(m2, storage.index_bits);
+        report.load_seconds += benchmark_now() - phase_start;
+        if (index_bits != 64)
         {
-            clock_gettime(CLOCK_MONOTONIC, &start);
-            matr_mult_ellpack_v2(m1, m2, res);
-            sleep(1);
-            clock_gettime(CLOCK_MONOTONIC, &end);
+            size_t used = strlen(storage_label);
+            snprintf(storage_label + used, sizeof(storage_label) - used, "/i%u", index_bits);
         }
-        char dumped = dump_result_to_ellpack(output_filename, res, m1->rows, m2->cols);
-        free_matrix_array(m1->rows, res);
-        if (dumped == 'F')
+    }
+
+    // numeric phase: warm-ups (caches, page faults of the result, thread pool start-up) are not measured
+    for (unsigned int i = 0; i < warmups; i++)
+    {
+        multiply(a_operand, b_operand, res);
+    }
+    for (unsigned int i = 0; i < iterations; i++)
+    {
+        phase_start = benchmark_now();
+        multiply(a_operand, b_operand, res);
+        samples[i] = benchmark_now() - phase_start;
+    }
+    compute_benchmark_stats(samples, iterations, &report.multiply);
+    free(samples);
+    if (storage.storage != STORAGE_ELLPACK)
+    {
+        free_operand(a_operand, a_storage);
+        free_operand(b_operand, b_storage);
+    }
+    if (reordering != NULL)
+    {
+        phase_start = benchmark_now();
+        char restored = restore_result_order(res, reordering);
+        free_reordering(reordering);
+        report.reorder_seconds += benchmark_now() - phase_start;
+        if (restored != 'S')
         {
+            free_ellpack_matrix(res);
             free_ellpack_matrix(m1);
             free_ellpack_matrix(m2);
             exit(EXIT_FAILURE);
         }
-        counter++;
-        elapsed_time += (end.tv_sec - start.tv_sec) * 1.0e9 + (end.tv_nsec - start.tv_nsec);
     }
 
-    // calculate the duration of matr_mult_ellpack after n iterations
-    printf("Version %d average elapsed time per iteration: %f seconds (%d iterations ran)\n", version, (elapsed_time / iterations / 1.0e9) - 1.0, iterations);
+    // the result is the same in every iteration, it is written once
+    phase_start = benchmark_now();
+    char dumped = dump_result_to_ellpack(output_filename, res);
+    report.dump_seconds = benchmark_now() - phase_start;
+    if (dumped == 'F')
+    {
+        free_ellpack_matrix(res);
+        free_ellpack_matrix(m1);
+        free_ellpack_matrix(m2);
+        exit(EXIT_FAILURE);
+    }
+
+    report.result_nnz = ellpack_nnz(res);
+    report.bytes = estimate_multiplication_bytes(a_nnz, report.flops, report.result_nnz, index_bits);
+    print_benchmark_report(stdout, &report, report_format);
 
+    free_ellpack_matrix(res);
     free_ellpack_matrix(m1);
     free_ellpack_matrix(m2);
 
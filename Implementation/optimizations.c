@@ -1,78 +1,542 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "utils.h"
-#include "immintrin.h" // for simd
 #include "optimizations.h"
+#include "thread_pool.h"
 
 /*
- * simd instructions are used to speed up multiplication itself
- * the last 8 instructions in the loop add sums to the result_row_vector. This is an unrolled loop
- * _mm_set_ps1(a_val) - all floats in m128 are set to value a_val
- * _mm_load_ps(address) - 4 floats are loaded into the register
+ * scalar fallback of the row-scaling kernel: result_row_vector[b_row_indices[i]] += a_val * b_row_vector[i]
  */
-void scalar_multiplication_simd(float a_val, float *b_row_vector, const uint64_t *b_row_indices, float *result_row_vector, uint64_t b_ellpack_cols)
+void scalar_multiplication_scalar(float a_val, const float *b_row_vector, const uint64_t *b_row_indices, float *result_row_vector, uint64_t b_ellpack_cols)
 {
-    size_t i = 0;
-    __m128 sum1;
-    __m128 sum2;
-    for (; i < (b_ellpack_cols & ~7ul); i += 8)
+    for (uint64_t i = 0; i < b_ellpack_cols; i++)
     {
-        sum1 = _mm_set_ps1(a_val); // set 4 values to a
-        sum2 = _mm_set_ps1(a_val);
-        sum1 *= _mm_load_ps(&b_row_vector[i]);    // a * b[i], a * b[i+1], a * b[i+2], a * b[i+3]
-        sum2 *= _mm_load_ps(&b_row_vector[i+4]);  // a * b[i+4], a * b[i+5], a * b[i+6], a * b[i+7]
-        result_row_vector[b_row_indices[i]]   += sum1[0];
-        result_row_vector[b_row_indices[i+1]] += sum1[1];
-        result_row_vector[b_row_indices[i+2]] += sum1[2];
-        result_row_vector[b_row_indices[i+3]] += sum1[3];
-        result_row_vector[b_row_indices[i+4]] += sum2[0];        
-        result_row_vector[b_row_indices[i+5]] += sum2[1];        
-        result_row_vector[b_row_indices[i+6]] += sum2[2];        
-        result_row_vector[b_row_indices[i+7]] += sum2[3];        
+        result_row_vector[b_row_indices[i]] += b_row_vector[i] * a_val;
     }
-    for (; i < b_ellpack_cols; i++) // iterate through the last values (max 7 are left)
+}
+
+/*
+ * scalar fallbacks of the row-scaling kernels of narrowed indices
+ */
+void scalar_multiplication_scalar32(float a_val, const float *b_row_vector, const uint32_t *b_row_indices, float *result_row_vector, uint64_t b_ellpack_cols)
+{
+    for (uint64_t i = 0; i < b_ellpack_cols; i++)
     {
         result_row_vector[b_row_indices[i]] += b_row_vector[i] * a_val;
     }
 }
 
+void scalar_multiplication_scalar16(float a_val, const float *b_row_vector, const uint32_t *b_block_bases, const uint16_t *b_row_deltas, float *result_row_vector, uint64_t b_ellpack_cols)
+{
+    for (uint64_t i = 0; i < b_ellpack_cols; i++)
+    {
+        result_row_vector[b_block_bases[i / INDEX_DELTA_BLOCK] + b_row_deltas[i]] += b_row_vector[i] * a_val;
+    }
+}
 
-void sequential_multiplication(const void *a, const void *b, void *result) 
+/*
+ * scalar fallback of the sparse x dense kernel: every y element sums its products in the entry order of the A row,
+ * row-major y rows are accumulated entry by entry (the x rows are contiguous), column-major y and single
+ * right-hand sides one element at a time
+ */
+void dense_product_scalar(const EllpackMatrix *a_matrix, uint64_t start, uint64_t end, const DenseMatrix *x, DenseMatrix *y)
+{
+    uint64_t rhs = x->cols;
+    for (uint64_t row = start; row < end; row++)
+    {
+        const float *row_values = ellpack_row_values(a_matrix, row);
+        const uint64_t *row_indices = ellpack_row_indices(a_matrix, row);
+        uint64_t length = ellpack_row_length(a_matrix, row);
+        if (y->layout == DENSE_ROW_MAJOR && rhs > 1)
+        {
+            float *y_row = y->values + row * rhs;
+            memset(y_row, 0, rhs * sizeof(float));
+            for (uint64_t j = 0; j < length; j++)
+            {
+                const float *x_row = x->values + row_indices[j] * rhs;
+                for (uint64_t col = 0; col < rhs; col++)
+                {
+                    y_row[col] += row_values[j] * x_row[col];
+                }
+            }
+        }
+        else
+        {
+            for (uint64_t col = 0; col < rhs; col++)
+            {
+                const float *x_col = x->values + col * x->rows;
+                float sum = 0.0F;
+                for (uint64_t j = 0; j < length; j++)
+                {
+                    sum += row_values[j] * x_col[row_indices[j]];
+                }
+                y->values[col * y->rows + row] = sum;
+            }
+        }
+    }
+}
+
+/*
+ * scalar fallback of the column-major sparse x dense kernel: the rows of a block are added slot by slot up to its
+ * width, like the lanes of the simd variants, a row stops at its own length
+ */
+void ellcol_dense_product_scalar(const EllColMatrix *a_matrix, uint64_t start, uint64_t end, const DenseMatrix *x, DenseMatrix *y)
+{
+    for (uint64_t row = start; row < end; row += ELLCOL_BLOCK_ROWS)
+    {
+        uint64_t width = a_matrix->block_widths[row / ELLCOL_BLOCK_ROWS];
+        uint64_t lanes = end - row < ELLCOL_BLOCK_ROWS ? end - row : ELLCOL_BLOCK_ROWS;
+        const uint32_t *lengths = a_matrix->row_lengths + row;
+        for (uint64_t col = 0; col < x->cols; col++)
+        {
+            float sums[ELLCOL_BLOCK_ROWS] = {0.0F};
+            for (uint64_t slot = 0; slot < width; slot++)
+            {
+                const float *slot_values = a_matrix->values + slot * a_matrix->padded_rows + row;
+                const uint32_t *slot_indices = a_matrix->indices + slot * a_matrix->padded_rows + row;
+                for (uint64_t lane = 0; lane < lanes; lane++)
+                {
+                    if (slot < lengths[lane])
+                    {
+                        sums[lane] += slot_values[lane] * x->values[dense_offset(x, slot_indices[lane], col)];
+                    }
+                }
+            }
+            for (uint64_t lane = 0; lane < lanes; lane++)
+            {
+                y->values[dense_offset(y, row + lane, col)] = sums[lane];
+            }
+        }
+    }
+}
+
+// RowMultiplication struct, shared by the workers of one multiply_rows call
+typedef struct
+{
+    const void *a;
+    const void *b;
+    uint64_t b_cols;
+    const uint64_t *row_order;        // NULL: rows in order
+    AccumulateRow accumulate;
+    EllpackMatrix *result;
+    SparseAccumulator **accumulators; // one per worker, allocated on its first block
+    char *status;                     // one per worker, 'F' if its accumulator could not be allocated or grown
+} RowMultiplication;
+
+// row-scaling kernel variants, the avx2/avx512 ones live in their own translation units built with their own -m flags
+static const SimdKernel simd_kernels[] = {
+    {"avx512", "avx512f", scalar_multiplication_avx512, scalar_multiplication_avx512_32, scalar_multiplication_avx512_16, dense_product_avx512, ellcol_dense_product_avx512},
+    {"avx2", "avx2", scalar_multiplication_avx2, scalar_multiplication_avx2_32, scalar_multiplication_avx2_16, dense_product_avx2, ellcol_dense_product_avx2},
+    {"scalar", NULL, scalar_multiplication_scalar, scalar_multiplication_scalar32, scalar_multiplication_scalar16, dense_product_scalar, ellcol_dense_product_scalar},
+};
+
+#define SIMD_KERNEL_COUNT (sizeof(simd_kernels) / sizeof(simd_kernels[0]))
+
+static const SimdKernel *selected_kernel = NULL;
+
+static unsigned int prefetch_distance = PREFETCH_DEFAULT_DISTANCE;
+
+static int simd_kernel_supported(const SimdKernel *kernel)
+{
+    __builtin_cpu_init();
+    if (kernel->cpu_feature == NULL)
+    {
+        return 1;
+    }
+    if (strcmp(kernel->cpu_feature, "avx512f") == 0)
+    {
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd");
+    }
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+/*
+ * Select the row-scaling kernel used by scalar_multiplication_simd.
+ * name == NULL picks the widest variant the CPU supports (CPUID), otherwise the named variant.
+ * Returns the selected variant or NULL if the name is unknown or the CPU cannot run it.
+ */
+const SimdKernel *select_simd_kernel(const char *name)
+{
+    for (size_t i = 0; i < SIMD_KERNEL_COUNT; i++)
+    {
+        const SimdKernel *kernel = &simd_kernels[i];
+        if (name != NULL && strcmp(name, kernel->name) != 0)
+        {
+            continue;
+        }
+        if (simd_kernel_supported(kernel))
+        {
+            selected_kernel = kernel;
+            return kernel;
+        }
+        if (name != NULL)
+        {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Returns the variant scalar_multiplication_simd dispatches to, selecting one on first use
+ */
+const SimdKernel *current_simd_kernel(void)
+{
+    if (selected_kernel == NULL)
+    {
+        select_simd_kernel(NULL);
+    }
+    return selected_kernel;
+}
+
+/*
+ * Set how many A entries ahead accumulate_row_simd prefetches the B rows, 0 turns prefetching off
+ */
+void configure_prefetch(unsigned int distance)
+{
+    prefetch_distance = distance;
+}
+
+unsigned int current_prefetch_distance(void)
+{
+    return prefetch_distance;
+}
+
+/*
+ * Prefetch the first PREFETCH_ROW_LINES cache lines of the values and indices of B row b_row,
+ * the hardware prefetcher picks up the rest of a long row from there
+ */
+static inline void prefetch_b_row(const EllpackMatrix *b_matrix, uint64_t b_row)
+{
+    uint64_t offset = b_row * b_matrix->stride;
+    const char *values = (const char *)(b_matrix->values + offset);
+    const char *indices;
+    switch (b_matrix->index_bits)
+    {
+    case 32:
+        indices = (const char *)(b_matrix->indices32 + offset);
+        break;
+    case 16:
+        indices = (const char *)(b_matrix->index_deltas + offset);
+        __builtin_prefetch(b_matrix->index_bases + offset / INDEX_DELTA_BLOCK, 0, 3);
+        break;
+    default:
+        indices = (const char *)(b_matrix->indices + offset);
+        break;
+    }
+    for (unsigned int line = 0; line < PREFETCH_ROW_LINES; line++)
+    {
+        __builtin_prefetch(values + line * 64, 0, 3);
+        __builtin_prefetch(indices + line * 64, 0, 3);
+    }
+}
+
+/*
+ * Prefetch the dense accumulator cells the first PREFETCH_RESULT_CELLS entries of B row b_row will add to,
+ * its indices were prefetched by prefetch_b_row a few A entries earlier
+ */
+static inline void prefetch_result_cells(const SparseAccumulator *spa, const EllpackMatrix *b_matrix, uint64_t b_row)
+{
+    uint64_t length = ellpack_row_length(b_matrix, b_row);
+    length = length < PREFETCH_RESULT_CELLS ? length : PREFETCH_RESULT_CELLS;
+    for (uint64_t i = 0; i < length; i++)
+    {
+        __builtin_prefetch(spa->values + ellpack_index(b_matrix, b_row, i), 1, 3);
+    }
+}
+
+/*
+ * Scale a B row by a_val and add it into the dense result row through the selected simd variant
+ */
+void scalar_multiplication_simd(float a_val, const float *b_row_vector, const uint64_t *b_row_indices, float *result_row_vector, uint64_t b_ellpack_cols)
+{
+    current_simd_kernel()->kernel(a_val, b_row_vector, b_row_indices, result_row_vector, b_ellpack_cols);
+}
+
+/*
+ * Scale B row b_row by a_val into the accumulator with the kernels of the index width of B
+ */
+static void scale_b_row(SparseAccumulator *spa, AccumulatorKind kind, const SimdKernel *simd, float a_val, const EllpackMatrix *b_matrix, uint64_t b_row)
+{
+    // b_row_vector contains values in b_matrix that a_val can multiply, the indices of B hold their columns
+    const float *b_row_vector = ellpack_row_values(b_matrix, b_row);
+    uint64_t b_offset = b_row * b_matrix->stride;
+    uint64_t b_length = ellpack_row_length(b_matrix, b_row);
+
+    // result row would be a_row
+    // result col would be b_col
+    switch (b_matrix->index_bits)
+    {
+    case 32:
+    {
+        const uint32_t *b_row_indices = b_matrix->indices32 + b_offset;
+        if (kind == ACCUMULATOR_DENSE)
+        {
+            simd->kernel32(a_val, b_row_vector, b_row_indices, spa->values, b_length);
+            spa_mark32(spa, b_row_indices, b_length);
+        }
+        else
+        {
+            spa_scale_row32(spa, a_val, b_row_vector, b_row_indices, b_length);
+        }
+        break;
+    }
+    case 16:
+    {
+        const uint32_t *b_block_bases = b_matrix->index_bases + b_offset / INDEX_DELTA_BLOCK;
+        const uint16_t *b_row_deltas = b_matrix->index_deltas + b_offset;
+        if (kind == ACCUMULATOR_DENSE)
+        {
+            simd->kernel16(a_val, b_row_vector, b_block_bases, b_row_deltas, spa->values, b_length);
+            spa_mark16(spa, b_block_bases, b_row_deltas, b_length);
+        }
+        else
+        {
+            spa_scale_row16(spa, a_val, b_row_vector, b_block_bases, b_row_deltas, b_length);
+        }
+        break;
+    }
+    default:
+    {
+        const uint64_t *b_row_indices = b_matrix->indices + b_offset;
+        if (kind == ACCUMULATOR_DENSE)
+        {
+            simd->kernel(a_val, b_row_vector, b_row_indices, spa->values, b_length);
+            spa_mark(spa, b_row_indices, b_length);
+        }
+        else
+        {
+            spa_scale_row(spa, a_val, b_row_vector, b_row_indices, b_length);
+        }
+        break;
+    }
+    }
+}
+
+/*
+ * Accumulate row a_row of A * B into the accumulator (Gustavson row-by-row product)
+ * The accumulator is chosen from the row's upper-bound flop count, the sum of the lengths of the B rows it touches.
+ * Only the valid entries of the rows are read (row_lengths), padding costs nothing.
+ * With a dense accumulator every B row is scaled with the selected simd kernel and its columns are recorded,
+ * hash and sort-merge accumulators take the products one by one.
+ * The B rows are a dependent lookup through the indices of A, so the loop prefetches ahead of them.
+ * The first `distance` B rows are prefetched before the loop. Inside it, every A entry prefetches the values
+ * and indices of the B row `distance` entries ahead, and for a dense accumulator the result cells of the B row
+ * half as far ahead, whose indices should have arrived by then.
+ * Returns 'F' if the accumulator could not grow its buffers.
+ */
+char accumulate_row_simd(const EllpackMatrix *a_matrix, const EllpackMatrix *b_matrix, uint64_t a_row, SparseAccumulator *spa)
+{
+    const float *a_row_values = ellpack_row_values(a_matrix, a_row);
+    uint64_t a_length = ellpack_row_length(a_matrix, a_row);
+    uint64_t flops = 0;
+    for (uint64_t a_ellpack_col = 0; a_ellpack_col < a_length; a_ellpack_col++)
+    {
+        flops += ellpack_row_length(b_matrix, ellpack_index(a_matrix, a_row, a_ellpack_col));
+    }
+
+    AccumulatorKind kind = choose_accumulator(b_matrix->cols, flops);
+    if (spa_begin_row(spa, kind, flops) != 'S')
+    {
+        return 'F';
+    }
+    const SimdKernel *simd = current_simd_kernel();
+    uint64_t distance = prefetch_distance;
+    uint64_t cell_distance = kind == ACCUMULATOR_DENSE ? distance / 2 : 0;
+    for (uint64_t a_ellpack_col = 0; a_ellpack_col < distance && a_ellpack_col < a_length; a_ellpack_col++)
+    {
+        prefetch_b_row(b_matrix, ellpack_index(a_matrix, a_row, a_ellpack_col));
+    }
+
+    for (uint64_t a_ellpack_col = 0; a_ellpack_col < a_length; a_ellpack_col++)
+    {
+        if (distance != 0 && a_ellpack_col + distance < a_length)
+        {
+            prefetch_b_row(b_matrix, ellpack_index(a_matrix, a_row, a_ellpack_col + distance));
+        }
+        if (cell_distance != 0 && a_ellpack_col + cell_distance < a_length)
+        {
+            prefetch_result_cells(spa, b_matrix, ellpack_index(a_matrix, a_row, a_ellpack_col + cell_distance));
+        }
+        scale_b_row(spa, kind, simd, a_row_values[a_ellpack_col], b_matrix, ellpack_index(a_matrix, a_row, a_ellpack_col));
+    }
+    return 'S';
+}
+
+/*
+ * Upper-bound flop count of every row of A * B as a prefix sum: row a_row costs
+ * flop_prefix[a_row + 1] - flop_prefix[a_row] multiply-adds (same estimate as accumulate_row_simd).
+ * Returns NULL if the rows + 1 entries could not be allocated.
+ */
+uint64_t *row_flop_prefix(const EllpackMatrix *a_matrix, const EllpackMatrix *b_matrix)
+{
+    uint64_t *flop_prefix = (uint64_t *)malloc((a_matrix->rows + 1) * sizeof(uint64_t));
+    if (flop_prefix == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "row flop prefix");
+        return NULL;
+    }
+
+    flop_prefix[0] = 0;
+    for (uint64_t a_row = 0; a_row < a_matrix->rows; a_row++)
+    {
+        uint64_t a_length = ellpack_row_length(a_matrix, a_row);
+        uint64_t flops = 0;
+        for (uint64_t a_ellpack_col = 0; a_ellpack_col < a_length; a_ellpack_col++)
+        {
+            flops += ellpack_row_length(b_matrix, ellpack_index(a_matrix, a_row, a_ellpack_col));
+        }
+        flop_prefix[a_row + 1] = flop_prefix[a_row] + flops;
+    }
+    return flop_prefix;
+}
+
+/*
+ * Cut the rows [0, rows) into block_count blocks of about equal work, bounds gets block_count + 1 entries.
+ * The work of a row is its flop count plus one for the per-row overhead (gather and store), so blocks of
+ * empty rows stay bounded too. Block k ends at the first row whose work prefix reaches k / block_count of the total,
+ * a single expensive row can not be split and may leave the following blocks empty.
+ */
+void partition_rows_by_flops(const uint64_t *flop_prefix, uint64_t rows, uint64_t block_count, uint64_t *bounds)
+{
+    uint64_t total_work = flop_prefix[rows] + rows;
+    uint64_t row = 0;
+
+    bounds[0] = 0;
+    for (uint64_t block = 1; block < block_count; block++)
+    {
+        // total_work * block / block_count without overflowing total_work * block
+        uint64_t target = total_work / block_count * block + total_work % block_count * block / block_count;
+        while (row < rows && flop_prefix[row] + row < target)
+        {
+            row++;
+        }
+        bounds[block] = row;
+    }
+    bounds[block_count] = rows;
+}
+
+/*
+ * Numeric phase of A * B on the calling thread, result is an EllpackMatrix allocated from the symbolic phase
+ */
+void sequential_multiplication(const void *a, const void *b, void *result)
 {
     EllpackMatrix *a_matrix = (EllpackMatrix *)a;
     EllpackMatrix *b_matrix = (EllpackMatrix *)b;
-    float **result_matrix = (float **)result;
-    
+    EllpackMatrix *result_matrix = (EllpackMatrix *)result;
+
     if (a_matrix->cols != b_matrix->rows)
     {
         fprintf(stderr, ERR_INVALID_MATRIX_DIMENSIONS, a_matrix->cols, b_matrix->rows);
-        free_matrix_array(a_matrix->rows, result);
         free_ellpack_matrix((EllpackMatrix *)a);
         free_ellpack_matrix((EllpackMatrix *)b);
+        free_ellpack_matrix(result_matrix);
+        exit(EXIT_FAILURE);
+    }
+
+    SparseAccumulator *spa = allocate_sparse_accumulator(b_matrix->cols);
+    if (spa == NULL)
+    {
+        free_ellpack_matrix((EllpackMatrix *)a);
+        free_ellpack_matrix((EllpackMatrix *)b);
+        free_ellpack_matrix(result_matrix);
         exit(EXIT_FAILURE);
     }
 
     for (uint64_t a_row = 0; a_row < a_matrix->rows; a_row++)
     {
-        for (uint64_t a_ellpack_col = 0; a_ellpack_col < a_matrix->ellpack_cols; a_ellpack_col++)
+        if (accumulate_row_simd(a_matrix, b_matrix, a_row, spa) != 'S')
         {
-            float a_val = a_matrix->values[a_row][a_ellpack_col];
-            // break the row iteration once we encountered a zero entry
-            if (a_val == 0)
-            {
-                break;
-            }
-            uint64_t a_col = a_matrix->indices[a_row][a_ellpack_col];
+            free_sparse_accumulator(spa);
+            free_ellpack_matrix((EllpackMatrix *)a);
+            free_ellpack_matrix((EllpackMatrix *)b);
+            free_ellpack_matrix(result_matrix);
+            exit(EXIT_FAILURE);
+        }
+        spa_store_row(spa, result_matrix, a_row);
+    }
+
+    free_sparse_accumulator(spa);
+}
 
-            // b_row_vector contains values in b_matrix that a_val can multiply
-            // b_row_indices contains the column index of the values in b_matrix
-            float *b_row_vector = b_matrix->values[a_col];
-            uint64_t *b_row_indices = b_matrix->indices[a_col];
+/*
+ * Multiply the rows at the positions [start, end) of the row order, run by pool worker `worker`.
+ * Every row is stored to its own row of the result.
+ */
+static void multiply_row_block(void *arg, uint64_t start, uint64_t end, unsigned int worker)
+{
+    RowMultiplication *data = (RowMultiplication *)arg;
+    if (data->status[worker] != 'S')
+    {
+        return;
+    }
+    if (data->accumulators[worker] == NULL)
+    {
+        data->accumulators[worker] = allocate_sparse_accumulator(data->b_cols);
+        if (data->accumulators[worker] == NULL)
+        {
+            data->status[worker] = 'F';
+            return;
+        }
+    }
+    SparseAccumulator *spa = data->accumulators[worker];
 
-            // result row would be a_row
-            // result col would be b_col
-            scalar_multiplication_simd(a_val, b_row_vector, b_row_indices, result_matrix[a_row], b_matrix->ellpack_cols);
+    for (uint64_t position = start; position < end; position++)
+    {
+        uint64_t a_row = data->row_order != NULL ? data->row_order[position] : position;
+        if (data->accumulate(data->a, data->b, a_row, spa) != 'S')
+        {
+            data->status[worker] = 'F';
+            return;
         }
+        spa_store_row(spa, data->result, a_row);
+    }
+}
+
+/*
+ * Numeric phase of A * B for operand storages other than EllpackMatrix, accumulate computes one row.
+ * The rows run in row_order (NULL: 0 .. rows - 1) on the calling thread (workers == 1) or as blocks
+ * on the thread pool. result is an EllpackMatrix allocated from the symbolic phase.
+ * Returns 'F' if an accumulator could not be allocated.
+ */
+char multiply_rows(const void *a, const void *b, uint64_t b_cols, uint64_t rows, const uint64_t *row_order, AccumulateRow accumulate, EllpackMatrix *result, unsigned int workers)
+{
+    RowMultiplication data;
+    data.a = a;
+    data.b = b;
+    data.b_cols = b_cols;
+    data.row_order = row_order;
+    data.accumulate = accumulate;
+    data.result = result;
+    data.accumulators = (SparseAccumulator **)calloc(workers, sizeof(SparseAccumulator *));
+    data.status = (char *)malloc(workers * sizeof(char));
+    if (data.accumulators == NULL || data.status == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "thread data");
+        free(data.accumulators);
+        free(data.status);
+        return 'F';
+    }
+    memset(data.status, 'S', workers);
+
+    if (workers == 1)
+    {
+        multiply_row_block(&data, 0, rows, 0);
+    }
+    else
+    {
+        thread_pool_run_rows(rows, multiply_row_block, &data);
+    }
+
+    char status = 'S';
+    for (unsigned int i = 0; i < workers; i++)
+    {
+        free_sparse_accumulator(data.accumulators[i]);
+        status = data.status[i] != 'S' ? 'F' : status;
     }
+    free(data.accumulators);
+    free(data.status);
+    return status;
 }
@@ -1,2 +1,88 @@
-void scalar_multiplication_simd(float a_val, float *b_row_vector, const uint64_t *b_row_indices, float *result_row_vector, uint64_t b_ellpack_cols);
-void sequential_multiplication(const void *a, const void *b, void *result);
\ No newline at end of file
+#ifndef FINAL_OPTIMIZATIONS_H
+#define FINAL_OPTIMIZATIONS_H
+
+#include "utils.h"
+#include "accumulator.h"
+#include "ellpack_col.h"
+
+// Row-scaling kernel: result_row_vector[b_row_indices[i]] += a_val * b_row_vector[i] for i < b_ellpack_cols
+// The kernels get the valid entries of a B row (ellpack_row_length), the indices of a row are distinct
+// (the loaders reject duplicates).
+typedef void (*ScaleRowKernel)(float a_val, const float *b_row_vector, const uint64_t *b_row_indices, float *result_row_vector, uint64_t b_ellpack_cols);
+
+// Row-scaling kernels of narrowed indices (see compact_indices.h), same contract as ScaleRowKernel:
+// 32-bit indices, or 16-bit deltas to one base per INDEX_DELTA_BLOCK entries (b_block_bases[i / INDEX_DELTA_BLOCK])
+typedef void (*ScaleRowKernel32)(float a_val, const float *b_row_vector, const uint32_t *b_row_indices, float *result_row_vector, uint64_t b_ellpack_cols);
+typedef void (*ScaleRowKernel16)(float a_val, const float *b_row_vector, const uint32_t *b_block_bases, const uint16_t *b_row_deltas, float *result_row_vector, uint64_t b_ellpack_cols);
+
+// Sparse x dense kernel: rows [start, end) of y = A * x for the ELLPACK matrix A and dense x and y of the same
+// layout (see spmm.h), every y element is the sum of its products in the entry order of the A row
+typedef void (*DenseProductKernel)(const EllpackMatrix *a_matrix, uint64_t start, uint64_t end, const DenseMatrix *x, DenseMatrix *y);
+
+// Sparse x dense kernel of a column-major ELLPACK A (see ellpack_col.h), same contract as DenseProductKernel;
+// start is a multiple of ELLCOL_BLOCK_ROWS
+typedef void (*EllColDenseProductKernel)(const EllColMatrix *a_matrix, uint64_t start, uint64_t end, const DenseMatrix *x, DenseMatrix *y);
+
+// Accumulate row a_row of A * B into the accumulator for one operand storage (SELL, HYB, ...),
+// returns 'F' if the accumulator could not grow its buffers
+typedef char (*AccumulateRow)(const void *a, const void *b, uint64_t a_row, SparseAccumulator *spa);
+
+// Software prefetching of the Gustavson loop, see configure_prefetch(). Can be overridden with -D at build time.
+#ifndef PREFETCH_DEFAULT_DISTANCE
+#define PREFETCH_DEFAULT_DISTANCE 0 // A entries the B row prefetches run ahead, 0 (off) unless set with --prefetch
+#endif
+#define PREFETCH_ROW_LINES 2        // cache lines prefetched from the start of a B row's values and indices
+#define PREFETCH_RESULT_CELLS 16    // result cells prefetched per B row (the columns of its first entries)
+
+// By default the simd variants multiply and add separately, so every variant rounds exactly like the scalar
+// kernel and the result does not depend on the CPU it ran on. -DSIMD_FUSED_MULTIPLY_ADD switches them to
+// fma instructions (one rounding, results may differ in the last bit between variants).
+#ifdef SIMD_FUSED_MULTIPLY_ADD
+#define SIMD_MULTIPLY_ADD_128(a, b, c) _mm_fmadd_ps((a), (b), (c))
+#define SIMD_MULTIPLY_ADD_256(a, b, c) _mm256_fmadd_ps((a), (b), (c))
+#define SIMD_MULTIPLY_ADD_512(a, b, c) _mm512_fmadd_ps((a), (b), (c))
+#else
+#define SIMD_MULTIPLY_ADD_128(a, b, c) _mm_add_ps(_mm_mul_ps((a), (b)), (c))
+#define SIMD_MULTIPLY_ADD_256(a, b, c) _mm256_add_ps(_mm256_mul_ps((a), (b)), (c))
+#define SIMD_MULTIPLY_ADD_512(a, b, c) _mm512_add_ps(_mm512_mul_ps((a), (b)), (c))
+#endif
+
+// SimdKernel struct, one per compiled variant
+typedef struct
+{
+    const char *name;
+    const char *cpu_feature; // NULL if the variant runs everywhere
+    ScaleRowKernel kernel;
+    ScaleRowKernel32 kernel32;
+    ScaleRowKernel16 kernel16;
+    DenseProductKernel dense_product;
+    EllColDenseProductKernel ellcol_dense_product;
+} SimdKernel;
+
+void scalar_multiplication_scalar(float a_val, const float *b_row_vector, const uint64_t *b_row_indices, float *result_row_vector, uint64_t b_ellpack_cols);
+void scalar_multiplication_avx2(float a_val, const float *b_row_vector, const uint64_t *b_row_indices, float *result_row_vector, uint64_t b_ellpack_cols);
+void scalar_multiplication_avx512(float a_val, const float *b_row_vector, const uint64_t *b_row_indices, float *result_row_vector, uint64_t b_ellpack_cols);
+void scalar_multiplication_scalar32(float a_val, const float *b_row_vector, const uint32_t *b_row_indices, float *result_row_vector, uint64_t b_ellpack_cols);
+void scalar_multiplication_avx2_32(float a_val, const float *b_row_vector, const uint32_t *b_row_indices, float *result_row_vector, uint64_t b_ellpack_cols);
+void scalar_multiplication_avx512_32(float a_val, const float *b_row_vector, const uint32_t *b_row_indices, float *result_row_vector, uint64_t b_ellpack_cols);
+void scalar_multiplication_scalar16(float a_val, const float *b_row_vector, const uint32_t *b_block_bases, const uint16_t *b_row_deltas, float *result_row_vector, uint64_t b_ellpack_cols);
+void scalar_multiplication_avx2_16(float a_val, const float *b_row_vector, const uint32_t *b_block_bases, const uint16_t *b_row_deltas, float *result_row_vector, uint64_t b_ellpack_cols);
+void scalar_multiplication_avx512_16(float a_val, const float *b_row_vector, const uint32_t *b_block_bases, const uint16_t *b_row_deltas, float *result_row_vector, uint64_t b_ellpack_cols);
+void dense_product_scalar(const EllpackMatrix *a_matrix, uint64_t start, uint64_t end, const DenseMatrix *x, DenseMatrix *y);
+void dense_product_avx2(const EllpackMatrix *a_matrix, uint64_t start, uint64_t end, const DenseMatrix *x, DenseMatrix *y);
+void dense_product_avx512(const EllpackMatrix *a_matrix, uint64_t start, uint64_t end, const DenseMatrix *x, DenseMatrix *y);
+void ellcol_dense_product_scalar(const EllColMatrix *a_matrix, uint64_t start, uint64_t end, const DenseMatrix *x, DenseMatrix *y);
+void ellcol_dense_product_avx2(const EllColMatrix *a_matrix, uint64_t start, uint64_t end, const DenseMatrix *x, DenseMatrix *y);
+void ellcol_dense_product_avx512(const EllColMatrix *a_matrix, uint64_t start, uint64_t end, const DenseMatrix *x, DenseMatrix *y);
+const SimdKernel *select_simd_kernel(const char *name);
+const SimdKernel *current_simd_kernel(void);
+void configure_prefetch(unsigned int distance);
+unsigned int current_prefetch_distance(void);
+void scalar_multiplication_simd(float a_val, const float *b_row_vector, const uint64_t *b_row_indices, float *result_row_vector, uint64_t b_ellpack_cols);
+char accumulate_row_simd(const EllpackMatrix *a_matrix, const EllpackMatrix *b_matrix, uint64_t a_row, SparseAccumulator *spa);
+uint64_t *row_flop_prefix(const EllpackMatrix *a_matrix, const EllpackMatrix *b_matrix);
+void partition_rows_by_flops(const uint64_t *flop_prefix, uint64_t rows, uint64_t block_count, uint64_t *bounds);
+void sequential_multiplication(const void *a, const void *b, void *result);
+char multiply_rows(const void *a, const void *b, uint64_t b_cols, uint64_t rows, const uint64_t *row_order, AccumulateRow accumulate, EllpackMatrix *result, unsigned int workers);
+
+#endif
@@ -0,0 +1,311 @@
+#include <stdint.h>
+#include "immintrin.h" // for simd
+#include "optimizations.h"
+
+/*
+ * AVX2 variant of the row-scaling kernel, this file is built with -mavx2 -mfma -ffp-contract=off
+ * 8 entries per iteration:
+ * _mm256_i64gather_ps - the 4 result cells addressed by 4 64-bit indices are gathered into a m128
+ * SIMD_MULTIPLY_ADD_128 - result + a * b, see optimizations.h
+ * AVX2 has no scatter, the lanes are stored back one by one. The kernels only get the valid entries of a row,
+ * whose indices are distinct (the loaders reject duplicates), so no two lanes write the same cell. Every lane is
+ * stored, explicit zeros and NaN values too, so the result is the one of the scalar kernel.
+ */
+void scalar_multiplication_avx2(float a_val, const float *b_row_vector, const uint64_t *b_row_indices, float *result_row_vector, uint64_t b_ellpack_cols)
+{
+    const __m128 a = _mm_set1_ps(a_val);
+    uint64_t i = 0;
+    for (; i + 8 <= b_ellpack_cols; i += 8)
+    {
+        __m256 b = _mm256_loadu_ps(&b_row_vector[i]);
+        __m256i index_low = _mm256_loadu_si256((const __m256i *)&b_row_indices[i]);
+        __m256i index_high = _mm256_loadu_si256((const __m256i *)&b_row_indices[i + 4]);
+        __m128 sum_low = _mm256_i64gather_ps(result_row_vector, index_low, 4);
+        __m128 sum_high = _mm256_i64gather_ps(result_row_vector, index_high, 4);
+        sum_low = SIMD_MULTIPLY_ADD_128(a, _mm256_castps256_ps128(b), sum_low);
+        sum_high = SIMD_MULTIPLY_ADD_128(a, _mm256_extractf128_ps(b, 1), sum_high);
+
+        float sums[8];
+        _mm_storeu_ps(&sums[0], sum_low);
+        _mm_storeu_ps(&sums[4], sum_high);
+        for (int lane = 0; lane < 8; lane++)
+        {
+            result_row_vector[b_row_indices[i + lane]] = sums[lane];
+        }
+    }
+    for (; i < b_ellpack_cols; i++) // iterate through the last values (max 7 are left)
+    {
+        result_row_vector[b_row_indices[i]] += b_row_vector[i] * a_val;
+    }
+}
+
+/*
+ * AVX2 variant for 32-bit indices: one _mm256_i32gather_ps fetches all 8 result cells
+ * (the gathers take signed 32-bit lanes, compact_ellpack_indices only narrows matrices with at most 2^31 columns)
+ */
+void scalar_multiplication_avx2_32(float a_val, const float *b_row_vector, const uint32_t *b_row_indices, float *result_row_vector, uint64_t b_ellpack_cols)
+{
+    const __m256 a = _mm256_set1_ps(a_val);
+    uint64_t i = 0;
+    for (; i + 8 <= b_ellpack_cols; i += 8)
+    {
+        __m256 b = _mm256_loadu_ps(&b_row_vector[i]);
+        __m256i index = _mm256_loadu_si256((const __m256i *)&b_row_indices[i]);
+        __m256 sum = SIMD_MULTIPLY_ADD_256(a, b, _mm256_i32gather_ps(result_row_vector, index, 4));
+
+        float sums[8];
+        _mm256_storeu_ps(sums, sum);
+        for (int lane = 0; lane < 8; lane++)
+        {
+            result_row_vector[b_row_indices[i + lane]] = sums[lane];
+        }
+    }
+    for (; i < b_ellpack_cols; i++) // iterate through the last values (max 7 are left)
+    {
+        result_row_vector[b_row_indices[i]] += b_row_vector[i] * a_val;
+    }
+}
+
+/*
+ * AVX2 variant for 16-bit delta indices: the 8 deltas are widened to 32-bit lanes and gather from the base
+ * column of their block (8 divides INDEX_DELTA_BLOCK, so all lanes share one base)
+ */
+void scalar_multiplication_avx2_16(float a_val, const float *b_row_vector, const uint32_t *b_block_bases, const uint16_t *b_row_deltas, float *result_row_vector, uint64_t b_ellpack_cols)
+{
+    const __m256 a = _mm256_set1_ps(a_val);
+    uint64_t i = 0;
+    for (; i + 8 <= b_ellpack_cols; i += 8)
+    {
+        __m256 b = _mm256_loadu_ps(&b_row_vector[i]);
+        float *block_result = result_row_vector + b_block_bases[i / INDEX_DELTA_BLOCK];
+        __m256i index = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)&b_row_deltas[i]));
+        __m256 sum = SIMD_MULTIPLY_ADD_256(a, b, _mm256_i32gather_ps(block_result, index, 4));
+
+        float sums[8];
+        _mm256_storeu_ps(sums, sum);
+        for (int lane = 0; lane < 8; lane++)
+        {
+            block_result[b_row_deltas[i + lane]] = sums[lane];
+        }
+    }
+    for (; i < b_ellpack_cols; i++) // iterate through the last values (max 7 are left)
+    {
+        result_row_vector[b_block_bases[i / INDEX_DELTA_BLOCK] + b_row_deltas[i]] += b_row_vector[i] * a_val;
+    }
+}
+
+/*
+ * AVX2 variant of the sparse x dense kernel, the same structure as the AVX-512 one with 8-lane registers:
+ * 32 row-major right-hand sides per entry in 4 registers, 8 column-major ones gathered as two halves of 4
+ * (AVX2 has no scatter, column-major y is stored lane by lane). Every lane adds its products in entry order.
+ * A single right-hand side runs the scalar kernel, see the AVX-512 variant.
+ */
+void dense_product_avx2(const EllpackMatrix *a_matrix, uint64_t start, uint64_t end, const DenseMatrix *x, DenseMatrix *y)
+{
+    uint64_t rhs = x->cols;
+    if (rhs == 1)
+    {
+        dense_product_scalar(a_matrix, start, end, x, y);
+        return;
+    }
+
+    const long long x_rows = (long long)x->rows;
+    const __m256i x_columns = _mm256_set_epi64x(3 * x_rows, 2 * x_rows, x_rows, 0);
+    const __m256i lane_numbers = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for (uint64_t row = start; row < end; row++)
+    {
+        const float *row_values = ellpack_row_values(a_matrix, row);
+        const uint64_t *row_indices = ellpack_row_indices(a_matrix, row);
+        uint64_t length = ellpack_row_length(a_matrix, row);
+        if (y->layout == DENSE_ROW_MAJOR)
+        {
+            float *y_row = y->values + row * rhs;
+            uint64_t col = 0;
+            for (; col + 32 <= rhs; col += 32)
+            {
+                __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+                __m256 sum2 = _mm256_setzero_ps(), sum3 = _mm256_setzero_ps();
+                for (uint64_t j = 0; j < length; j++)
+                {
+                    const __m256 a = _mm256_set1_ps(row_values[j]);
+                    const float *x_row = x->values + row_indices[j] * rhs + col;
+                    sum0 = SIMD_MULTIPLY_ADD_256(a, _mm256_loadu_ps(x_row), sum0);
+                    sum1 = SIMD_MULTIPLY_ADD_256(a, _mm256_loadu_ps(x_row + 8), sum1);
+                    sum2 = SIMD_MULTIPLY_ADD_256(a, _mm256_loadu_ps(x_row + 16), sum2);
+                    sum3 = SIMD_MULTIPLY_ADD_256(a, _mm256_loadu_ps(x_row + 24), sum3);
+                }
+                _mm256_storeu_ps(y_row + col, sum0);
+                _mm256_storeu_ps(y_row + col + 8, sum1);
+                _mm256_storeu_ps(y_row + col + 16, sum2);
+                _mm256_storeu_ps(y_row + col + 24, sum3);
+            }
+            for (; col < rhs; col += 8) // the last (max 31) right-hand sides, 8 per pass
+            {
+                __m256i lanes = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)(rhs - col < 8 ? rhs - col : 8)), lane_numbers);
+                __m256 sum = _mm256_setzero_ps();
+                for (uint64_t j = 0; j < length; j++)
+                {
+                    const float *x_row = x->values + row_indices[j] * rhs + col;
+                    sum = SIMD_MULTIPLY_ADD_256(_mm256_set1_ps(row_values[j]), _mm256_maskload_ps(x_row, lanes), sum);
+                }
+                _mm256_maskstore_ps(y_row + col, lanes, sum);
+            }
+        }
+        else
+        {
+            for (uint64_t col = 0; col < rhs; col += 8)
+            {
+                uint64_t count = rhs - col < 8 ? rhs - col : 8;
+                __m256i active = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)count), lane_numbers);
+                __m128 low = _mm_castsi128_ps(_mm256_castsi256_si128(active));
+                __m128 high = _mm_castsi128_ps(_mm256_extracti128_si256(active, 1));
+                __m256i x_low = _mm256_add_epi64(x_columns, _mm256_set1_epi64x((long long)col * x_rows));
+                __m256i x_high = _mm256_add_epi64(x_low, _mm256_set1_epi64x(4 * x_rows));
+                __m128 sum_low = _mm_setzero_ps();
+                __m128 sum_high = _mm_setzero_ps();
+                for (uint64_t j = 0; j < length; j++)
+                {
+                    const __m128 a = _mm_set1_ps(row_values[j]);
+                    const __m256i index = _mm256_set1_epi64x((long long)row_indices[j]);
+                    __m128 xs_low = _mm256_mask_i64gather_ps(_mm_setzero_ps(), x->values, _mm256_add_epi64(x_low, index), low, 4);
+                    __m128 xs_high = _mm256_mask_i64gather_ps(_mm_setzero_ps(), x->values, _mm256_add_epi64(x_high, index), high, 4);
+                    sum_low = SIMD_MULTIPLY_ADD_128(a, xs_low, sum_low);
+                    sum_high = SIMD_MULTIPLY_ADD_128(a, xs_high, sum_high);
+                }
+                float sums[8];
+                _mm_storeu_ps(&sums[0], sum_low);
+                _mm_storeu_ps(&sums[4], sum_high);
+                for (uint64_t lane = 0; lane < count; lane++)
+                {
+                    y->values[(col + lane) * y->rows + row] = sums[lane];
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Add slot values * x_col[indices] to the active lanes of sum, the other lanes are left unchanged
+ */
+static inline __m256 ellcol_add_column_avx2(__m256 sum, __m256 active, __m256 values, __m256i indices, const float *x_col)
+{
+    __m256 xs = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), x_col, indices, active, 4);
+    return _mm256_blendv_ps(sum, SIMD_MULTIPLY_ADD_256(values, xs, sum), active);
+}
+
+/*
+ * The same for a row-major x, the 64-bit offsets (index * right-hand sides) of lanes 0-3 and 4-7 from x_col
+ */
+static inline __m256 ellcol_add_row_avx2(__m256 sum, __m256 active, __m256 values, __m256i offsets_low, __m256i offsets_high, const float *x_col)
+{
+    __m128 xs_low = _mm256_mask_i64gather_ps(_mm_setzero_ps(), x_col, offsets_low, _mm256_castps256_ps128(active), 4);
+    __m128 xs_high = _mm256_mask_i64gather_ps(_mm_setzero_ps(), x_col, offsets_high, _mm256_extractf128_ps(active, 1), 4);
+    return _mm256_blendv_ps(sum, SIMD_MULTIPLY_ADD_256(values, _mm256_set_m128(xs_high, xs_low), sum), active);
+}
+
+/*
+ * Store the first rows lanes of sum to column col of y: one masked store into a column-major y, lane by lane into a row-major one
+ */
+static inline void ellcol_store_column_avx2(__m256 sum, __m256i lanes, uint64_t rows, uint64_t row, uint64_t col, int by_column, DenseMatrix *y)
+{
+    if (by_column)
+    {
+        _mm256_maskstore_ps(y->values + col * y->rows + row, lanes, sum);
+        return;
+    }
+    float sums[8];
+    _mm256_storeu_ps(sums, sum);
+    for (uint64_t lane = 0; lane < rows; lane++)
+    {
+        y->values[(row + lane) * y->cols + col] = sums[lane];
+    }
+}
+
+/*
+ * AVX2 variant of the column-major sparse x dense kernel, the same structure as the AVX-512 one with 8-lane
+ * registers (a block runs as two halves): a column-major x is gathered with the 32-bit indices and a y column
+ * written with one masked store, a row-major x is gathered as two halves of 4 through 64-bit offsets and y
+ * stored lane by lane (AVX2 has no scatter). Lanes past the end of their row keep their sum.
+ */
+void ellcol_dense_product_avx2(const EllColMatrix *a_matrix, uint64_t start, uint64_t end, const DenseMatrix *x, DenseMatrix *y)
+{
+    uint64_t rhs = x->cols;
+    if (rhs > UINT32_MAX) // the offsets are multiplied with 32-bit factors
+    {
+        ellcol_dense_product_scalar(a_matrix, start, end, x, y);
+        return;
+    }
+
+    const int by_column = x->layout == DENSE_COL_MAJOR || rhs == 1;
+    const uint64_t padded_rows = a_matrix->padded_rows;
+    const __m256i rhs_factor = _mm256_set1_epi64x((long long)rhs);
+    const __m256i lane_numbers = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for (uint64_t row = start; row < end; row += 8)
+    {
+        uint64_t width = a_matrix->block_widths[row / ELLCOL_BLOCK_ROWS];
+        uint64_t rows = end - row < 8 ? end - row : 8;
+        const __m256i lanes = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)rows), lane_numbers);
+        const __m256i lengths = _mm256_load_si256((const __m256i *)(a_matrix->row_lengths + row));
+        for (uint64_t col = 0; col < rhs; col += 4)
+        {
+            uint64_t count = rhs - col < 4 ? rhs - col : 4;
+            __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+            __m256 sum2 = _mm256_setzero_ps(), sum3 = _mm256_setzero_ps();
+            for (uint64_t slot = 0; slot < width; slot++)
+            {
+                const __m256 active = _mm256_castsi256_ps(_mm256_cmpgt_epi32(lengths, _mm256_set1_epi32((int)slot)));
+                const __m256 values = _mm256_load_ps(a_matrix->values + slot * padded_rows + row);
+                const __m256i indices = _mm256_load_si256((const __m256i *)(a_matrix->indices + slot * padded_rows + row));
+                if (by_column)
+                {
+                    const float *x_col = x->values + col * x->rows;
+                    sum0 = ellcol_add_column_avx2(sum0, active, values, indices, x_col);
+                    if (count > 1)
+                    {
+                        sum1 = ellcol_add_column_avx2(sum1, active, values, indices, x_col + x->rows);
+                    }
+                    if (count > 2)
+                    {
+                        sum2 = ellcol_add_column_avx2(sum2, active, values, indices, x_col + 2 * x->rows);
+                    }
+                    if (count > 3)
+                    {
+                        sum3 = ellcol_add_column_avx2(sum3, active, values, indices, x_col + 3 * x->rows);
+                    }
+                }
+                else
+                {
+                    __m256i offsets_low = _mm256_mul_epu32(_mm256_cvtepu32_epi64(_mm256_castsi256_si128(indices)), rhs_factor);
+                    __m256i offsets_high = _mm256_mul_epu32(_mm256_cvtepu32_epi64(_mm256_extracti128_si256(indices, 1)), rhs_factor);
+                    const float *x_col = x->values + col;
+                    sum0 = ellcol_add_row_avx2(sum0, active, values, offsets_low, offsets_high, x_col);
+                    if (count > 1)
+                    {
+                        sum1 = ellcol_add_row_avx2(sum1, active, values, offsets_low, offsets_high, x_col + 1);
+                    }
+                    if (count > 2)
+                    {
+                        sum2 = ellcol_add_row_avx2(sum2, active, values, offsets_low, offsets_high, x_col + 2);
+                    }
+                    if (count > 3)
+                    {
+                        sum3 = ellcol_add_row_avx2(sum3, active, values, offsets_low, offsets_high, x_col + 3);
+                    }
+                }
+            }
+            ellcol_store_column_avx2(sum0, lanes, rows, row, col, by_column, y);
+            if (count > 1)
+            {
+                ellcol_store_column_avx2(sum1, lanes, rows, row, col + 1, by_column, y);
+            }
+            if (count > 2)
+            {
+                ellcol_store_column_avx2(sum2, lanes, rows, row, col + 2, by_column, y);
+            }
+            if (count > 3)
+            {
+                ellcol_store_column_avx2(sum3, lanes, rows, row, col + 3, by_column, y);
+            }
+        }
+    }
+}
@@ -0,0 +1,321 @@
+#include <stdint.h>
+#include "immintrin.h" // for simd
+#include "optimizations.h"
+
+/*
+ * AVX-512 variant of the row-scaling kernel, this file is built with -mavx512f -mavx512cd -mfma -ffp-contract=off
+ * 8 entries per iteration: gather, fma and scatter of all lanes. The kernels only get the valid entries of a row,
+ * every lane is added (explicit zeros and NaN values too, like the scalar kernel). _mm512_conflict_epi64 flags
+ * lanes whose index already occurs in an earlier lane. The loaders reject rows with repeated indices, if they
+ * collide anyway the 8 entries are added one by one instead.
+ */
+void scalar_multiplication_avx512(float a_val, const float *b_row_vector, const uint64_t *b_row_indices, float *result_row_vector, uint64_t b_ellpack_cols)
+{
+    const __m256 a = _mm256_set1_ps(a_val);
+    uint64_t i = 0;
+    for (; i + 8 <= b_ellpack_cols; i += 8)
+    {
+        __m256 b = _mm256_loadu_ps(&b_row_vector[i]);
+        __m512i index = _mm512_loadu_si512((const void *)&b_row_indices[i]);
+
+        // bit j of lane k is set if index[k] == index[j] for j < k
+        __m512i conflicts = _mm512_conflict_epi64(index);
+        if (_mm512_test_epi64_mask(conflicts, conflicts) != 0)
+        {
+            for (uint64_t k = i; k < i + 8; k++)
+            {
+                result_row_vector[b_row_indices[k]] += b_row_vector[k] * a_val;
+            }
+            continue;
+        }
+
+        __m256 sum = _mm512_i64gather_ps(index, result_row_vector, 4);
+        sum = SIMD_MULTIPLY_ADD_256(a, b, sum);
+        _mm512_i64scatter_ps(result_row_vector, index, sum, 4);
+    }
+    for (; i < b_ellpack_cols; i++) // iterate through the last values (max 7 are left)
+    {
+        result_row_vector[b_row_indices[i]] += b_row_vector[i] * a_val;
+    }
+}
+
+/*
+ * AVX-512 variant for 32-bit indices: the same gather, fma and scatter, but 16 entries per iteration
+ * (the gathers take signed 32-bit lanes, compact_ellpack_indices only narrows matrices with at most 2^31 columns)
+ */
+void scalar_multiplication_avx512_32(float a_val, const float *b_row_vector, const uint32_t *b_row_indices, float *result_row_vector, uint64_t b_ellpack_cols)
+{
+    const __m512 a = _mm512_set1_ps(a_val);
+    uint64_t i = 0;
+    for (; i + 16 <= b_ellpack_cols; i += 16)
+    {
+        __m512 b = _mm512_loadu_ps(&b_row_vector[i]);
+        __m512i index = _mm512_loadu_si512((const void *)&b_row_indices[i]);
+
+        __m512i conflicts = _mm512_conflict_epi32(index);
+        if (_mm512_test_epi32_mask(conflicts, conflicts) != 0)
+        {
+            for (uint64_t k = i; k < i + 16; k++)
+            {
+                result_row_vector[b_row_indices[k]] += b_row_vector[k] * a_val;
+            }
+            continue;
+        }
+
+        __m512 sum = _mm512_i32gather_ps(index, result_row_vector, 4);
+        sum = SIMD_MULTIPLY_ADD_512(a, b, sum);
+        _mm512_i32scatter_ps(result_row_vector, index, sum, 4);
+    }
+    for (; i < b_ellpack_cols; i++) // iterate through the last values (max 15 are left)
+    {
+        result_row_vector[b_row_indices[i]] += b_row_vector[i] * a_val;
+    }
+}
+
+/*
+ * AVX-512 variant for 16-bit delta indices: one iteration is one block of INDEX_DELTA_BLOCK (16) entries,
+ * its deltas are widened to 32-bit lanes and address the result row from the block's base column
+ */
+void scalar_multiplication_avx512_16(float a_val, const float *b_row_vector, const uint32_t *b_block_bases, const uint16_t *b_row_deltas, float *result_row_vector, uint64_t b_ellpack_cols)
+{
+    const __m512 a = _mm512_set1_ps(a_val);
+    uint64_t i = 0;
+    for (; i + 16 <= b_ellpack_cols; i += 16)
+    {
+        __m512 b = _mm512_loadu_ps(&b_row_vector[i]);
+        float *block_result = result_row_vector + b_block_bases[i / INDEX_DELTA_BLOCK];
+        __m512i index = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i *)&b_row_deltas[i]));
+
+        __m512i conflicts = _mm512_conflict_epi32(index);
+        if (_mm512_test_epi32_mask(conflicts, conflicts) != 0)
+        {
+            for (uint64_t k = i; k < i + 16; k++)
+            {
+                block_result[b_row_deltas[k]] += b_row_vector[k] * a_val;
+            }
+            continue;
+        }
+
+        __m512 sum = _mm512_i32gather_ps(index, block_result, 4);
+        sum = SIMD_MULTIPLY_ADD_512(a, b, sum);
+        _mm512_i32scatter_ps(block_result, index, sum, 4);
+    }
+    for (; i < b_ellpack_cols; i++) // iterate through the last values (max 15 are left)
+    {
+        result_row_vector[b_block_bases[i / INDEX_DELTA_BLOCK] + b_row_deltas[i]] += b_row_vector[i] * a_val;
+    }
+}
+
+/*
+ * AVX-512 variant of the sparse x dense kernel, this file is built with -mavx512f -mavx512cd -mfma -ffp-contract=off
+ * The right-hand sides share every entry of the A row: a row-major x row is loaded contiguously into 4 registers
+ * (64 right-hand sides per entry), a column-major x is gathered for 16 right-hand sides at once from the index plus
+ * 16 column offsets. Every lane adds its products in entry order, like the scalar kernel.
+ * A single right-hand side (SpMV) has nothing to put in the lanes but the entries of a row, whose sum then has to be
+ * added lane by lane anyway; it runs the scalar kernel (one lane per row with gathered entries measured slower).
+ */
+void dense_product_avx512(const EllpackMatrix *a_matrix, uint64_t start, uint64_t end, const DenseMatrix *x, DenseMatrix *y)
+{
+    uint64_t rhs = x->cols;
+    if (rhs == 1)
+    {
+        dense_product_scalar(a_matrix, start, end, x, y);
+        return;
+    }
+
+    const long long x_rows = (long long)x->rows;
+    const long long y_rows = (long long)y->rows;
+    const __m512i x_columns = _mm512_set_epi64(7 * x_rows, 6 * x_rows, 5 * x_rows, 4 * x_rows, 3 * x_rows, 2 * x_rows, x_rows, 0);
+    const __m512i y_columns = _mm512_set_epi64(7 * y_rows, 6 * y_rows, 5 * y_rows, 4 * y_rows, 3 * y_rows, 2 * y_rows, y_rows, 0);
+    for (uint64_t row = start; row < end; row++)
+    {
+        const float *row_values = ellpack_row_values(a_matrix, row);
+        const uint64_t *row_indices = ellpack_row_indices(a_matrix, row);
+        uint64_t length = ellpack_row_length(a_matrix, row);
+        if (y->layout == DENSE_ROW_MAJOR)
+        {
+            float *y_row = y->values + row * rhs;
+            uint64_t col = 0;
+            for (; col + 64 <= rhs; col += 64)
+            {
+                __m512 sum0 = _mm512_setzero_ps(), sum1 = _mm512_setzero_ps();
+                __m512 sum2 = _mm512_setzero_ps(), sum3 = _mm512_setzero_ps();
+                for (uint64_t j = 0; j < length; j++)
+                {
+                    const __m512 a = _mm512_set1_ps(row_values[j]);
+                    const float *x_row = x->values + row_indices[j] * rhs + col;
+                    sum0 = SIMD_MULTIPLY_ADD_512(a, _mm512_loadu_ps(x_row), sum0);
+                    sum1 = SIMD_MULTIPLY_ADD_512(a, _mm512_loadu_ps(x_row + 16), sum1);
+                    sum2 = SIMD_MULTIPLY_ADD_512(a, _mm512_loadu_ps(x_row + 32), sum2);
+                    sum3 = SIMD_MULTIPLY_ADD_512(a, _mm512_loadu_ps(x_row + 48), sum3);
+                }
+                _mm512_storeu_ps(y_row + col, sum0);
+                _mm512_storeu_ps(y_row + col + 16, sum1);
+                _mm512_storeu_ps(y_row + col + 32, sum2);
+                _mm512_storeu_ps(y_row + col + 48, sum3);
+            }
+            for (; col < rhs; col += 16) // the last (max 63) right-hand sides, 16 per pass
+            {
+                __mmask16 lanes = rhs - col >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1U << (rhs - col)) - 1);
+                __m512 sum = _mm512_setzero_ps();
+                for (uint64_t j = 0; j < length; j++)
+                {
+                    const float *x_row = x->values + row_indices[j] * rhs + col;
+                    sum = SIMD_MULTIPLY_ADD_512(_mm512_set1_ps(row_values[j]), _mm512_maskz_loadu_ps(lanes, x_row), sum);
+                }
+                _mm512_mask_storeu_ps(y_row + col, lanes, sum);
+            }
+        }
+        else
+        {
+            for (uint64_t col = 0; col < rhs; col += 16)
+            {
+                __mmask8 low = rhs - col >= 8 ? (__mmask8)0xFF : (__mmask8)((1U << (rhs - col)) - 1);
+                __mmask8 high = rhs - col >= 16 ? (__mmask8)0xFF : rhs - col > 8 ? (__mmask8)((1U << (rhs - col - 8)) - 1) : 0;
+                __m512i x_low = _mm512_add_epi64(x_columns, _mm512_set1_epi64((long long)col * x_rows));
+                __m512i x_high = _mm512_add_epi64(x_low, _mm512_set1_epi64(8 * x_rows));
+                __m256 sum_low = _mm256_setzero_ps();
+                __m256 sum_high = _mm256_setzero_ps();
+                for (uint64_t j = 0; j < length; j++)
+                {
+                    const __m256 a = _mm256_set1_ps(row_values[j]);
+                    const __m512i index = _mm512_set1_epi64((long long)row_indices[j]);
+                    __m256 xs_low = _mm512_mask_i64gather_ps(_mm256_setzero_ps(), low, _mm512_add_epi64(x_low, index), x->values, 4);
+                    __m256 xs_high = _mm512_mask_i64gather_ps(_mm256_setzero_ps(), high, _mm512_add_epi64(x_high, index), x->values, 4);
+                    sum_low = SIMD_MULTIPLY_ADD_256(a, xs_low, sum_low);
+                    sum_high = SIMD_MULTIPLY_ADD_256(a, xs_high, sum_high);
+                }
+                __m512i y_low = _mm512_add_epi64(y_columns, _mm512_set1_epi64((long long)row + (long long)col * y_rows));
+                _mm512_mask_i64scatter_ps(y->values, low, y_low, sum_low, 4);
+                _mm512_mask_i64scatter_ps(y->values, high, _mm512_add_epi64(y_low, _mm512_set1_epi64(8 * y_rows)), sum_high, 4);
+            }
+        }
+    }
+}
+
+/*
+ * Add slot values * x_col[indices] to the active lanes of sum, the other lanes are left unchanged
+ */
+static inline __m512 ellcol_add_column_avx512(__m512 sum, __mmask16 active, __m512 values, __m512i indices, const float *x_col)
+{
+    __m512 xs = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), active, indices, x_col, 4);
+    return _mm512_mask_blend_ps(active, sum, SIMD_MULTIPLY_ADD_512(values, xs, sum));
+}
+
+/*
+ * The same for a row-major x, the 64-bit offsets (index * right-hand sides) of lanes 0-7 and 8-15 from x_col
+ */
+static inline __m512 ellcol_add_row_avx512(__m512 sum, __mmask16 active, __m512 values, __m512i offsets_low, __m512i offsets_high, const float *x_col)
+{
+    __m256 xs_low = _mm512_mask_i64gather_ps(_mm256_setzero_ps(), (__mmask8)active, offsets_low, x_col, 4);
+    __m256 xs_high = _mm512_mask_i64gather_ps(_mm256_setzero_ps(), (__mmask8)(active >> 8), offsets_high, x_col, 4);
+    __m512 xs = _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(xs_low)), _mm256_castps_pd(xs_high), 1));
+    return _mm512_mask_blend_ps(active, sum, SIMD_MULTIPLY_ADD_512(values, xs, sum));
+}
+
+/*
+ * Store the lanes of sum to column col of y: one masked store into a column-major y, a scatter into a row-major one
+ */
+static inline void ellcol_store_column_avx512(__m512 sum, __mmask16 lanes, uint64_t row, uint64_t col, int by_column, __m512i y_low, __m512i y_high, DenseMatrix *y)
+{
+    if (by_column)
+    {
+        _mm512_mask_storeu_ps(y->values + col * y->rows + row, lanes, sum);
+        return;
+    }
+    __m256 sum_high = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(sum), 1));
+    _mm512_mask_i64scatter_ps(y->values + col, (__mmask8)lanes, y_low, _mm512_castps512_ps256(sum), 4);
+    _mm512_mask_i64scatter_ps(y->values + col, (__mmask8)(lanes >> 8), y_high, sum_high, 4);
+}
+
+/*
+ * AVX-512 variant of the column-major sparse x dense kernel: one lane per row of a block, the values and indices
+ * of a slot are two aligned loads. A column-major x (or a single vector) is gathered with the 32-bit indices and
+ * a y column written with one store; a row-major x is gathered through 64-bit offsets (index * right-hand sides)
+ * and y scattered. Up to 4 right-hand sides share every loaded slot. Lanes past the end of their row neither
+ * gather nor add, so every lane adds its products in entry order like the scalar kernel.
+ */
+void ellcol_dense_product_avx512(const EllColMatrix *a_matrix, uint64_t start, uint64_t end, const DenseMatrix *x, DenseMatrix *y)
+{
+    uint64_t rhs = x->cols;
+    if (rhs > UINT32_MAX) // the offsets are multiplied with 32-bit factors
+    {
+        ellcol_dense_product_scalar(a_matrix, start, end, x, y);
+        return;
+    }
+
+    const int by_column = x->layout == DENSE_COL_MAJOR || rhs == 1;
+    const uint64_t padded_rows = a_matrix->padded_rows;
+    const __m512i rhs_factor = _mm512_set1_epi64((long long)rhs);
+    for (uint64_t row = start; row < end; row += ELLCOL_BLOCK_ROWS)
+    {
+        uint64_t width = a_matrix->block_widths[row / ELLCOL_BLOCK_ROWS];
+        __mmask16 lanes = end - row >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1U << (end - row)) - 1);
+        const __m512i lengths = _mm512_load_si512(a_matrix->row_lengths + row);
+        const long long y_row = (long long)(row * rhs), step = (long long)rhs;
+        const __m512i y_low = _mm512_set_epi64(y_row + 7 * step, y_row + 6 * step, y_row + 5 * step, y_row + 4 * step,
+                                               y_row + 3 * step, y_row + 2 * step, y_row + step, y_row);
+        const __m512i y_high = _mm512_add_epi64(y_low, _mm512_set1_epi64(8 * step));
+        for (uint64_t col = 0; col < rhs; col += 4)
+        {
+            uint64_t count = rhs - col < 4 ? rhs - col : 4;
+            __m512 sum0 = _mm512_setzero_ps(), sum1 = _mm512_setzero_ps();
+            __m512 sum2 = _mm512_setzero_ps(), sum3 = _mm512_setzero_ps();
+            for (uint64_t slot = 0; slot < width; slot++)
+            {
+                const __mmask16 active = _mm512_cmpgt_epu32_mask(lengths, _mm512_set1_epi32((int)slot));
+                const __m512 values = _mm512_load_ps(a_matrix->values + slot * padded_rows + row);
+                const __m512i indices = _mm512_load_si512(a_matrix->indices + slot * padded_rows + row);
+                if (by_column)
+                {
+                    const float *x_col = x->values + col * x->rows;
+                    sum0 = ellcol_add_column_avx512(sum0, active, values, indices, x_col);
+                    if (count > 1)
+                    {
+                        sum1 = ellcol_add_column_avx512(sum1, active, values, indices, x_col + x->rows);
+                    }
+                    if (count > 2)
+                    {
+                        sum2 = ellcol_add_column_avx512(sum2, active, values, indices, x_col + 2 * x->rows);
+                    }
+                    if (count > 3)
+                    {
+                        sum3 = ellcol_add_column_avx512(sum3, active, values, indices, x_col + 3 * x->rows);
+                    }
+                }
+                else
+                {
+                    __m512i offsets_low = _mm512_mul_epu32(_mm512_cvtepu32_epi64(_mm512_castsi512_si256(indices)), rhs_factor);
+                    __m512i offsets_high = _mm512_mul_epu32(_mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(indices, 1)), rhs_factor);
+                    const float *x_col = x->values + col;
+                    sum0 = ellcol_add_row_avx512(sum0, active, values, offsets_low, offsets_high, x_col);
+                    if (count > 1)
+                    {
+                        sum1 = ellcol_add_row_avx512(sum1, active, values, offsets_low, offsets_high, x_col + 1);
+                    }
+                    if (count > 2)
+                    {
+                        sum2 = ellcol_add_row_avx512(sum2, active, values, offsets_low, offsets_high, x_col + 2);
+                    }
+                    if (count > 3)
+                    {
+                        sum3 = ellcol_add_row_avx512(sum3, active, values, offsets_low, offsets_high, x_col + 3);
+                    }
+                }
+            }
+            ellcol_store_column_avx512(sum0, lanes, row, col, by_column, y_low, y_high, y);
+            if (count > 1)
+            {
+                ellcol_store_column_avx512(sum1, lanes, row, col + 1, by_column, y_low, y_high, y);
+            }
+            if (count > 2)
+            {
+                ellcol_store_column_avx512(sum2, lanes, row, col + 2, by_column, y_low, y_high, y);
+            }
+            if (count > 3)
+            {
+                ellcol_store_column_avx512(sum3, lanes, row, col + 3, by_column, y_low, y_high, y);
+            }
+        }
+    }
+}
@@ -0,0 +1,644 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reorder.h"
+
+#define MIN_HASH_SEED_1 0x9E3779B97F4A7C15ULL
+#define MIN_HASH_SEED_2 0xC2B2AE3D27D4EB4FULL
+
+static const char *reorder_method_names[] = {"none", "rcm", "cluster"};
+
+// Transpose struct, the rows of a matrix that have an entry in every column (CSR of the transposed pattern)
+typedef struct
+{
+    uint64_t *offsets; // cols + 1 entries
+    uint64_t *rows;
+} Transpose;
+
+// RowSignature struct, sort key of an A row for REORDER_CLUSTER
+typedef struct
+{
+    uint64_t hash1;
+    uint64_t hash2;
+    uint64_t row;
+} RowSignature;
+
+// Neighbor struct, a vertex of the Cuthill-McKee BFS with its degree
+typedef struct
+{
+    uint64_t degree;
+    uint64_t vertex;
+} Neighbor;
+
+/*
+ * Parse "none", "rcm" or "cluster"
+ */
+char parse_reorder_method(const char *name, ReorderMethod *method)
+{
+    for (ReorderMethod m = REORDER_NONE; m <= REORDER_CLUSTER; m++)
+    {
+        if (strcmp(name, reorder_method_names[m]) == 0)
+        {
+            *method = m;
+            return 'S';
+        }
+    }
+    fprintf(stderr, "Error: Invalid reordering \"%s\".\n", name);
+    return 'F';
+}
+
+const char *reorder_method_name(ReorderMethod method)
+{
+    return reorder_method_names[method];
+}
+
+void free_reordering(Reordering *reordering)
+{
+    if (reordering != NULL)
+    {
+        free(reordering->row_order);
+        free(reordering->middle_order);
+        free(reordering->middle_position);
+        free(reordering->col_order);
+        free(reordering->col_position);
+        free(reordering);
+    }
+}
+
+static Reordering *allocate_reordering(uint64_t a_rows, uint64_t middle, uint64_t b_cols)
+{
+    Reordering *reordering = (Reordering *)calloc(1, sizeof(Reordering));
+    if (reordering == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "reordering");
+        return NULL;
+    }
+    reordering->a_rows = a_rows;
+    reordering->middle = middle;
+    reordering->b_cols = b_cols;
+    reordering->row_order = (uint64_t *)malloc(a_rows * sizeof(uint64_t));
+    reordering->middle_order = (uint64_t *)malloc(middle * sizeof(uint64_t));
+    reordering->middle_position = (uint64_t *)malloc(middle * sizeof(uint64_t));
+    reordering->col_order = (uint64_t *)malloc(b_cols * sizeof(uint64_t));
+    reordering->col_position = (uint64_t *)malloc(b_cols * sizeof(uint64_t));
+    if (reordering->row_order == NULL || reordering->middle_order == NULL || reordering->middle_position == NULL ||
+        reordering->col_order == NULL || reordering->col_position == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "reordering");
+        free_reordering(reordering);
+        return NULL;
+    }
+    return reordering;
+}
+
+/*
+ * Fill the positions from the orders
+ */
+static void invert_orders(Reordering *reordering)
+{
+    for (uint64_t i = 0; i < reordering->middle; i++)
+    {
+        reordering->middle_position[reordering->middle_order[i]] = i;
+    }
+    for (uint64_t i = 0; i < reordering->b_cols; i++)
+    {
+        reordering->col_position[reordering->col_order[i]] = i;
+    }
+}
+
+static void free_transpose(Transpose *transpose)
+{
+    free(transpose->offsets);
+    free(transpose->rows);
+}
+
+/*
+ * Transposed pattern of the valid entries of a matrix. Returns 'F' if it does not fit into memory.
+ */
+static char transpose_pattern(const EllpackMatrix *matrix, Transpose *transpose)
+{
+    transpose->offsets = (uint64_t *)calloc(matrix->cols + 1, sizeof(uint64_t));
+    uint64_t entries = 0;
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        entries += ellpack_row_length(matrix, row);
+    }
+    transpose->rows = (uint64_t *)malloc((entries > 0 ? entries : 1) * sizeof(uint64_t));
+    if (transpose->offsets == NULL || transpose->rows == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "transposed pattern");
+        free_transpose(transpose);
+        return 'F';
+    }
+
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        const uint64_t *row_indices = ellpack_row_indices(matrix, row);
+        for (uint64_t j = 0; j < ellpack_row_length(matrix, row); j++)
+        {
+            transpose->offsets[row_indices[j] + 1]++;
+        }
+    }
+    for (uint64_t col = 0; col < matrix->cols; col++)
+    {
+        transpose->offsets[col + 1] += transpose->offsets[col];
+    }
+    // offsets[col] is the fill position of col while filling, shifted back afterwards
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        const uint64_t *row_indices = ellpack_row_indices(matrix, row);
+        for (uint64_t j = 0; j < ellpack_row_length(matrix, row); j++)
+        {
+            transpose->rows[transpose->offsets[row_indices[j]]++] = row;
+        }
+    }
+    for (uint64_t col = matrix->cols; col > 0; col--)
+    {
+        transpose->offsets[col] = transpose->offsets[col - 1];
+    }
+    transpose->offsets[0] = 0;
+    return 'S';
+}
+
+static int compare_neighbors(const void *lhs, const void *rhs)
+{
+    const Neighbor *l = (const Neighbor *)lhs;
+    const Neighbor *r = (const Neighbor *)rhs;
+    if (l->degree != r->degree)
+    {
+        return (l->degree > r->degree) - (l->degree < r->degree);
+    }
+    return (l->vertex > r->vertex) - (l->vertex < r->vertex);
+}
+
+// RcmGraph struct, the A rows [0, n), the A columns / B rows [n, n + k) and the B columns [n + k, n + k + m)
+// as one graph, its edges are the entries of A and B
+typedef struct
+{
+    const EllpackMatrix *a;
+    const EllpackMatrix *b;
+    Transpose a_transpose;
+    Transpose b_transpose;
+    uint64_t vertices;
+} RcmGraph;
+
+static uint64_t rcm_degree(const RcmGraph *graph, uint64_t vertex)
+{
+    uint64_t n = graph->a->rows;
+    uint64_t k = graph->b->rows;
+    if (vertex < n)
+    {
+        return ellpack_row_length(graph->a, vertex);
+    }
+    if (vertex < n + k)
+    {
+        uint64_t middle = vertex - n;
+        return graph->a_transpose.offsets[middle + 1] - graph->a_transpose.offsets[middle] + ellpack_row_length(graph->b, middle);
+    }
+    uint64_t col = vertex - n - k;
+    return graph->b_transpose.offsets[col + 1] - graph->b_transpose.offsets[col];
+}
+
+/*
+ * Append the unvisited neighbors of vertex to the queue, lowest degree first, and mark them visited
+ */
+static uint64_t rcm_visit(const RcmGraph *graph, uint64_t vertex, char *visited, uint64_t *queue, uint64_t queue_end, Neighbor *buffer)
+{
+    uint64_t n = graph->a->rows;
+    uint64_t k = graph->b->rows;
+    uint64_t count = 0;
+    if (vertex < n)
+    {
+        const uint64_t *row_indices = ellpack_row_indices(graph->a, vertex);
+        for (uint64_t j = 0; j < ellpack_row_length(graph->a, vertex); j++)
+        {
+            uint64_t neighbor = n + row_indices[j];
+            if (!visited[neighbor])
+            {
+                visited[neighbor] = 1;
+                buffer[count++].vertex = neighbor;
+            }
+        }
+    }
+    else if (vertex < n + k)
+    {
+        uint64_t middle = vertex - n;
+        for (uint64_t j = graph->a_transpose.offsets[middle]; j < graph->a_transpose.offsets[middle + 1]; j++)
+        {
+            uint64_t neighbor = graph->a_transpose.rows[j];
+            if (!visited[neighbor])
+            {
+                visited[neighbor] = 1;
+                buffer[count++].vertex = neighbor;
+            }
+        }
+        const uint64_t *row_indices = ellpack_row_indices(graph->b, middle);
+        for (uint64_t j = 0; j < ellpack_row_length(graph->b, middle); j++)
+        {
+            uint64_t neighbor = n + k + row_indices[j];
+            if (!visited[neighbor])
+            {
+                visited[neighbor] = 1;
+                buffer[count++].vertex = neighbor;
+            }
+        }
+    }
+    else
+    {
+        uint64_t col = vertex - n - k;
+        for (uint64_t j = graph->b_transpose.offsets[col]; j < graph->b_transpose.offsets[col + 1]; j++)
+        {
+            uint64_t neighbor = n + graph->b_transpose.rows[j];
+            if (!visited[neighbor])
+            {
+                visited[neighbor] = 1;
+                buffer[count++].vertex = neighbor;
+            }
+        }
+    }
+
+    for (uint64_t i = 0; i < count; i++)
+    {
+        buffer[i].degree = rcm_degree(graph, buffer[i].vertex);
+    }
+    qsort(buffer, count, sizeof(Neighbor), compare_neighbors);
+    for (uint64_t i = 0; i < count; i++)
+    {
+        queue[queue_end++] = buffer[i].vertex;
+    }
+    return queue_end;
+}
+
+/*
+ * Reverse Cuthill-McKee: a BFS from a vertex of lowest degree per connected component, the neighbors of every
+ * vertex are queued by increasing degree, and the visit order reversed. The orders of A rows, B rows and B columns
+ * are the vertices of each kind in that order.
+ */
+static Reordering *rcm_reordering(const EllpackMatrix *a, const EllpackMatrix *b)
+{
+    RcmGraph graph;
+    graph.a = a;
+    graph.b = b;
+    graph.vertices = a->rows + b->rows + b->cols;
+    if (transpose_pattern(a, &graph.a_transpose) != 'S')
+    {
+        return NULL;
+    }
+    if (transpose_pattern(b, &graph.b_transpose) != 'S')
+    {
+        free_transpose(&graph.a_transpose);
+        return NULL;
+    }
+
+    // vertices by increasing degree (counting sort), the start vertices of the components are taken from there
+    uint64_t max_degree = 0;
+    for (uint64_t vertex = 0; vertex < graph.vertices; vertex++)
+    {
+        uint64_t degree = rcm_degree(&graph, vertex);
+        max_degree = degree > max_degree ? degree : max_degree;
+    }
+    uint64_t *degree_counts = (uint64_t *)calloc(max_degree + 2, sizeof(uint64_t));
+    uint64_t *by_degree = (uint64_t *)malloc(graph.vertices * sizeof(uint64_t));
+    uint64_t *queue = (uint64_t *)malloc(graph.vertices * sizeof(uint64_t));
+    char *visited = (char *)calloc(graph.vertices, sizeof(char));
+    Neighbor *buffer = (Neighbor *)malloc((max_degree + 1) * sizeof(Neighbor));
+    Reordering *reordering = NULL;
+    if (degree_counts == NULL || by_degree == NULL || queue == NULL || visited == NULL || buffer == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "RCM reordering");
+    }
+    else
+    {
+        for (uint64_t vertex = 0; vertex < graph.vertices; vertex++)
+        {
+            degree_counts[rcm_degree(&graph, vertex) + 1]++;
+        }
+        for (uint64_t degree = 0; degree <= max_degree; degree++)
+        {
+            degree_counts[degree + 1] += degree_counts[degree];
+        }
+        for (uint64_t vertex = 0; vertex < graph.vertices; vertex++)
+        {
+            by_degree[degree_counts[rcm_degree(&graph, vertex)]++] = vertex;
+        }
+
+        uint64_t queue_end = 0;
+        for (uint64_t i = 0; i < graph.vertices; i++)
+        {
+            if (visited[by_degree[i]])
+            {
+                continue;
+            }
+            uint64_t queue_start = queue_end;
+            visited[by_degree[i]] = 1;
+            queue[queue_end++] = by_degree[i];
+            for (; queue_start < queue_end; queue_start++)
+            {
+                queue_end = rcm_visit(&graph, queue[queue_start], visited, queue, queue_end, buffer);
+            }
+        }
+
+        reordering = allocate_reordering(a->rows, b->rows, b->cols);
+        if (reordering != NULL)
+        {
+            uint64_t rows = 0, middle = 0, cols = 0;
+            for (uint64_t i = graph.vertices; i > 0; i--)
+            {
+                uint64_t vertex = queue[i - 1];
+                if (vertex < a->rows)
+                {
+                    reordering->row_order[rows++] = vertex;
+                }
+                else if (vertex < a->rows + b->rows)
+                {
+                    reordering->middle_order[middle++] = vertex - a->rows;
+                }
+                else
+                {
+                    reordering->col_order[cols++] = vertex - a->rows - b->rows;
+                }
+            }
+            invert_orders(reordering);
+        }
+    }
+
+    free(degree_counts);
+    free(by_degree);
+    free(queue);
+    free(visited);
+    free(buffer);
+    free_transpose(&graph.a_transpose);
+    free_transpose(&graph.b_transpose);
+    return reordering;
+}
+
+static inline uint64_t mix_hash(uint64_t value)
+{
+    // splitmix64 finalizer
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+    return value ^ (value >> 31);
+}
+
+static int compare_signatures(const void *lhs, const void *rhs)
+{
+    const RowSignature *l = (const RowSignature *)lhs;
+    const RowSignature *r = (const RowSignature *)rhs;
+    if (l->hash1 != r->hash1)
+    {
+        return (l->hash1 > r->hash1) - (l->hash1 < r->hash1);
+    }
+    if (l->hash2 != r->hash2)
+    {
+        return (l->hash2 > r->hash2) - (l->hash2 < r->hash2);
+    }
+    return (l->row > r->row) - (l->row < r->row);
+}
+
+/*
+ * Similarity clustering: two min-hashes of the columns of every A row estimate how many columns two rows share
+ * (rows with the same minimum share its column), sorting the rows by them puts rows that read the same B rows
+ * next to each other. The B rows are then numbered in the order the sorted A rows first read them, the B columns
+ * in the order those B rows first write them; rows and columns nobody uses keep their order at the end.
+ */
+static Reordering *cluster_reordering(const EllpackMatrix *a, const EllpackMatrix *b)
+{
+    Reordering *reordering = allocate_reordering(a->rows, b->rows, b->cols);
+    RowSignature *signatures = (RowSignature *)malloc((a->rows > 0 ? a->rows : 1) * sizeof(RowSignature));
+    char *used = (char *)calloc((b->rows > b->cols ? b->rows : b->cols) + 1, sizeof(char));
+    if (reordering == NULL || signatures == NULL || used == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "cluster reordering");
+        free_reordering(reordering);
+        free(signatures);
+        free(used);
+        return NULL;
+    }
+
+    for (uint64_t row = 0; row < a->rows; row++)
+    {
+        const uint64_t *row_indices = ellpack_row_indices(a, row);
+        signatures[row].hash1 = UINT64_MAX;
+        signatures[row].hash2 = UINT64_MAX;
+        signatures[row].row = row;
+        for (uint64_t j = 0; j < ellpack_row_length(a, row); j++)
+        {
+            uint64_t hash1 = mix_hash(row_indices[j] ^ MIN_HASH_SEED_1);
+            uint64_t hash2 = mix_hash(row_indices[j] ^ MIN_HASH_SEED_2);
+            signatures[row].hash1 = hash1 < signatures[row].hash1 ? hash1 : signatures[row].hash1;
+            signatures[row].hash2 = hash2 < signatures[row].hash2 ? hash2 : signatures[row].hash2;
+        }
+    }
+    qsort(signatures, a->rows, sizeof(RowSignature), compare_signatures);
+
+    uint64_t middle = 0;
+    for (uint64_t i = 0; i < a->rows; i++)
+    {
+        uint64_t row = signatures[i].row;
+        const uint64_t *row_indices = ellpack_row_indices(a, row);
+        reordering->row_order[i] = row;
+        for (uint64_t j = 0; j < ellpack_row_length(a, row); j++)
+        {
+            if (!used[row_indices[j]])
+            {
+                used[row_indices[j]] = 1;
+                reordering->middle_order[middle++] = row_indices[j];
+            }
+        }
+    }
+    for (uint64_t row = 0; row < b->rows; row++)
+    {
+        if (!used[row])
+        {
+            reordering->middle_order[middle++] = row;
+        }
+    }
+
+    memset(used, 0, b->cols);
+    uint64_t cols = 0;
+    for (uint64_t i = 0; i < b->rows; i++)
+    {
+        uint64_t row = reordering->middle_order[i];
+        const uint64_t *row_indices = ellpack_row_indices(b, row);
+        for (uint64_t j = 0; j < ellpack_row_length(b, row); j++)
+        {
+            if (!used[row_indices[j]])
+            {
+                used[row_indices[j]] = 1;
+                reordering->col_order[cols++] = row_indices[j];
+            }
+        }
+    }
+    for (uint64_t col = 0; col < b->cols; col++)
+    {
+        if (!used[col])
+        {
+            reordering->col_order[cols++] = col;
+        }
+    }
+
+    free(signatures);
+    free(used);
+    invert_orders(reordering);
+    return reordering;
+}
+
+/*
+ * Permutations of A * B for the method, both matrices with 64-bit indices (before compact_ellpack_indices).
+ * Returns NULL if the dimensions do not match or the permutations do not fit into memory.
+ */
+Reordering *compute_reordering(const EllpackMatrix *a, const EllpackMatrix *b, ReorderMethod method)
+{
+    if (a->cols != b->rows)
+    {
+        fprintf(stderr, ERR_INVALID_MATRIX_DIMENSIONS, a->cols, b->rows);
+        return NULL;
+    }
+    return method == REORDER_RCM ? rcm_reordering(a, b) : cluster_reordering(a, b);
+}
+
+/*
+ * Copy of matrix with row i taken from row row_order[i] and every index renumbered by index_position,
+ * the entries of a row keep their order. Returns NULL if it does not fit into memory.
+ */
+static EllpackMatrix *permute_matrix(const EllpackMatrix *matrix, const uint64_t *row_order, const uint64_t *index_position)
+{
+    EllpackMatrix *permuted = allocate_ellpack_matrix(matrix->rows, matrix->cols, matrix->ellpack_cols);
+    if (permuted == NULL)
+    {
+        return NULL;
+    }
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        uint64_t source = row_order[row];
+        uint64_t length = ellpack_row_length(matrix, source);
+        const uint64_t *source_indices = ellpack_row_indices(matrix, source);
+        uint64_t *row_indices = ellpack_row_indices(permuted, row);
+        memcpy(ellpack_row_values(permuted, row), ellpack_row_values(matrix, source), length * sizeof(float));
+        for (uint64_t j = 0; j < length; j++)
+        {
+            row_indices[j] = index_position[source_indices[j]];
+        }
+        permuted->row_lengths[row] = length;
+    }
+    return permuted;
+}
+
+/*
+ * Replace *a and *b by their renumbered copies, the originals are freed.
+ * Returns 'F' (and leaves both untouched) if the copies do not fit into memory.
+ */
+char apply_reordering(const Reordering *reordering, EllpackMatrix **a, EllpackMatrix **b)
+{
+    EllpackMatrix *permuted_a = permute_matrix(*a, reordering->row_order, reordering->middle_position);
+    EllpackMatrix *permuted_b = permuted_a != NULL ? permute_matrix(*b, reordering->middle_order, reordering->col_position) : NULL;
+    if (permuted_b == NULL)
+    {
+        free_ellpack_matrix(permuted_a);
+        return 'F';
+    }
+    free_ellpack_matrix(*a);
+    free_ellpack_matrix(*b);
+    *a = permuted_a;
+    *b = permuted_b;
+    return 'S';
+}
+
+static int compare_entries_by_col(const void *lhs, const void *rhs)
+{
+    uint64_t l = *(const uint64_t *)lhs;
+    uint64_t r = *(const uint64_t *)rhs;
+    return (l > r) - (l < r);
+}
+
+/*
+ * Move the result of the renumbered multiplication back to the original row and column numbers in place (the
+ * padded result can be the largest matrix of the run), the entries of every row are sorted by column again.
+ * Returns 'F' if the buffers do not fit into memory.
+ */
+char restore_result_order(EllpackMatrix *result, const Reordering *reordering)
+{
+    uint64_t stride = result->stride;
+    // (column, value bits) pairs of a row, sorted by column
+    uint64_t *pairs = (uint64_t *)malloc((result->ellpack_cols > 0 ? result->ellpack_cols : 1) * 2 * sizeof(uint64_t));
+    // two row buffers for following the cycles of the row permutation
+    float *value_buffer = (float *)malloc((stride > 0 ? stride : 1) * 2 * sizeof(float));
+    uint64_t *index_buffer = (uint64_t *)malloc((stride > 0 ? stride : 1) * 2 * sizeof(uint64_t));
+    char *placed = (char *)calloc(result->rows + 1, sizeof(char));
+    if (pairs == NULL || value_buffer == NULL || index_buffer == NULL || placed == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "restored result");
+        free(pairs);
+        free(value_buffer);
+        free(index_buffer);
+        free(placed);
+        return 'F';
+    }
+
+    for (uint64_t row = 0; row < result->rows; row++)
+    {
+        uint64_t length = ellpack_row_length(result, row);
+        float *row_values = ellpack_row_values(result, row);
+        uint64_t *row_indices = ellpack_row_indices(result, row);
+        for (uint64_t j = 0; j < length; j++)
+        {
+            uint32_t bits;
+            memcpy(&bits, &row_values[j], sizeof(bits));
+            pairs[2 * j] = reordering->col_order[row_indices[j]];
+            pairs[2 * j + 1] = bits;
+        }
+        qsort(pairs, length, 2 * sizeof(uint64_t), compare_entries_by_col);
+        for (uint64_t j = 0; j < length; j++)
+        {
+            uint32_t bits = (uint32_t)pairs[2 * j + 1];
+            memcpy(&row_values[j], &bits, sizeof(bits));
+            row_indices[j] = pairs[2 * j];
+        }
+    }
+
+    // row `row` goes to row_order[row]: every cycle carries one row along and swaps it with the row at its target
+    float *carry_values = value_buffer;
+    uint64_t *carry_indices = index_buffer;
+    float *spare_values = value_buffer + stride;
+    uint64_t *spare_indices = index_buffer + stride;
+    for (uint64_t start = 0; start < result->rows; start++)
+    {
+        if (placed[start])
+        {
+            continue;
+        }
+        memcpy(carry_values, ellpack_row_values(result, start), stride * sizeof(float));
+        memcpy(carry_indices, ellpack_row_indices(result, start), stride * sizeof(uint64_t));
+        uint64_t carry_length = result->row_lengths[start];
+        uint64_t row = start;
+        do
+        {
+            uint64_t target = reordering->row_order[row];
+            float *target_values = ellpack_row_values(result, target);
+            uint64_t *target_indices = ellpack_row_indices(result, target);
+            memcpy(spare_values, target_values, stride * sizeof(float));
+            memcpy(spare_indices, target_indices, stride * sizeof(uint64_t));
+            uint64_t spare_length = result->row_lengths[target];
+            memcpy(target_values, carry_values, stride * sizeof(float));
+            memcpy(target_indices, carry_indices, stride * sizeof(uint64_t));
+            result->row_lengths[target] = carry_length;
+            placed[row] = 1;
+
+            float *swap_values = carry_values;
+            uint64_t *swap_indices = carry_indices;
+            carry_values = spare_values;
+            carry_indices = spare_indices;
+            spare_values = swap_values;
+            spare_indices = swap_indices;
+            carry_length = spare_length;
+            row = target;
+        } while (row != start);
+    }
+
+    free(pairs);
+    free(value_buffer);
+    free(index_buffer);
+    free(placed);
+    return 'S';
+}
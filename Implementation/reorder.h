@@ -0,0 +1,46 @@
+#ifndef FINAL_REORDER_H
+#define FINAL_REORDER_H
+
+#include <stdint.h>
+#include "utils.h"
+
+// Reordering of the operands before the multiplication
+// Three permutations renumber the rows of A, the columns of A together with the rows of B (so A * B is unchanged)
+// and the columns of B. Rows of A that read the same B rows end up next to each other, and the B rows read together
+// end up next to each other in memory, so a B row is more likely to still be cached when the next A row reads it.
+// The multiplication runs on the renumbered matrices, restore_result_order moves the rows and columns of the result
+// back. The entries of a row keep their order, every result entry sums the same products in the same order.
+
+typedef enum
+{
+    REORDER_NONE,
+    REORDER_RCM,     // reverse Cuthill-McKee over the graph of A rows, A columns / B rows and B columns
+    REORDER_CLUSTER  // A rows grouped by the min-hash signature of their columns, B rows and columns by first use
+} ReorderMethod;
+
+// Reordering struct, every order maps a new number to the old one, every position an old number to the new one
+typedef struct
+{
+    uint64_t a_rows;
+    uint64_t middle;           // A columns == B rows
+    uint64_t b_cols;
+    uint64_t *row_order;       // rows of A (and the result)
+    uint64_t *middle_order;
+    uint64_t *middle_position;
+    uint64_t *col_order;       // columns of B (and the result)
+    uint64_t *col_position;
+} Reordering;
+
+char parse_reorder_method(const char *name, ReorderMethod *method);
+
+const char *reorder_method_name(ReorderMethod method);
+
+Reordering *compute_reordering(const EllpackMatrix *a, const EllpackMatrix *b, ReorderMethod method);
+
+char apply_reordering(const Reordering *reordering, EllpackMatrix **a, EllpackMatrix **b);
+
+char restore_result_order(EllpackMatrix *result, const Reordering *reordering);
+
+void free_reordering(Reordering *reordering);
+
+#endif
@@ -0,0 +1,272 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sell.h"
+#include "optimizations.h"
+#include "accumulator.h"
+#include "thread_pool.h"
+
+#define ERR_INVALID_SELL_SPEC "Error: Invalid SELL shape '%s', expected <C>,<sigma> with C, sigma >= 1\n"
+
+// RowLength struct, sort key of a row inside its sigma window
+typedef struct
+{
+    uint64_t length;
+    uint64_t row;
+} RowLength;
+
+/*
+ * Parse "<C>,<sigma>"
+ */
+char parse_sell_options(const char *spec, uint64_t *chunk_size, uint64_t *sigma)
+{
+    unsigned long long c, s;
+    char trailing;
+    if (sscanf(spec, "%llu,%llu%c", &c, &s, &trailing) != 2 || c == 0 || s == 0)
+    {
+        fprintf(stderr, ERR_INVALID_SELL_SPEC, spec);
+        return 'F';
+    }
+    *chunk_size = c;
+    *sigma = s;
+    return 'S';
+}
+
+/*
+ * Longest row first, equal lengths keep their row order
+ */
+static int compare_row_lengths(const void *lhs, const void *rhs)
+{
+    const RowLength *l = (const RowLength *)lhs;
+    const RowLength *r = (const RowLength *)rhs;
+    if (l->length != r->length)
+    {
+        return l->length < r->length ? 1 : -1;
+    }
+    return (l->row > r->row) - (l->row < r->row);
+}
+
+/*
+ * Helper method to free memory of a SELL matrix
+ */
+void free_sell_matrix(SellMatrix *matrix)
+{
+    if (matrix != NULL)
+    {
+        free(matrix->chunk_offsets);
+        free(matrix->chunk_widths);
+        free(matrix->row_order);
+        free(matrix->row_position);
+        free(matrix->row_lengths);
+        free(matrix->values);
+        free(matrix->indices);
+        free(matrix);
+    }
+}
+
+/*
+ * Convert an ELLPACK matrix to SELL-C-sigma, the rows keep their valid entries
+ */
+SellMatrix *ellpack_to_sell(const EllpackMatrix *matrix, uint64_t chunk_size, uint64_t sigma)
+{
+    SellMatrix *sell = (SellMatrix *)calloc(1, sizeof(SellMatrix));
+    if (sell == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "SELL matrix structure");
+        return NULL;
+    }
+    sell->rows = matrix->rows;
+    sell->cols = matrix->cols;
+    sell->ellpack_cols = matrix->ellpack_cols;
+    sell->chunk_size = chunk_size;
+    sell->sigma = sigma;
+    sell->chunks = (matrix->rows + chunk_size - 1) / chunk_size;
+    sell->chunk_offsets = (uint64_t *)malloc((sell->chunks + 1) * sizeof(uint64_t));
+    sell->chunk_widths = (uint64_t *)malloc(sell->chunks * sizeof(uint64_t));
+    sell->row_order = (uint64_t *)malloc(matrix->rows * sizeof(uint64_t));
+    sell->row_position = (uint64_t *)malloc(matrix->rows * sizeof(uint64_t));
+    sell->row_lengths = (uint64_t *)malloc(matrix->rows * sizeof(uint64_t));
+    RowLength *lengths = (RowLength *)malloc(matrix->rows * sizeof(RowLength));
+    if (sell->chunk_offsets == NULL || sell->chunk_widths == NULL || sell->row_order == NULL || sell->row_position == NULL || sell->row_lengths == NULL || lengths == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "SELL row order");
+        free(lengths);
+        free_sell_matrix(sell);
+        return NULL;
+    }
+
+    // sort every window of sigma rows by length
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        lengths[row].length = ellpack_row_length(matrix, row);
+        lengths[row].row = row;
+        sell->row_lengths[row] = lengths[row].length;
+    }
+    for (uint64_t window = 0; window < matrix->rows; window += sigma)
+    {
+        uint64_t count = matrix->rows - window < sigma ? matrix->rows - window : sigma;
+        qsort(lengths + window, count, sizeof(RowLength), compare_row_lengths);
+    }
+    for (uint64_t position = 0; position < matrix->rows; position++)
+    {
+        sell->row_order[position] = lengths[position].row;
+        sell->row_position[lengths[position].row] = position;
+    }
+
+    // every chunk is as wide as its longest row
+    sell->chunk_offsets[0] = 0;
+    for (uint64_t chunk = 0; chunk < sell->chunks; chunk++)
+    {
+        uint64_t first = chunk * chunk_size;
+        uint64_t last = first + chunk_size < matrix->rows ? first + chunk_size : matrix->rows;
+        uint64_t width = 0;
+        for (uint64_t position = first; position < last; position++)
+        {
+            width = lengths[position].length > width ? lengths[position].length : width;
+        }
+        sell->chunk_widths[chunk] = width;
+        sell->chunk_offsets[chunk + 1] = sell->chunk_offsets[chunk] + (last - first) * width;
+    }
+    free(lengths);
+
+    uint64_t entries = sell->chunk_offsets[sell->chunks];
+    sell->values = (float *)allocate_aligned_slab(entries, sizeof(float));
+    sell->indices = (uint64_t *)allocate_aligned_slab(entries, sizeof(uint64_t));
+    if (sell->values == NULL || sell->indices == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "SELL values/indices array");
+        free_sell_matrix(sell);
+        return NULL;
+    }
+
+    // the slabs are zeroed, only the stored entries are copied
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        uint64_t offset = sell_row_offset(sell, row);
+        uint64_t length = ellpack_row_length(matrix, row);
+        memcpy(sell->values + offset, ellpack_row_values(matrix, row), length * sizeof(float));
+        memcpy(sell->indices + offset, ellpack_row_indices(matrix, row), length * sizeof(uint64_t));
+    }
+    return sell;
+}
+
+/*
+ * Convert a SELL matrix back to ELLPACK with the ellpack_cols of the original matrix
+ */
+EllpackMatrix *sell_to_ellpack(const SellMatrix *matrix)
+{
+    EllpackMatrix *ellpack = allocate_ellpack_matrix(matrix->rows, matrix->cols, matrix->ellpack_cols);
+    if (ellpack == NULL)
+    {
+        return NULL;
+    }
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        uint64_t offset = sell_row_offset(matrix, row);
+        uint64_t width = sell_row_width(matrix, row);
+        memcpy(ellpack_row_values(ellpack, row), matrix->values + offset, width * sizeof(float));
+        memcpy(ellpack_row_indices(ellpack, row), matrix->indices + offset, width * sizeof(uint64_t));
+        ellpack->row_lengths[row] = sell_row_length(matrix, row);
+    }
+    return ellpack;
+}
+
+/*
+ * Load an ELLPACK file (text or binary) as SELL-C-sigma, the padded matrix only lives until it is converted
+ */
+SellMatrix *load_sell_matrix(const char *filename, uint64_t chunk_size, uint64_t sigma)
+{
+    EllpackMatrix *matrix = load_ellpack_matrix(filename);
+    if (matrix == NULL)
+    {
+        return NULL;
+    }
+    SellMatrix *sell = ellpack_to_sell(matrix, chunk_size, sigma);
+    free_ellpack_matrix(matrix);
+    return sell;
+}
+
+/*
+ * Accumulate row a_row of A * B into the accumulator, same products in the same order as accumulate_row_simd
+ */
+static char accumulate_row_sell(const void *a, const void *b, uint64_t a_row, SparseAccumulator *spa)
+{
+    const SellMatrix *a_matrix = (const SellMatrix *)a;
+    const SellMatrix *b_matrix = (const SellMatrix *)b;
+    const float *a_row_values = a_matrix->values + sell_row_offset(a_matrix, a_row);
+    const uint64_t *a_row_indices = a_matrix->indices + sell_row_offset(a_matrix, a_row);
+    uint64_t a_length = sell_row_length(a_matrix, a_row);
+    uint64_t flops = 0;
+    for (uint64_t a_entry = 0; a_entry < a_length; a_entry++)
+    {
+        flops += sell_row_length(b_matrix, a_row_indices[a_entry]);
+    }
+
+    AccumulatorKind kind = choose_accumulator(b_matrix->cols, flops);
+    if (spa_begin_row(spa, kind, flops) != 'S')
+    {
+        return 'F';
+    }
+    ScaleRowKernel scale_row = current_simd_kernel()->kernel;
+
+    for (uint64_t a_entry = 0; a_entry < a_length; a_entry++)
+    {
+        uint64_t a_col = a_row_indices[a_entry];
+        uint64_t b_offset = sell_row_offset(b_matrix, a_col);
+        const float *b_row_vector = b_matrix->values + b_offset;
+        const uint64_t *b_row_indices = b_matrix->indices + b_offset;
+        uint64_t b_length = sell_row_length(b_matrix, a_col);
+        if (kind == ACCUMULATOR_DENSE)
+        {
+            scale_row(a_row_values[a_entry], b_row_vector, b_row_indices, spa->values, b_length);
+            spa_mark(spa, b_row_indices, b_length);
+        }
+        else
+        {
+            spa_scale_row(spa, a_row_values[a_entry], b_row_vector, b_row_indices, b_length);
+        }
+    }
+    return 'S';
+}
+
+/*
+ * Numeric phase of A * B with both operands in SELL-C-sigma, on the calling thread (workers == 1)
+ * or on the thread pool. The rows run in sorted order, so a block of rows is a run of chunks of similar rows.
+ */
+static void sell_multiplication(const SellMatrix *a_matrix, const SellMatrix *b_matrix, EllpackMatrix *result, unsigned int workers)
+{
+    if (a_matrix->cols != b_matrix->rows)
+    {
+        fprintf(stderr, ERR_INVALID_MATRIX_DIMENSIONS, a_matrix->cols, b_matrix->rows);
+        free_sell_matrix((SellMatrix *)a_matrix);
+        free_sell_matrix((SellMatrix *)b_matrix);
+        free_ellpack_matrix(result);
+        exit(EXIT_FAILURE);
+    }
+    if (multiply_rows(a_matrix, b_matrix, b_matrix->cols, a_matrix->rows, a_matrix->row_order, accumulate_row_sell, result, workers) != 'S')
+    {
+        free_sell_matrix((SellMatrix *)a_matrix);
+        free_sell_matrix((SellMatrix *)b_matrix);
+        free_ellpack_matrix(result);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * function to multiply two SellMatrix on the calling thread and save it to the result pointer (EllpackMatrix)
+ */
+void matr_mult_sell(const void *a, const void *b, void *result)
+{
+    sell_multiplication((const SellMatrix *)a, (const SellMatrix *)b, (EllpackMatrix *)result, 1);
+}
+
+/*
+ * function to multiply two SellMatrix on the thread pool
+ */
+void matr_mult_sell_parallel(const void *a, const void *b, void *result)
+{
+    const SellMatrix *a_matrix = (const SellMatrix *)a;
+    unsigned int workers = thread_pool_size();
+    sell_multiplication(a_matrix, (const SellMatrix *)b, (EllpackMatrix *)result, a_matrix->rows <= 5 * workers ? 1 : workers);
+}
@@ -0,0 +1,72 @@
+#ifndef FINAL_SELL_H
+#define FINAL_SELL_H
+
+#include <stdint.h>
+#include "utils.h"
+
+// Sliced ELLPACK (SELL-C-sigma)
+// The rows are sorted by length (longest first) inside windows of sigma rows and cut into chunks of C consecutive
+// sorted rows; every chunk is padded only to its own longest row instead of the global ellpack_cols.
+// The rows of a chunk are stored one after the other (chunk_widths[k] entries each): the multiplication reads whole
+// B rows, which stay contiguous that way, and the row-scaling kernels only run over the valid entries of the row.
+// Padding is stored as in EllpackMatrix (value 0 at index 0, only at the end of a row).
+
+#define SELL_DEFAULT_CHUNK_SIZE 8  // C, rows per chunk
+#define SELL_DEFAULT_SIGMA 1024    // sigma, rows per sorting window (a multiple of C keeps chunks inside one window)
+
+// SellMatrix struct
+typedef struct
+{
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t ellpack_cols;    // ellpack_cols of the ELLPACK matrix it was converted from
+    uint64_t chunk_size;      // C
+    uint64_t sigma;
+    uint64_t chunks;          // ceil(rows / C)
+    uint64_t *chunk_offsets;  // chunks + 1 entries, first entry of every chunk in values/indices
+    uint64_t *chunk_widths;   // entries per row of every chunk
+    uint64_t *row_order;      // sorted position -> row
+    uint64_t *row_position;   // row -> sorted position
+    uint64_t *row_lengths;    // valid entries of every row (by row number)
+    float *values;
+    uint64_t *indices;
+} SellMatrix;
+
+/*
+ * Row accessors by row number (not sorted position)
+ */
+static inline uint64_t sell_row_offset(const SellMatrix *matrix, uint64_t row)
+{
+    uint64_t position = matrix->row_position[row];
+    uint64_t chunk = position / matrix->chunk_size;
+    return matrix->chunk_offsets[chunk] + position % matrix->chunk_size * matrix->chunk_widths[chunk];
+}
+
+static inline uint64_t sell_row_width(const SellMatrix *matrix, uint64_t row)
+{
+    return matrix->chunk_widths[matrix->row_position[row] / matrix->chunk_size];
+}
+
+/*
+ * Number of valid entries of a row
+ */
+static inline uint64_t sell_row_length(const SellMatrix *matrix, uint64_t row)
+{
+    return matrix->row_lengths[row];
+}
+
+char parse_sell_options(const char *spec, uint64_t *chunk_size, uint64_t *sigma);
+
+SellMatrix *ellpack_to_sell(const EllpackMatrix *matrix, uint64_t chunk_size, uint64_t sigma);
+
+EllpackMatrix *sell_to_ellpack(const SellMatrix *matrix);
+
+SellMatrix *load_sell_matrix(const char *filename, uint64_t chunk_size, uint64_t sigma);
+
+void free_sell_matrix(SellMatrix *matrix);
+
+void matr_mult_sell(const void *a, const void *b, void *result);
+
+void matr_mult_sell_parallel(const void *a, const void *b, void *result);
+
+#endif
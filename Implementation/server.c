@@ -0,0 +1,612 @@
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "server.h"
+#include "utils.h"
+#include "ellpack_plan.h"
+#include "ellpack_binary.h"
+#include "benchmark.h"
+
+#define SERVER_MAX_RESPONSE (PATH_MAX + 128)
+#define MESSAGE_TOO_LONG (-1)
+#define MESSAGE_TIMED_OUT (-2)
+
+// CachedMatrix struct, a resident matrix and the identity of the file it was loaded from
+typedef struct
+{
+    char *path;             // NULL if the slot is free
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec modified;
+    EllpackMatrix *matrix;
+    uint64_t generation;    // unique per load, the plans refer to it
+    uint64_t last_use;
+} CachedMatrix;
+
+// CachedPlan struct, plan and result matrix of a pair of resident matrices
+typedef struct
+{
+    EllpackPlan *plan;      // NULL if the slot is free
+    EllpackMatrix *result;
+    uint64_t a_generation;
+    uint64_t b_generation;
+    bool parallel;
+    uint64_t last_use;
+} CachedPlan;
+
+// Server struct, the state of run_server
+typedef struct
+{
+    CachedMatrix matrices[SERVER_CACHE_MATRICES];
+    CachedPlan plans[SERVER_CACHE_PLANS];
+    uint64_t clock;         // counts the lookups, for last_use
+    uint64_t generations;
+    unsigned int index_bits;
+} Server;
+
+static volatile sig_atomic_t server_stopping = 0;
+
+static void stop_server(int signal_number)
+{
+    (void)signal_number;
+    server_stopping = 1;
+}
+
+static void free_cached_plan(CachedPlan *cached)
+{
+    free_ellpack_plan(cached->plan);
+    free_ellpack_matrix(cached->result);
+    memset(cached, 0, sizeof(CachedPlan));
+}
+
+/*
+ * Drop a resident matrix and every plan made from it
+ */
+static void free_cached_matrix(Server *server, CachedMatrix *cached)
+{
+    for (int i = 0; i < SERVER_CACHE_PLANS; i++)
+    {
+        CachedPlan *plan = &server->plans[i];
+        if (plan->plan != NULL && (plan->a_generation == cached->generation || plan->b_generation == cached->generation))
+        {
+            free_cached_plan(plan);
+        }
+    }
+    free_ellpack_matrix(cached->matrix);
+    free(cached->path);
+    memset(cached, 0, sizeof(CachedMatrix));
+}
+
+static bool same_file(const CachedMatrix *cached, const struct stat *file)
+{
+    return cached->device == file->st_dev && cached->inode == file->st_ino && cached->size == file->st_size &&
+           cached->modified.tv_sec == file->st_mtim.tv_sec && cached->modified.tv_nsec == file->st_mtim.tv_nsec;
+}
+
+/*
+ * The resident matrix of a file, loaded unless the cache holds it from the same file (device, inode, size and
+ * modification time). *cached tells whether it came from the cache.
+ * Returns NULL (error gets the reason) if the file can not be loaded.
+ */
+static CachedMatrix *resident_matrix(Server *server, const char *path, bool *cached, char *error, size_t error_size)
+{
+    struct stat file;
+    if (stat(path, &file) != 0)
+    {
+        snprintf(error, error_size, "cannot access %s: %s", path, strerror(errno));
+        return NULL;
+    }
+    // opening a FIFO would block the server until some other process writes to it
+    if (!S_ISREG(file.st_mode))
+    {
+        snprintf(error, error_size, "%s is not a regular file", path);
+        return NULL;
+    }
+
+    CachedMatrix *slot = &server->matrices[0];
+    for (int i = 0; i < SERVER_CACHE_MATRICES; i++)
+    {
+        CachedMatrix *entry = &server->matrices[i];
+        if (entry->path != NULL && strcmp(entry->path, path) == 0)
+        {
+            if (same_file(entry, &file))
+            {
+                entry->last_use = ++server->clock;
+                *cached = true;
+                return entry;
+            }
+            free_cached_matrix(server, entry); // the file changed since it was loaded
+        }
+        if (slot->path != NULL && (entry->path == NULL || entry->last_use < slot->last_use))
+        {
+            slot = entry;
+        }
+    }
+
+    EllpackMatrix *matrix = load_ellpack_matrix(path);
+    if (matrix == NULL)
+    {
+        snprintf(error, error_size, "cannot load %s", path);
+        return NULL;
+    }
+    char *path_copy = strdup(path);
+    if (path_copy == NULL)
+    {
+        free_ellpack_matrix(matrix);
+        snprintf(error, error_size, "out of memory");
+        return NULL;
+    }
+    if (slot->path != NULL)
+    {
+        free_cached_matrix(server, slot);
+    }
+    slot->path = path_copy;
+    slot->device = file.st_dev;
+    slot->inode = file.st_ino;
+    slot->size = file.st_size;
+    slot->modified = file.st_mtim;
+    slot->matrix = matrix;
+    slot->generation = ++server->generations;
+    slot->last_use = ++server->clock;
+    *cached = false;
+    return slot;
+}
+
+/*
+ * The plan and result matrix of A * B, planned unless the cache holds them for these loads of A and B.
+ * Returns NULL (error gets the reason) if planning fails.
+ */
+static CachedPlan *resident_plan(Server *server, const CachedMatrix *a, const CachedMatrix *b, bool parallel, bool *cached, char *error, size_t error_size)
+{
+    CachedPlan *slot = &server->plans[0];
+    for (int i = 0; i < SERVER_CACHE_PLANS; i++)
+    {
+        CachedPlan *entry = &server->plans[i];
+        if (entry->plan != NULL && entry->a_generation == a->generation && entry->b_generation == b->generation && entry->parallel == parallel)
+        {
+            entry->last_use = ++server->clock;
+            *cached = true;
+            return entry;
+        }
+        if (slot->plan != NULL && (entry->plan == NULL || entry->last_use < slot->last_use))
+        {
+            slot = entry;
+        }
+    }
+
+    free_cached_plan(slot);
+    EllpackPlanOptions options;
+    default_plan_options(&options);
+    options.parallel = parallel;
+    options.index_bits = server->index_bits;
+    EllpackStatus status = ellpack_plan(a->matrix, b->matrix, &options, &slot->plan);
+    if (status == ELLPACK_SUCCESS)
+    {
+        status = ellpack_plan_allocate_result(slot->plan, &slot->result);
+    }
+    if (status != ELLPACK_SUCCESS)
+    {
+        snprintf(error, error_size, "%s", ellpack_status_message(status));
+        free_cached_plan(slot);
+        return NULL;
+    }
+    slot->a_generation = a->generation;
+    slot->b_generation = b->generation;
+    slot->parallel = parallel;
+    slot->last_use = ++server->clock;
+    *cached = false;
+    return slot;
+}
+
+/*
+ * Value of the line "<key> <value>" of a request, NULL if it has none.
+ * The lines of the request have been cut at their line breaks.
+ */
+static const char *request_field(const char *request, size_t length, const char *key)
+{
+    size_t key_length = strlen(key);
+    for (const char *line = request; line < request + length; line += strlen(line) + 1)
+    {
+        if (strncmp(line, key, key_length) == 0 && line[key_length] == ' ')
+        {
+            return line + key_length + 1;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Run a multiply request, response gets the answer line
+ */
+static void handle_multiply(Server *server, const char *request, size_t length, char *response, size_t response_size)
+{
+    char error[PATH_MAX + 64];
+    const char *version = request_field(request, length, "version");
+    const char *format = request_field(request, length, "format");
+    const char *a_path = request_field(request, length, "a");
+    const char *b_path = request_field(request, length, "b");
+    const char *output_path = request_field(request, length, "output");
+    if (version == NULL || (strcmp(version, "1") != 0 && strcmp(version, "2") != 0) || a_path == NULL || b_path == NULL || output_path == NULL)
+    {
+        snprintf(response, response_size, "error invalid request\n");
+        return;
+    }
+    bool binary_output = format != NULL && strcmp(format, "binary") == 0;
+    struct stat output;
+    if (stat(output_path, &output) == 0 && S_ISFIFO(output.st_mode))
+    {
+        snprintf(response, response_size, "error %s is a FIFO\n", output_path);
+        return;
+    }
+
+    bool a_cached = false, b_cached = false, plan_cached = false;
+    double phase_start = benchmark_now();
+    CachedMatrix *a = resident_matrix(server, a_path, &a_cached, error, sizeof(error));
+    CachedMatrix *b = a != NULL ? resident_matrix(server, b_path, &b_cached, error, sizeof(error)) : NULL;
+    double load_seconds = benchmark_now() - phase_start;
+    phase_start = benchmark_now();
+    CachedPlan *plan = b != NULL ? resident_plan(server, a, b, strcmp(version, "2") == 0, &plan_cached, error, sizeof(error)) : NULL;
+    double plan_seconds = benchmark_now() - phase_start;
+    if (plan == NULL)
+    {
+        snprintf(response, response_size, "error %s\n", error);
+        return;
+    }
+
+    phase_start = benchmark_now();
+    EllpackStatus status = ellpack_execute(plan->plan, a->matrix->values, b->matrix->values, plan->result);
+    double multiply_seconds = benchmark_now() - phase_start;
+    if (status != ELLPACK_SUCCESS)
+    {
+        snprintf(response, response_size, "error %s\n", ellpack_status_message(status));
+        return;
+    }
+
+    phase_start = benchmark_now();
+    char dumped = binary_output ? dump_ellpack_binary(output_path, plan->result) : dump_result_to_ellpack(output_path, plan->result);
+    double dump_seconds = benchmark_now() - phase_start;
+    if (dumped != 'S')
+    {
+        snprintf(response, response_size, "error cannot write %s\n", output_path);
+        return;
+    }
+    snprintf(response, response_size, "ok %f %f %f %f %c%c%c\n", load_seconds, plan_seconds, multiply_seconds, dump_seconds,
+             a_cached ? 'a' : '-', b_cached ? 'b' : '-', plan_cached ? 'p' : '-');
+}
+
+static char send_all(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (sent <= 0)
+        {
+            return 'F';
+        }
+        data += sent;
+        length -= (size_t)sent;
+    }
+    return 'S';
+}
+
+/*
+ * Read from fd until the empty line that ends a request (or the other side stops writing), within timeout seconds
+ * for the whole message if timeout > 0. Returns the bytes read, MESSAGE_TOO_LONG if the message does not fit into
+ * buffer or MESSAGE_TIMED_OUT if it did not arrive in time.
+ */
+static ssize_t receive_message(int fd, char *buffer, size_t size, double timeout)
+{
+    double deadline = benchmark_now() + timeout;
+    size_t length = 0;
+    while (length + 1 < size)
+    {
+        if (timeout > 0)
+        {
+            double remaining = deadline - benchmark_now();
+            struct pollfd readable = {fd, POLLIN, 0};
+            int ready = remaining > 0 ? poll(&readable, 1, (int)(remaining * 1000.0) + 1) : 0;
+            if (ready < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (ready <= 0)
+            {
+                return MESSAGE_TIMED_OUT;
+            }
+        }
+        ssize_t received = recv(fd, buffer + length, size - 1 - length, 0);
+        if (received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (received <= 0)
+        {
+            break;
+        }
+        length += (size_t)received;
+        buffer[length] = '\0';
+        if (strstr(buffer, "\n\n") != NULL)
+        {
+            return (ssize_t)length;
+        }
+    }
+    buffer[length] = '\0';
+    return length + 1 < size ? (ssize_t)length : MESSAGE_TOO_LONG;
+}
+
+/*
+ * Answer the request of one connection, returns true for a shutdown request
+ */
+static bool handle_connection(Server *server, int connection)
+{
+    char request[SERVER_MAX_REQUEST];
+    char response[SERVER_MAX_RESPONSE];
+    bool shutdown_request = false;
+    ssize_t length = receive_message(connection, request, sizeof(request), SERVER_REQUEST_TIMEOUT);
+    if (length == MESSAGE_TIMED_OUT)
+    {
+        return false; // dropped, a client that does not send its request would not read an answer either
+    }
+    if (length == MESSAGE_TOO_LONG)
+    {
+        snprintf(response, sizeof(response), "error request too long\n");
+    }
+    else
+    {
+        // cut the lines at their line breaks, request_field walks them as strings
+        for (ssize_t i = 0; i < length; i++)
+        {
+            request[i] = request[i] == '\n' ? '\0' : request[i];
+        }
+        if (strcmp(request, "multiply") == 0)
+        {
+            handle_multiply(server, request, (size_t)length, response, sizeof(response));
+        }
+        else if (strcmp(request, "shutdown") == 0)
+        {
+            shutdown_request = true;
+            snprintf(response, sizeof(response), "ok\n");
+        }
+        else
+        {
+            snprintf(response, sizeof(response), "error invalid request\n");
+        }
+    }
+    send_all(connection, response, strlen(response));
+    return shutdown_request;
+}
+
+/*
+ * Open a stream socket connected to socket_path, -1 (after printing the reason if report is set) if that fails
+ */
+static int connect_socket(const char *socket_path, bool report)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0)
+    {
+        return fd;
+    }
+    if (report)
+    {
+        fprintf(stderr, "Error: Cannot connect to %s: %s\n", socket_path, strerror(errno));
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    return -1;
+}
+
+/*
+ * Serve multiply requests on the Unix domain socket socket_path until a shutdown request, SIGINT or SIGTERM.
+ * index_bits is the index width of the plans (see compact_indices.h), the simd kernel and the thread pool are
+ * the ones selected for the process. Returns the exit status of the process.
+ */
+int run_server(const char *socket_path, unsigned int index_bits)
+{
+    struct sockaddr_un address;
+    if (strlen(socket_path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "Error: The socket path %s is too long.\n", socket_path);
+        return EXIT_FAILURE;
+    }
+    // a socket left behind by a server that did not stop cleanly is replaced, a running server is not
+    int running = connect_socket(socket_path, false);
+    if (running >= 0)
+    {
+        close(running);
+        fprintf(stderr, "Error: A server is already running on %s.\n", socket_path);
+        return EXIT_FAILURE;
+    }
+    struct stat file;
+    if (lstat(socket_path, &file) == 0 && S_ISSOCK(file.st_mode))
+    {
+        unlink(socket_path);
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", socket_path);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+    {
+        fprintf(stderr, "Error: Cannot listen on %s: %s\n", socket_path, strerror(errno));
+        if (listener >= 0)
+        {
+            close(listener);
+        }
+        return EXIT_FAILURE;
+    }
+    Server *server = (Server *)calloc(1, sizeof(Server));
+    if (server == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "server");
+        close(listener);
+        unlink(socket_path);
+        return EXIT_FAILURE;
+    }
+    server->index_bits = index_bits;
+
+    // no SA_RESTART: a signal makes accept return, so the loop sees server_stopping
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_server;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    // a write to an output whose reader went away fails with EPIPE instead of killing the server
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, NULL);
+    printf("Serving on %s\n", socket_path);
+    fflush(stdout);
+
+    int status = EXIT_SUCCESS;
+    while (!server_stopping)
+    {
+        int connection = accept(listener, NULL, NULL);
+        if (connection < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            fprintf(stderr, "Error: accept failed on %s: %s\n", socket_path, strerror(errno));
+            status = EXIT_FAILURE;
+            break;
+        }
+        bool shutdown_request = handle_connection(server, connection);
+        close(connection);
+        if (shutdown_request)
+        {
+            break;
+        }
+    }
+
+    close(listener);
+    unlink(socket_path);
+    for (int i = 0; i < SERVER_CACHE_MATRICES; i++)
+    {
+        free_cached_matrix(server, &server->matrices[i]);
+    }
+    free(server);
+    return status;
+}
+
+/*
+ * Absolute form of a path for the server, whose working directory may differ: inputs are resolved
+ * (they have to exist), the output is put behind the current directory if it is relative.
+ * Returns 'F' (after printing the reason) if that fails.
+ */
+static char absolute_path(const char *path, bool must_exist, char *resolved)
+{
+    if (must_exist)
+    {
+        if (realpath(path, resolved) == NULL)
+        {
+            fprintf(stderr, ERR_OPEN_FILE_FAILED, path);
+            return 'F';
+        }
+        return 'S';
+    }
+    if (path[0] == '/')
+    {
+        snprintf(resolved, PATH_MAX, "%s", path);
+        return 'S';
+    }
+    char directory[PATH_MAX];
+    if (getcwd(directory, sizeof(directory)) == NULL || snprintf(resolved, PATH_MAX, "%s/%s", directory, path) >= PATH_MAX)
+    {
+        fprintf(stderr, ERR_OPEN_FILE_FAILED, path);
+        return 'F';
+    }
+    return 'S';
+}
+
+/*
+ * Send a request to the server on socket_path and print its answer. Returns the exit status of the process.
+ */
+int run_client(const char *socket_path, const ServerRequest *request)
+{
+    char message[SERVER_MAX_REQUEST];
+    if (request->shutdown)
+    {
+        snprintf(message, sizeof(message), "shutdown\n\n");
+    }
+    else
+    {
+        char a_path[PATH_MAX], b_path[PATH_MAX], output_path[PATH_MAX];
+        if (absolute_path(request->a_filename, true, a_path) != 'S' || absolute_path(request->b_filename, true, b_path) != 'S' ||
+            absolute_path(request->output_filename, false, output_path) != 'S')
+        {
+            return EXIT_FAILURE;
+        }
+        if (snprintf(message, sizeof(message), "multiply\nversion %u\nformat %s\na %s\nb %s\noutput %s\n\n", request->version,
+                     request->binary_output ? "binary" : "text", a_path, b_path, output_path) >= (int)sizeof(message))
+        {
+            fprintf(stderr, "Error: The request is too long.\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    int fd = connect_socket(socket_path, true);
+    if (fd < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    char response[SERVER_MAX_RESPONSE];
+    ssize_t length = -1;
+    if (send_all(fd, message, strlen(message)) == 'S')
+    {
+        shutdown(fd, SHUT_WR);
+        length = receive_message(fd, response, sizeof(response), 0);
+    }
+    close(fd);
+    if (length <= 0)
+    {
+        fprintf(stderr, "Error: No answer from the server on %s.\n", socket_path);
+        return EXIT_FAILURE;
+    }
+    response[strcspn(response, "\n")] = '\0';
+
+    double load_seconds, plan_seconds, multiply_seconds, dump_seconds;
+    char cached[4];
+    if (strncmp(response, "error ", 6) == 0)
+    {
+        fprintf(stderr, "Error: The server failed: %s\n", response + 6);
+        return EXIT_FAILURE;
+    }
+    if (request->shutdown && strcmp(response, "ok") == 0)
+    {
+        return EXIT_SUCCESS;
+    }
+    if (sscanf(response, "ok %lf %lf %lf %lf %3s", &load_seconds, &plan_seconds, &multiply_seconds, &dump_seconds, cached) != 5)
+    {
+        fprintf(stderr, "Error: Invalid answer from the server: %s\n", response);
+        return EXIT_FAILURE;
+    }
+    printf("Version %u on %s (A %s, B %s, plan %s)\n", request->version, socket_path, cached[0] == 'a' ? "cached" : "loaded",
+           cached[1] == 'b' ? "cached" : "loaded", cached[2] == 'p' ? "cached" : "computed");
+    printf("  load:     %f seconds\n", load_seconds);
+    printf("  plan:     %f seconds\n", plan_seconds);
+    printf("  multiply: %f seconds\n", multiply_seconds);
+    printf("  dump:     %f seconds\n", dump_seconds);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,45 @@
+#ifndef FINAL_SERVER_H
+#define FINAL_SERVER_H
+
+#include <stdbool.h>
+
+// Multiplication server
+// run_server keeps the loaded matrices resident, keyed by path and the device, inode, size and modification time
+// of the file (a changed file is loaded again), together with a plan (see ellpack_plan.h) and a result matrix for
+// every pair of matrices it multiplied. Requests come over a Unix domain socket, one per connection, and the result
+// is written to the output file of the request, so a request for cached matrices costs the numeric phase and the
+// write (an output under /dev/shm stays in shared memory). run_client is the client side of the same binary.
+//
+// Protocol, text lines: "multiply", "version <1|2>", "format <text|binary>", "a <path>", "b <path>",
+// "output <path>" and an empty line, or "shutdown" and an empty line. The paths are absolute. The server answers
+// "ok <load_s> <plan_s> <multiply_s> <dump_s> <cached>" (cached: which of A, B and the plan were reused, e.g. "ab-")
+// or "error <message>" and closes the connection. The server runs one request at a time, a connection that has not
+// sent its request within SERVER_REQUEST_TIMEOUT seconds is closed without an answer.
+
+#ifndef SERVER_CACHE_MATRICES
+#define SERVER_CACHE_MATRICES 16 // resident matrices (at least 2), a new one replaces the least recently used
+#endif
+#ifndef SERVER_CACHE_PLANS
+#define SERVER_CACHE_PLANS 16    // plans and result matrices of pairs of resident matrices, least recently used go first
+#endif
+#define SERVER_MAX_REQUEST 16384 // bytes of a request
+#ifndef SERVER_REQUEST_TIMEOUT
+#define SERVER_REQUEST_TIMEOUT 5 // seconds a connection has to send its whole request, then it is dropped unanswered
+#endif
+
+// ServerRequest struct, what run_client asks the server for
+typedef struct
+{
+    const char *a_filename;
+    const char *b_filename;
+    const char *output_filename;
+    unsigned int version;
+    bool binary_output;
+    bool shutdown;          // stop the server instead of multiplying
+} ServerRequest;
+
+int run_server(const char *socket_path, unsigned int index_bits);
+
+int run_client(const char *socket_path, const ServerRequest *request);
+
+#endif
@@ -0,0 +1,155 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "spmm.h"
+#include "optimizations.h"
+#include "thread_pool.h"
+
+// DenseProduct struct, shared by the workers of matr_mult_dense_parallel
+typedef struct
+{
+    const EllpackMatrix *a;
+    const DenseMatrix *x;
+    DenseMatrix *y;
+    DenseProductKernel kernel;
+} DenseProduct;
+
+// EllColDenseProduct struct, the same for matr_mult_dense_ellcol_parallel
+typedef struct
+{
+    const EllColMatrix *a;
+    const DenseMatrix *x;
+    DenseMatrix *y;
+    EllColDenseProductKernel kernel;
+} EllColDenseProduct;
+
+/*
+ * Allocate y of A * x: A->rows x x->cols in the layout of x.
+ * Returns NULL (after printing the reason) if the dimensions do not match or it does not fit into memory.
+ */
+DenseMatrix *allocate_dense_product(const EllpackMatrix *a, const DenseMatrix *x)
+{
+    if (a->cols != x->rows)
+    {
+        fprintf(stderr, ERR_INVALID_MATRIX_DIMENSIONS, a->cols, x->rows);
+        return NULL;
+    }
+    return allocate_dense_matrix(a->rows, x->cols, x->layout);
+}
+
+/*
+ * function to multiply an EllpackMatrix by a DenseMatrix with the scalar kernel
+ */
+void matr_mult_dense(const void *a, const void *x, void *y)
+{
+    const EllpackMatrix *a_matrix = (const EllpackMatrix *)a;
+    dense_product_scalar(a_matrix, 0, a_matrix->rows, (const DenseMatrix *)x, (DenseMatrix *)y);
+}
+
+/*
+ * function to multiply an EllpackMatrix by a DenseMatrix with the selected simd kernel on the calling thread
+ */
+void matr_mult_dense_simd(const void *a, const void *x, void *y)
+{
+    const EllpackMatrix *a_matrix = (const EllpackMatrix *)a;
+    current_simd_kernel()->dense_product(a_matrix, 0, a_matrix->rows, (const DenseMatrix *)x, (DenseMatrix *)y);
+}
+
+static void dense_product_block(void *context, uint64_t start, uint64_t end, unsigned int worker)
+{
+    (void)worker;
+    DenseProduct *product = (DenseProduct *)context;
+    product->kernel(product->a, start, end, product->x, product->y);
+}
+
+/*
+ * function to multiply an EllpackMatrix by a DenseMatrix with the selected simd kernel on the thread pool,
+ * the row blocks hold about the same number of entries (partition_rows_by_flops over the row lengths)
+ */
+void matr_mult_dense_parallel(const void *a, const void *x, void *y)
+{
+    const EllpackMatrix *a_matrix = (const EllpackMatrix *)a;
+    DenseProduct product = {a_matrix, (const DenseMatrix *)x, (DenseMatrix *)y, current_simd_kernel()->dense_product};
+    unsigned int workers = thread_pool_size();
+    uint64_t block_count = (uint64_t)workers * THREAD_POOL_BLOCKS_PER_WORKER;
+    uint64_t *entry_prefix = (uint64_t *)malloc((a_matrix->rows + 1) * sizeof(uint64_t));
+    uint64_t *bounds = (uint64_t *)malloc((block_count + 1) * sizeof(uint64_t));
+    if (workers == 1 || a_matrix->rows <= 5 * workers || entry_prefix == NULL || bounds == NULL)
+    {
+        free(entry_prefix);
+        free(bounds);
+        dense_product_block(&product, 0, a_matrix->rows, 0);
+        return;
+    }
+
+    entry_prefix[0] = 0;
+    for (uint64_t row = 0; row < a_matrix->rows; row++)
+    {
+        entry_prefix[row + 1] = entry_prefix[row] + ellpack_row_length(a_matrix, row);
+    }
+    partition_rows_by_flops(entry_prefix, a_matrix->rows, block_count, bounds);
+    thread_pool_run(bounds, block_count, dense_product_block, &product);
+    free(entry_prefix);
+    free(bounds);
+}
+
+/*
+ * function to multiply a column-major ELLPACK matrix by a DenseMatrix with the scalar kernel
+ */
+void matr_mult_dense_ellcol(const void *a, const void *x, void *y)
+{
+    const EllColMatrix *a_matrix = (const EllColMatrix *)a;
+    ellcol_dense_product_scalar(a_matrix, 0, a_matrix->rows, (const DenseMatrix *)x, (DenseMatrix *)y);
+}
+
+/*
+ * function to multiply a column-major ELLPACK matrix by a DenseMatrix with the selected simd kernel on the calling thread
+ */
+void matr_mult_dense_ellcol_simd(const void *a, const void *x, void *y)
+{
+    const EllColMatrix *a_matrix = (const EllColMatrix *)a;
+    current_simd_kernel()->ellcol_dense_product(a_matrix, 0, a_matrix->rows, (const DenseMatrix *)x, (DenseMatrix *)y);
+}
+
+static void ellcol_dense_product_block(void *context, uint64_t start, uint64_t end, unsigned int worker)
+{
+    (void)worker;
+    EllColDenseProduct *product = (EllColDenseProduct *)context;
+    product->kernel(product->a, start, end, product->x, product->y);
+}
+
+/*
+ * function to multiply a column-major ELLPACK matrix by a DenseMatrix with the selected simd kernel on the thread pool,
+ * the blocks of ELLCOL_BLOCK_ROWS rows are split by their widths (every lane of a block runs up to the width)
+ */
+void matr_mult_dense_ellcol_parallel(const void *a, const void *x, void *y)
+{
+    const EllColMatrix *a_matrix = (const EllColMatrix *)a;
+    EllColDenseProduct product = {a_matrix, (const DenseMatrix *)x, (DenseMatrix *)y, current_simd_kernel()->ellcol_dense_product};
+    unsigned int workers = thread_pool_size();
+    uint64_t blocks = a_matrix->padded_rows / ELLCOL_BLOCK_ROWS;
+    uint64_t block_count = (uint64_t)workers * THREAD_POOL_BLOCKS_PER_WORKER;
+    uint64_t *width_prefix = (uint64_t *)malloc((blocks + 1) * sizeof(uint64_t));
+    uint64_t *bounds = (uint64_t *)malloc((block_count + 1) * sizeof(uint64_t));
+    if (workers == 1 || a_matrix->rows <= 5 * workers * ELLCOL_BLOCK_ROWS || width_prefix == NULL || bounds == NULL)
+    {
+        free(width_prefix);
+        free(bounds);
+        ellcol_dense_product_block(&product, 0, a_matrix->rows, 0);
+        return;
+    }
+
+    width_prefix[0] = 0;
+    for (uint64_t block = 0; block < blocks; block++)
+    {
+        width_prefix[block + 1] = width_prefix[block] + a_matrix->block_widths[block];
+    }
+    partition_rows_by_flops(width_prefix, blocks, block_count, bounds);
+    for (uint64_t i = 0; i <= block_count; i++) // block numbers to rows
+    {
+        bounds[i] = bounds[i] * ELLCOL_BLOCK_ROWS < a_matrix->rows ? bounds[i] * ELLCOL_BLOCK_ROWS : a_matrix->rows;
+    }
+    thread_pool_run(bounds, block_count, ellcol_dense_product_block, &product);
+    free(width_prefix);
+    free(bounds);
+}
@@ -0,0 +1,30 @@
+#ifndef FINAL_SPMM_H
+#define FINAL_SPMM_H
+
+#include <stdint.h>
+#include "utils.h"
+#include "ellpack_col.h"
+
+// Sparse x dense products
+// y = A * x for an ELLPACK matrix A and a dense x with one (SpMV) or several (SpMM) right-hand sides, x and y in
+// the same layout (see DenseMatrix in utils.h). Every y element sums its products in the entry order of its A row,
+// so all versions, kernels and layouts give the same bits. A keeps its 64-bit indices (no compact_ellpack_indices).
+// V2 cuts the rows into blocks of about equal entry counts for the thread pool.
+// The _ellcol variants take A in column-major ELLPACK (one SIMD lane per row, see ellpack_col.h) and give the
+// same y; their V2 splits the blocks of ELLCOL_BLOCK_ROWS rows by width.
+
+DenseMatrix *allocate_dense_product(const EllpackMatrix *a, const DenseMatrix *x);
+
+void matr_mult_dense(const void *a, const void *x, void *y);
+
+void matr_mult_dense_simd(const void *a, const void *x, void *y);
+
+void matr_mult_dense_parallel(const void *a, const void *x, void *y);
+
+void matr_mult_dense_ellcol(const void *a, const void *x, void *y);
+
+void matr_mult_dense_ellcol_simd(const void *a, const void *x, void *y);
+
+void matr_mult_dense_ellcol_parallel(const void *a, const void *x, void *y);
+
+#endif
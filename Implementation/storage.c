@@ -0,0 +1,191 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "storage.h"
+#include "sell.h"
+#include "hyb.h"
+#include "csr.h"
+#include "tiling.h"
+#include "ellpack_col.h"
+#include "compact_indices.h"
+#include "V0/matr_mult_ellpack.h"
+#include "V1/matr_mult_ellpack_v1.h"
+#include "V2/matr_mult_ellpack_v2.h"
+
+static const char *storage_names[] = {"ellpack", "sell", "hyb", "csr", "ellcsr", "tiled", "ellcol", "auto"};
+
+void default_storage_options(StorageOptions *options)
+{
+    options->storage = STORAGE_ELLPACK;
+    options->sell_chunk_size = SELL_DEFAULT_CHUNK_SIZE;
+    options->sell_sigma = SELL_DEFAULT_SIGMA;
+    options->hyb_width = HYB_AUTO_WIDTH;
+    options->tile_cols = TILE_AUTO;
+    options->tile_rows = TILE_AUTO;
+    options->index_bits = INDEX_BITS_AUTO;
+}
+
+/*
+ * Parse "ellpack", "sell[,<C>,<sigma>]", "hyb[,<width>]", "csr", "ellcsr", "tiled[,<cols>[,<rows>]]" or "auto",
+ * parameters that are not given keep their value
+ */
+char parse_storage_options(const char *spec, StorageOptions *options)
+{
+    for (MatrixStorage storage = STORAGE_ELLPACK; storage <= STORAGE_AUTO; storage++)
+    {
+        if (strcmp(spec, storage_names[storage]) == 0)
+        {
+            options->storage = storage;
+            return 'S';
+        }
+    }
+    if (strncmp(spec, "sell,", 5) == 0 && parse_sell_options(spec + 5, &options->sell_chunk_size, &options->sell_sigma) == 'S')
+    {
+        options->storage = STORAGE_SELL;
+        return 'S';
+    }
+    if (strncmp(spec, "tiled,", 6) == 0 && parse_tile_options(spec + 6, &options->tile_cols, &options->tile_rows) == 'S')
+    {
+        options->storage = STORAGE_TILED;
+        return 'S';
+    }
+    unsigned long long width;
+    char trailing;
+    if (sscanf(spec, "hyb,%llu%c", &width, &trailing) == 1)
+    {
+        options->storage = STORAGE_HYB;
+        options->hyb_width = width;
+        return 'S';
+    }
+    fprintf(stderr, "Error: Invalid storage \"%s\".\n", spec);
+    return 'F';
+}
+
+const char *storage_name(MatrixStorage storage)
+{
+    return storage_names[storage];
+}
+
+/*
+ * Multiplication of a version for operands in the storage, NULL if the version has none (V0 only runs on ELLPACK)
+ */
+MultiplyFunction storage_multiplication(MatrixStorage storage, unsigned int version)
+{
+    switch (storage)
+    {
+    case STORAGE_SELL:
+        return version == 0 ? NULL : version == 1 ? matr_mult_sell : matr_mult_sell_parallel;
+    case STORAGE_HYB:
+        return version == 0 ? NULL : version == 1 ? matr_mult_hyb : matr_mult_hyb_parallel;
+    case STORAGE_CSR:
+        return version == 0 ? NULL : version == 1 ? matr_mult_csr : matr_mult_csr_parallel;
+    case STORAGE_ELL_CSR:
+        return version == 0 ? NULL : version == 1 ? matr_mult_ell_csr : matr_mult_ell_csr_parallel;
+    case STORAGE_TILED:
+        return version == 0 ? NULL : version == 1 ? matr_mult_tiled : matr_mult_tiled_parallel;
+    case STORAGE_ELL_COL:
+        return version == 0 ? NULL : version == 1 ? matr_mult_ellcol : matr_mult_ellcol_parallel;
+    case STORAGE_AUTO:
+        return NULL;
+    default:
+        return version == 0 ? matr_mult_ellpack : version == 1 ? matr_mult_ellpack_v1 : matr_mult_ellpack_v2;
+    }
+}
+
+/*
+ * Storage of operand 'A' or 'B' of the multiplication, STORAGE_ELL_CSR and STORAGE_TILED keep A in ELLPACK,
+ * STORAGE_ELL_COL keeps B in ELLPACK
+ */
+MatrixStorage operand_storage(MatrixStorage storage, char operand)
+{
+    if (storage == STORAGE_ELL_CSR)
+    {
+        return operand == 'A' ? STORAGE_ELLPACK : STORAGE_CSR;
+    }
+    if (storage == STORAGE_TILED)
+    {
+        return operand == 'A' ? STORAGE_ELLPACK : STORAGE_TILED;
+    }
+    if (storage == STORAGE_ELL_COL)
+    {
+        return operand == 'A' ? STORAGE_ELL_COL : STORAGE_ELLPACK;
+    }
+    return storage;
+}
+
+/*
+ * Stored slots (rows * ellpack_cols) per stored entry, 1.0 for a matrix without padding
+ */
+static double padding_ratio(const EllpackMatrix *matrix)
+{
+    uint64_t entries = 0;
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        entries += ellpack_row_length(matrix, row);
+    }
+    return entries == 0 ? 1.0 : (double)matrix->rows * (double)matrix->ellpack_cols / (double)entries;
+}
+
+/*
+ * Storage for STORAGE_AUTO. Every B row is read once per A entry that points to it, so B decides: with little
+ * padding the ELLPACK kernels run over nearly full SIMD-friendly rows and nothing is converted, otherwise the valid
+ * entries of B are spread over mostly unused cache lines and B goes to CSR. A is read once, it follows B into CSR
+ * only if it is padded as well (its rows are then read from fewer cache lines). V0 only runs on ELLPACK.
+ */
+MatrixStorage select_storage(const EllpackMatrix *a, const EllpackMatrix *b, unsigned int version)
+{
+    if (version == 0 || padding_ratio(b) <= AUTO_MAX_PADDING)
+    {
+        return STORAGE_ELLPACK;
+    }
+    return padding_ratio(a) <= AUTO_MAX_PADDING ? STORAGE_ELL_CSR : STORAGE_CSR;
+}
+
+/*
+ * Convert a loaded matrix to the storage of its operand, for ELLPACK the matrix itself is the operand.
+ * Returns NULL if the converted matrix does not fit into memory.
+ */
+void *convert_operand(const EllpackMatrix *matrix, const StorageOptions *options, MatrixStorage storage)
+{
+    switch (storage)
+    {
+    case STORAGE_SELL:
+        return ellpack_to_sell(matrix, options->sell_chunk_size, options->sell_sigma);
+    case STORAGE_HYB:
+        return ellpack_to_hyb(matrix, options->hyb_width);
+    case STORAGE_CSR:
+        return ellpack_to_csr(matrix);
+    case STORAGE_TILED:
+        return ellpack_to_tiled(matrix, options->tile_cols, options->tile_rows);
+    case STORAGE_ELL_COL:
+        return ellpack_to_ellcol(matrix);
+    default:
+        return (void *)matrix;
+    }
+}
+
+void free_operand(void *operand, MatrixStorage storage)
+{
+    switch (storage)
+    {
+    case STORAGE_SELL:
+        free_sell_matrix((SellMatrix *)operand);
+        break;
+    case STORAGE_HYB:
+        free_hyb_matrix((HybMatrix *)operand);
+        break;
+    case STORAGE_CSR:
+        free_csr_matrix((CsrMatrix *)operand);
+        break;
+    case STORAGE_TILED:
+        free_tiled_matrix((TiledMatrix *)operand);
+        break;
+    case STORAGE_ELL_COL:
+        free_ellcol_matrix((EllColMatrix *)operand);
+        break;
+    default:
+        free_ellpack_matrix((EllpackMatrix *)operand);
+        break;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef FINAL_STORAGE_H
+#define FINAL_STORAGE_H
+
+#include <stdint.h>
+#include "utils.h"
+
+// Storage of the operands during the numeric phase
+// The files are always ELLPACK and the symbolic phase runs on the loaded EllpackMatrix operands; for any other
+// storage they are converted afterwards and the multiplication of that storage writes the usual EllpackMatrix result.
+// STORAGE_AUTO is resolved by select_storage from the row lengths of the loaded operands.
+
+typedef enum
+{
+    STORAGE_ELLPACK,
+    STORAGE_SELL,    // sliced ELLPACK, see sell.h
+    STORAGE_HYB,     // ELLPACK + COO, see hyb.h
+    STORAGE_CSR,     // see csr.h
+    STORAGE_ELL_CSR, // A stays ELLPACK, B in CSR
+    STORAGE_TILED,   // A stays ELLPACK, B column-tiled, see tiling.h
+    STORAGE_ELL_COL, // A column-major ELLPACK, B stays ELLPACK, see ellpack_col.h
+    STORAGE_AUTO
+} MatrixStorage;
+
+#define AUTO_MAX_PADDING 1.25 // select_storage keeps an operand in ELLPACK up to this many stored slots per entry
+
+// StorageOptions struct, the storage and its parameters
+typedef struct
+{
+    MatrixStorage storage;
+    uint64_t sell_chunk_size;
+    uint64_t sell_sigma;
+    uint64_t hyb_width;       // HYB_AUTO_WIDTH to pick it per matrix
+    uint64_t tile_cols;       // TILE_AUTO to size the tiles from the caches
+    uint64_t tile_rows;
+    unsigned int index_bits;  // index width of ELLPACK operands, see compact_indices.h
+} StorageOptions;
+
+typedef void (*MultiplyFunction)(const void *a, const void *b, void *result);
+
+void default_storage_options(StorageOptions *options);
+
+char parse_storage_options(const char *spec, StorageOptions *options);
+
+const char *storage_name(MatrixStorage storage);
+
+MultiplyFunction storage_multiplication(MatrixStorage storage, unsigned int version);
+
+MatrixStorage operand_storage(MatrixStorage storage, char operand);
+
+MatrixStorage select_storage(const EllpackMatrix *a, const EllpackMatrix *b, unsigned int version);
+
+void *convert_operand(const EllpackMatrix *matrix, const StorageOptions *options, MatrixStorage storage);
+
+void free_operand(void *operand, MatrixStorage storage);
+
+#endif
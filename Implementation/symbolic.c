@@ -0,0 +1,191 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "symbolic.h"
+#include "thread_pool.h"
+#include "optimizations.h"
+
+// SymbolicThreadData struct, shared by all pool workers
+typedef struct
+{
+    const EllpackMatrix *a_matrix;
+    const EllpackMatrix *b_matrix;
+    uint64_t *row_nnz;
+    uint64_t **markers;      // one per pool worker, allocated by the worker on first use
+    uint64_t *max_row_nnz;   // one per pool worker
+    char *status;            // one per pool worker
+} SymbolicThreadData;
+
+/*
+ * Count the distinct output columns of the rows [start, end) on pool worker `worker`.
+ * marker[col] == a_row + 1 means col was already counted for a_row, so the marker never has to be reset.
+ */
+static void symbolic_row_block(void *arg, uint64_t start, uint64_t end, unsigned int worker)
+{
+    SymbolicThreadData *data = (SymbolicThreadData *)arg;
+    const EllpackMatrix *a_matrix = data->a_matrix;
+    const EllpackMatrix *b_matrix = data->b_matrix;
+
+    if (data->status[worker] != 'S')
+    {
+        return;
+    }
+    if (data->markers[worker] == NULL)
+    {
+        data->markers[worker] = (uint64_t *)calloc(b_matrix->cols, sizeof(uint64_t));
+        if (data->markers[worker] == NULL)
+        {
+            fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "symbolic marker array");
+            data->status[worker] = 'F';
+            return;
+        }
+    }
+    uint64_t *marker = data->markers[worker];
+
+    uint64_t max_row_nnz = data->max_row_nnz[worker];
+    for (uint64_t a_row = start; a_row < end; a_row++)
+    {
+        const uint64_t *a_row_indices = ellpack_row_indices(a_matrix, a_row);
+        uint64_t a_length = ellpack_row_length(a_matrix, a_row);
+        uint64_t stamp = a_row + 1;
+        uint64_t count = 0;
+        for (uint64_t a_ellpack_col = 0; a_ellpack_col < a_length; a_ellpack_col++)
+        {
+            uint64_t a_col = a_row_indices[a_ellpack_col];
+            const uint64_t *b_row_indices = ellpack_row_indices(b_matrix, a_col);
+            uint64_t b_length = ellpack_row_length(b_matrix, a_col);
+            for (uint64_t i = 0; i < b_length; i++)
+            {
+                uint64_t b_col = b_row_indices[i];
+                if (marker[b_col] != stamp)
+                {
+                    marker[b_col] = stamp;
+                    count++;
+                }
+            }
+        }
+        data->row_nnz[a_row] = count;
+        if (count > max_row_nnz)
+        {
+            max_row_nnz = count;
+        }
+    }
+    data->max_row_nnz[worker] = max_row_nnz;
+}
+
+/*
+ * Symbolic phase of A * B: computes the exact number of output entries of every row
+ * and therefore ellpack_cols of the result. With parallel set the rows are spread over the thread pool.
+ * Returns NULL on a dimension mismatch or allocation failure.
+ */
+SymbolicProduct *symbolic_multiplication(const EllpackMatrix *a_matrix, const EllpackMatrix *b_matrix, bool parallel)
+{
+    if (a_matrix->cols != b_matrix->rows)
+    {
+        fprintf(stderr, ERR_INVALID_MATRIX_DIMENSIONS, a_matrix->cols, b_matrix->rows);
+        return NULL;
+    }
+
+    SymbolicProduct *symbolic = (SymbolicProduct *)malloc(sizeof(SymbolicProduct));
+    if (symbolic == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "symbolic product");
+        return NULL;
+    }
+    symbolic->rows = a_matrix->rows;
+    symbolic->cols = b_matrix->cols;
+    symbolic->ellpack_cols = 0;
+    symbolic->row_nnz = (uint64_t *)calloc(a_matrix->rows, sizeof(uint64_t));
+    if (symbolic->row_nnz == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "symbolic row_nnz array");
+        free(symbolic);
+        return NULL;
+    }
+
+    unsigned int num_threads = parallel ? thread_pool_size() : 1;
+    SymbolicThreadData thread_data;
+    thread_data.a_matrix = a_matrix;
+    thread_data.b_matrix = b_matrix;
+    thread_data.row_nnz = symbolic->row_nnz;
+    thread_data.markers = (uint64_t **)calloc(num_threads, sizeof(uint64_t *));
+    thread_data.max_row_nnz = (uint64_t *)calloc(num_threads, sizeof(uint64_t));
+    thread_data.status = (char *)malloc(num_threads * sizeof(char));
+    if (thread_data.markers == NULL || thread_data.max_row_nnz == NULL || thread_data.status == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "symbolic thread data");
+        free(thread_data.markers);
+        free(thread_data.max_row_nnz);
+        free(thread_data.status);
+        free_symbolic_product(symbolic);
+        return NULL;
+    }
+    for (unsigned int i = 0; i < num_threads; i++)
+    {
+        thread_data.status[i] = 'S';
+    }
+
+    if (parallel)
+    {
+        // the symbolic work of a row is proportional to its flop count as well, cut the rows by flops
+        uint64_t block_count = (uint64_t)num_threads * THREAD_POOL_BLOCKS_PER_WORKER;
+        uint64_t *flop_prefix = row_flop_prefix(a_matrix, b_matrix);
+        uint64_t *block_bounds = (uint64_t *)malloc((block_count + 1) * sizeof(uint64_t));
+        if (flop_prefix != NULL && block_bounds != NULL)
+        {
+            partition_rows_by_flops(flop_prefix, a_matrix->rows, block_count, block_bounds);
+            thread_pool_run(block_bounds, block_count, symbolic_row_block, &thread_data);
+        }
+        else
+        {
+            thread_pool_run_rows(a_matrix->rows, symbolic_row_block, &thread_data);
+        }
+        free(flop_prefix);
+        free(block_bounds);
+    }
+    else
+    {
+        symbolic_row_block(&thread_data, 0, a_matrix->rows, 0);
+    }
+
+    char status = 'S';
+    for (unsigned int i = 0; i < num_threads; i++)
+    {
+        free(thread_data.markers[i]);
+        if (thread_data.status[i] != 'S')
+        {
+            status = 'F';
+        }
+        else if (thread_data.max_row_nnz[i] > symbolic->ellpack_cols)
+        {
+            symbolic->ellpack_cols = thread_data.max_row_nnz[i];
+        }
+    }
+    free(thread_data.markers);
+    free(thread_data.max_row_nnz);
+    free(thread_data.status);
+
+    if (status != 'S')
+    {
+        free_symbolic_product(symbolic);
+        return NULL;
+    }
+    return symbolic;
+}
+
+void free_symbolic_product(SymbolicProduct *symbolic)
+{
+    if (symbolic != NULL)
+    {
+        free(symbolic->row_nnz);
+        free(symbolic);
+    }
+}
+
+/*
+ * Allocate the result of the numeric phase, every row has room for its symbolic nnz
+ */
+EllpackMatrix *allocate_result_matrix(const SymbolicProduct *symbolic)
+{
+    return allocate_ellpack_matrix(symbolic->rows, symbolic->cols, symbolic->ellpack_cols);
+}
@@ -0,0 +1,27 @@
+#ifndef FINAL_SYMBOLIC_H
+#define FINAL_SYMBOLIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "utils.h"
+
+// SymbolicProduct structure
+// Sparsity information of A * B computed from the indices alone, before any floating point work.
+// It only depends on the patterns of A and B, so it can be reused for every multiplication
+// of matrices with the same patterns and new values.
+
+typedef struct
+{
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t ellpack_cols;  // longest output row, the exact ellpack_cols of the result
+    uint64_t *row_nnz;      // number of structural entries in every output row
+} SymbolicProduct;
+
+SymbolicProduct *symbolic_multiplication(const EllpackMatrix *a_matrix, const EllpackMatrix *b_matrix, bool parallel);
+
+void free_symbolic_product(SymbolicProduct *symbolic);
+
+EllpackMatrix *allocate_result_matrix(const SymbolicProduct *symbolic);
+
+#endif
@@ -1,12 +1,20 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <float.h>
 #include <time.h>
 #include "V0/matr_mult_ellpack.h"
 #include "V1/matr_mult_ellpack_v1.h"
 #include "V2/matr_mult_ellpack_v2.h"
 #include "utils.h"
+#include "symbolic.h"
+#include "generator.h"
+#include "storage.h"
+#include "reorder.h"
+#include "compact_indices.h"
+#include "ellpack_binary.h"
+#include "ellpack_plan.h"
 #include <math.h>
 #include <stdbool.h>
 #include <unistd.h>
@@ -14,53 +22,17 @@
 //testprogram for testing correctness of multiplication results of valid matrices
 
 
-float random_float(float min, float max) {
-    return min + ((float) rand() / (float) RAND_MAX) * (max - min);
-}
-
-//creates ellpack matrix with random float values between defined range
+//creates ellpack matrix with random one-decimal values between -100 and 100 at distinct random columns
+//(uniform family of the generator, seeded from rand())
 EllpackMatrix *create_random_ellpack_matrix(uint64_t rows, uint64_t cols, uint64_t ellpack_cols) {
 
-    EllpackMatrix *matrix = allocate_ellpack_matrix(rows, cols, ellpack_cols);
-    if(matrix == NULL){
-        return NULL;
-    }
-
-    matrix->rows = rows;
-    matrix->cols = cols;
-    matrix->ellpack_cols = ellpack_cols;
-
-
-    for (uint64_t i = 0; i < rows; i++) {
-        int *used_indices = (int *) calloc(cols, sizeof(int));
-
-            for (uint64_t j = 0; j < ellpack_cols; j++) {
-            float random_f = random_float(-100,100);
-
-            //after zero only zeros
-            uint64_t k = j;
-            if(random_f == 0.0f){
-                while(k < ellpack_cols){
-                    matrix->values[i][k] = 0.0f;
-                    k++;
-                }
-                continue;
-            }
-
-            matrix->values[i][j] = random_float(-100,100);
-
-            uint64_t rand_index;
-            do {
-                rand_index = rand() % cols;
-            } while (used_indices[rand_index]); // unique col index
-
-            matrix->indices[i][j] = rand_index;
-            used_indices[rand_index] = 1;
-        }
-        free(used_indices);
-    }
-
-    return matrix;
+    GeneratorOptions options;
+    options.family = GENERATE_UNIFORM;
+    options.rows = rows;
+    options.cols = cols;
+    options.row_length = ellpack_cols < cols ? ellpack_cols : cols;
+    options.seed = (uint64_t) rand();
+    return generate_ellpack_matrix(&options);
 }
 
 float **allocate_2d_float_array(size_t rows, size_t cols) { //with calloc
@@ -103,9 +75,9 @@ void test_dump_ellpack_matrix(FILE *file, EllpackMatrix *matrix) {
     for (uint64_t i = 0; i < matrix->rows; i++) {
         for (uint64_t j = 0; j < matrix->ellpack_cols; j++) {
             if (i == matrix->rows - 1 && j == matrix->ellpack_cols - 1) {
-                fprintf(file, "%.1f", matrix->values[i][j]);
+                fprintf(file, "%.1f", ellpack_row_values(matrix, i)[j]);
             } else {
-                fprintf(file, "%.1f,", matrix->values[i][j]);
+                fprintf(file, "%.1f,", ellpack_row_values(matrix, i)[j]);
             }
         }
     }
@@ -116,9 +88,9 @@ void test_dump_ellpack_matrix(FILE *file, EllpackMatrix *matrix) {
         for (uint64_t j = 0; j < matrix->ellpack_cols; j++) {
             {
                 if(i == matrix->rows - 1 && j == matrix->ellpack_cols - 1){
-                    fprintf(file, "%"PRIu64"", matrix->indices[i][j]);
+                    fprintf(file, "%"PRIu64"", ellpack_row_indices(matrix, i)[j]);
                 }else{
-                    fprintf(file, "%"PRIu64",", matrix->indices[i][j]);
+                    fprintf(file, "%"PRIu64",", ellpack_row_indices(matrix, i)[j]);
                 }
             }
         }
@@ -128,107 +100,53 @@ void test_dump_ellpack_matrix(FILE *file, EllpackMatrix *matrix) {
 }
 
 //dump method for tests, writing multiple results to the same file
-char test_dump_result_to_ellpack(FILE* file, float **result_matrix, uint64_t rows, uint64_t cols)
+char test_dump_result_to_ellpack(FILE* file, EllpackMatrix *result)
 {
 
     // check whether overflow occurred during multiplication
-    for(uint64_t i = 0; i < rows; i++){
-        for(uint64_t j = 0; j < cols; j++){
-            if(isinf(result_matrix[i][j])){
+    for(uint64_t i = 0; i < result->rows; i++){
+        for(uint64_t j = 0; j < result->ellpack_cols; j++){
+            if(isinf(ellpack_row_values(result, i)[j])){
                 fprintf(stderr, ERR_OVERFLOW);
                 return 'F';
             }
         }
     }
-    // calculate ellpack_col
-    uint64_t ellpack_cols = 0;
-    for (uint64_t i = 0; i < rows; i++)
-    {
-        uint64_t nonZero = 0;
-        for (uint64_t j = 0; j < cols; j++)
-        {
-            if (result_matrix[i][j] != 0)
-            {
-                nonZero++;
-            }
-        }
-        if (nonZero > ellpack_cols)
-        {
-            ellpack_cols = nonZero;
-        }
-    }
 
     // write <noRows>,<noCols>,<noEllpackCol> to the first line
-    fprintf(file, "%"PRIu64",%"PRIu64",%"PRIu64"\n", rows, cols, ellpack_cols);
-
-    uint64_t* index_array = malloc(rows * ellpack_cols * sizeof(uint64_t));
-    if (index_array == NULL) {
-        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "failed to allocate memory for index_array");
-        return 'F';
-    }
-    uint64_t array_index = 0;
+    fprintf(file, "%"PRIu64",%"PRIu64",%"PRIu64"\n", result->rows, result->cols, result->ellpack_cols);
 
-       // write matrix values in ellpack-format to the second line
-    for (uint64_t i = 0; i < rows; i++) {
-        uint64_t pos = 0;
-        for (uint64_t j = 0; j < cols; j++) {
-            if (result_matrix[i][j] != 0) {
-                if (pos > 0) {
-                    fprintf(file, ",");
-                }
-                fprintf(file, "%.1f", result_matrix[i][j]);
-                index_array[array_index++] = j;
-                pos++;
+    // write matrix values in ellpack-format to the second line, unused places are *
+    for (uint64_t i = 0; i < result->rows; i++) {
+        for (uint64_t j = 0; j < result->ellpack_cols; j++) {
+            if (i > 0 || j > 0) {
+                fprintf(file, ",");
             }
-        }
-        if (pos == ellpack_cols && i < rows - 1) //at the end of a row and not last row
-        {
-            fprintf(file, ",");
-        }
-        // fill unused places with *
-        bool filled_unused = false;
-
-        if (pos < ellpack_cols) {
-            filled_unused = true;
-        }
-
-        while (pos < ellpack_cols) //row not full
-        {
-            if (pos > 0) {
-                fprintf(file, ",*");
+            float value = ellpack_row_values(result, i)[j];
+            if (value != 0) {
+                fprintf(file, "%.1f", value);
             } else {
                 fprintf(file, "*");
             }
-            index_array[array_index++] = -1;
-            pos++;
-
         }
-        if (filled_unused && i < rows - 1) { //at the end of a row but not last row
-            fprintf(file, ",");
-        }
-
     }
     fprintf(file, "\n");
 
     // write indices to the third line
-    for (uint64_t i = 0; i < array_index; i++)
-    {
-        if (i > 0)
-        {
-            fprintf(file, ",");
-        }
-        if (index_array[i] == -1ULL) // comparison of integers of different signs: 'uint64_t'
-        {
-            fprintf(file, "*");
-        }
-        else
-        {
-            fprintf(file, "%"PRIu64"", index_array[i]);
+    for (uint64_t i = 0; i < result->rows; i++) {
+        for (uint64_t j = 0; j < result->ellpack_cols; j++) {
+            if (i > 0 || j > 0) {
+                fprintf(file, ",");
+            }
+            if (ellpack_row_values(result, i)[j] != 0) {
+                fprintf(file, "%"PRIu64"", ellpack_row_indices(result, i)[j]);
+            } else {
+                fprintf(file, "*");
+            }
         }
     }
 
     fprintf(file, "\n");
-    free(index_array);
     return 'S';
 }
 
@@ -237,15 +155,18 @@ float** convert_ellpack_to_normal(EllpackMatrix* ellpackMatrix){
     uint64_t rows = ellpackMatrix->rows;
     uint64_t cols = ellpackMatrix->cols;
     uint64_t ellpack_cols = ellpackMatrix->ellpack_cols;
-    float** value_array = ellpackMatrix->values;
-    uint64_t ** indices_array = ellpackMatrix->indices;
     float** normal_matrix = allocate_2d_float_array(rows,cols);
     if(normal_matrix == NULL){
         exit(EXIT_FAILURE);
     }
     for(uint64_t i = 0; i < rows; i++){
+        const float* value_array = ellpack_row_values(ellpackMatrix, i);
+        const uint64_t* indices_array = ellpack_row_indices(ellpackMatrix, i);
         for(uint64_t j = 0; j < ellpack_cols; j++){
-            normal_matrix[i][indices_array[i][j]] = value_array[i][j];
+            // padding slots are zero and must not overwrite a real entry in the same column
+            if(value_array[j] != 0){
+                normal_matrix[i][indices_array[j]] = value_array[j];
+            }
         }
     }
     return normal_matrix;
@@ -280,6 +201,262 @@ bool compare(float** ellpack_result, float** normal_result,uint64_t rows, uint64
     return true;
 }
 
+//compares an ellpack result with the reference product
+bool compare_result(EllpackMatrix *result, float **normal_res) {
+    float **normal_result = convert_ellpack_to_normal(result);
+    bool test_res = compare(normal_result, normal_res, result->rows, result->cols);
+    free_2d_float_array(normal_result, result->rows);
+    return test_res;
+}
+
+//copies a matrix through a binary ELLPACK file (dump_ellpack_binary, then load_ellpack_matrix), NULL on failure
+EllpackMatrix *binary_round_trip(const EllpackMatrix *matrix) {
+    char filename[] = "/tmp/ellpack_test_XXXXXX";
+    int fd = mkstemp(filename);
+    if (fd == -1) {
+        fprintf(stderr, ERR_OPEN_FILE_FAILED, filename);
+        return NULL;
+    }
+    close(fd);
+    EllpackMatrix *copy = dump_ellpack_binary(filename, matrix) == 'S' ? load_ellpack_matrix(filename) : NULL;
+    unlink(filename); //the mapping of the loaded copy stays valid
+    return copy;
+}
+
+//true if both matrices have the same shape and the same valid entries in every row
+bool same_ellpack_matrix(const EllpackMatrix *a, const EllpackMatrix *b) {
+    if (a->rows != b->rows || a->cols != b->cols || a->ellpack_cols != b->ellpack_cols) {
+        return false;
+    }
+    for (uint64_t row = 0; row < a->rows; row++) {
+        uint64_t length = ellpack_row_length(a, row);
+        if (length != ellpack_row_length(b, row)) {
+            return false;
+        }
+        const float *a_values = ellpack_row_values(a, row);
+        const float *b_values = ellpack_row_values(b, row);
+        for (uint64_t j = 0; j < length; j++) {
+            if (a_values[j] != b_values[j] || ellpack_index(a, row, j) != ellpack_index(b, row, j)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+//one numeric phase of the V1/V2 storages, optionally on reordered operands or narrowed ELLPACK indices
+typedef struct {
+    const char *name;
+    MatrixStorage storage;
+    ReorderMethod reorder;
+    unsigned int index_bits;
+} StorageTest;
+
+static const StorageTest storage_tests[] = {
+    {"sell", STORAGE_SELL, REORDER_NONE, 64},
+    {"hyb", STORAGE_HYB, REORDER_NONE, 64},
+    {"csr", STORAGE_CSR, REORDER_NONE, 64},
+    {"ellcsr", STORAGE_ELL_CSR, REORDER_NONE, 64},
+    {"tiled", STORAGE_TILED, REORDER_NONE, 64},
+    {"ellcol", STORAGE_ELL_COL, REORDER_NONE, 64},
+    {"auto", STORAGE_AUTO, REORDER_NONE, 64},
+    {"ellpack, 32 bit indices", STORAGE_ELLPACK, REORDER_NONE, 32},
+    {"ellpack, 16 bit indices", STORAGE_ELLPACK, REORDER_NONE, 16},
+    {"ellpack, rcm reordering", STORAGE_ELLPACK, REORDER_RCM, 64},
+    {"ellpack, cluster reordering", STORAGE_ELLPACK, REORDER_CLUSTER, 64},
+};
+
+//multiplies copies of test_a and test_b as the test describes and compares the result with normal_res
+bool run_storage_test(const StorageTest *test, const EllpackMatrix *test_a, const EllpackMatrix *test_b, float **normal_res, int version) {
+
+    //small chunks, tiles and HYB width, so the 20x20 test matrices span several of them
+    StorageOptions options;
+    default_storage_options(&options);
+    options.sell_chunk_size = 4;
+    options.sell_sigma = 8;
+    options.hyb_width = 4;
+    options.tile_cols = 8;
+    options.tile_rows = 4;
+
+    //copies, reordering and narrowing replace or change the operands
+    EllpackMatrix *a = binary_round_trip(test_a);
+    EllpackMatrix *b = binary_round_trip(test_b);
+    Reordering *reordering = NULL;
+    if (a == NULL || b == NULL) {
+        free_ellpack_matrix(a);
+        free_ellpack_matrix(b);
+        return false;
+    }
+    if (test->reorder != REORDER_NONE) {
+        reordering = compute_reordering(a, b, test->reorder);
+        if (reordering == NULL || apply_reordering(reordering, &a, &b) != 'S') {
+            free_reordering(reordering);
+            free_ellpack_matrix(a);
+            free_ellpack_matrix(b);
+            return false;
+        }
+    }
+    SymbolicProduct *symbolic = symbolic_multiplication(a, b, version == 2);
+    EllpackMatrix *result = symbolic != NULL ? allocate_result_matrix(symbolic) : NULL;
+    free_symbolic_product(symbolic);
+    bool test_res = result != NULL;
+
+    MatrixStorage storage = test->storage == STORAGE_AUTO ? select_storage(a, b, version) : test->storage;
+    if (storage == STORAGE_ELLPACK) {
+        compact_ellpack_indices(a, test->index_bits);
+        compact_ellpack_indices(b, test->index_bits);
+    }
+    MatrixStorage a_storage = operand_storage(storage, 'A');
+    MatrixStorage b_storage = operand_storage(storage, 'B');
+    void *a_operand = convert_operand(a, &options, a_storage);
+    void *b_operand = convert_operand(b, &options, b_storage);
+    test_res = test_res && a_operand != NULL && b_operand != NULL;
+    if (test_res) {
+        storage_multiplication(storage, version)(a_operand, b_operand, result);
+    }
+    if (a_operand != a) {
+        free_operand(a_operand, a_storage);
+    }
+    if (b_operand != b) {
+        free_operand(b_operand, b_storage);
+    }
+    free_ellpack_matrix(a);
+    free_ellpack_matrix(b);
+
+    if (reordering != NULL) {
+        test_res = test_res && restore_result_order(result, reordering) == 'S';
+        free_reordering(reordering);
+    }
+    test_res = test_res && compare_result(result, normal_res);
+    free_ellpack_matrix(result);
+    return test_res;
+}
+
+//values slab for the pattern of a matrix with new random one-decimal values between -100 and 100
+float *create_random_values(const EllpackMatrix *pattern) {
+    float *values = (float *) calloc(pattern->rows * pattern->stride, sizeof(float));
+    if (values == NULL) {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "values slab");
+        return NULL;
+    }
+    for (uint64_t row = 0; row < pattern->rows; row++) {
+        for (uint64_t j = 0; j < ellpack_row_length(pattern, row); j++) {
+            values[row * pattern->stride + j] = (float) (rand() % 2001 - 1000) / 10.0F;
+        }
+    }
+    return values;
+}
+
+//dense matrix of the pattern of a matrix with the values of a values slab
+float **convert_values_to_normal(const EllpackMatrix *pattern, const float *values) {
+    float **normal = allocate_2d_float_array(pattern->rows, pattern->cols);
+    if (normal == NULL) {
+        return NULL;
+    }
+    for (uint64_t row = 0; row < pattern->rows; row++) {
+        for (uint64_t j = 0; j < ellpack_row_length(pattern, row); j++) {
+            normal[row][ellpack_index(pattern, row, j)] = values[row * pattern->stride + j];
+        }
+    }
+    return normal;
+}
+
+//plan for the patterns of test_a and test_b, executed with their values and then with new values of the same patterns
+bool run_plan_test(const EllpackMatrix *test_a, const EllpackMatrix *test_b, float **normal_res, int version) {
+    EllpackPlanOptions options;
+    default_plan_options(&options);
+    options.parallel = version == 2;
+    EllpackPlan *plan = NULL;
+    EllpackMatrix *result = NULL;
+    if (ellpack_plan(test_a, test_b, &options, &plan) != ELLPACK_SUCCESS || ellpack_plan_allocate_result(plan, &result) != ELLPACK_SUCCESS) {
+        free_ellpack_plan(plan);
+        return false;
+    }
+    bool test_res = ellpack_execute(plan, test_a->values, test_b->values, result) == ELLPACK_SUCCESS && compare_result(result, normal_res);
+
+    float *a_values = create_random_values(test_a);
+    float *b_values = create_random_values(test_b);
+    float **normal_a = a_values != NULL ? convert_values_to_normal(test_a, a_values) : NULL;
+    float **normal_b = b_values != NULL ? convert_values_to_normal(test_b, b_values) : NULL;
+    float **normal_new = NULL;
+    if (normal_a != NULL && normal_b != NULL) {
+        normal_new = normal_matrix_multiplication(normal_a, normal_b, test_a->rows, test_a->cols, test_b->rows, test_b->cols);
+    }
+    test_res = test_res && normal_new != NULL && ellpack_execute(plan, a_values, b_values, result) == ELLPACK_SUCCESS && compare_result(result, normal_new);
+
+    if (normal_new != NULL) {
+        free_2d_float_array(normal_new, test_a->rows);
+    }
+    if (normal_a != NULL) {
+        free_2d_float_array(normal_a, test_a->rows);
+    }
+    if (normal_b != NULL) {
+        free_2d_float_array(normal_b, test_b->rows);
+    }
+    free(a_values);
+    free(b_values);
+    free_ellpack_matrix(result);
+    free_ellpack_plan(plan);
+    return test_res;
+}
+
+//the plan errors of a B with other rows than the columns of A and of a result of another shape than the product
+bool run_plan_error_test(const EllpackMatrix *test_a, const EllpackMatrix *test_b) {
+    EllpackMatrix *wrong_b = create_random_ellpack_matrix(test_a->cols + 1, test_b->cols, 1);
+    EllpackMatrix *wrong_result = allocate_ellpack_matrix(test_a->rows + 1, test_b->cols, 1);
+    EllpackPlan *plan = NULL;
+    bool test_res = wrong_b != NULL && wrong_result != NULL;
+    test_res = test_res && ellpack_plan(test_a, wrong_b, NULL, &plan) == ELLPACK_INVALID_DIMENSIONS && plan == NULL;
+    test_res = test_res && ellpack_plan(test_a, test_b, NULL, &plan) == ELLPACK_SUCCESS;
+    test_res = test_res && ellpack_execute(plan, test_a->values, test_b->values, wrong_result) == ELLPACK_INVALID_RESULT;
+    free_ellpack_plan(plan);
+    free_ellpack_matrix(wrong_b);
+    free_ellpack_matrix(wrong_result);
+    return test_res;
+}
+
+//writable copy of a matrix with 64-bit indices, NULL on failure
+EllpackMatrix *copy_ellpack_matrix(const EllpackMatrix *matrix) {
+    EllpackMatrix *copy = allocate_ellpack_matrix(matrix->rows, matrix->cols, matrix->ellpack_cols);
+    if (copy == NULL) {
+        return NULL;
+    }
+    memcpy(copy->values, matrix->values, matrix->rows * matrix->stride * sizeof(float));
+    memcpy(copy->indices, matrix->indices, matrix->rows * matrix->stride * sizeof(uint64_t));
+    memcpy(copy->row_lengths, matrix->row_lengths, matrix->rows * sizeof(uint64_t));
+    return copy;
+}
+
+//plans for B patterns with an index out of bounds, a repeated index and a row longer than ellpack_cols in row 0
+bool run_plan_pattern_test(const EllpackMatrix *test_a, const EllpackMatrix *test_b) {
+    EllpackMatrix *bad_b = copy_ellpack_matrix(test_b);
+    if (bad_b == NULL || ellpack_row_length(bad_b, 0) < 2) {
+        free_ellpack_matrix(bad_b);
+        return false;
+    }
+    uint64_t *row_indices = ellpack_row_indices(bad_b, 0);
+    uint64_t first = row_indices[0];
+    uint64_t second = row_indices[1];
+    uint64_t length = bad_b->row_lengths[0];
+    EllpackPlan *plan = NULL;
+
+    row_indices[0] = bad_b->cols;
+    bool test_res = ellpack_plan(test_a, bad_b, NULL, &plan) == ELLPACK_INVALID_ARGUMENT && plan == NULL;
+    row_indices[0] = first;
+    row_indices[1] = first;
+    test_res = test_res && ellpack_plan(test_a, bad_b, NULL, &plan) == ELLPACK_INVALID_ARGUMENT && plan == NULL;
+    row_indices[1] = second;
+    bad_b->row_lengths[0] = bad_b->ellpack_cols + 1;
+    test_res = test_res && ellpack_plan(test_a, bad_b, NULL, &plan) == ELLPACK_INVALID_ARGUMENT && plan == NULL;
+    bad_b->row_lengths[0] = length;
+
+    //the restored copy is a valid pattern again
+    test_res = test_res && ellpack_plan(test_a, bad_b, NULL, &plan) == ELLPACK_SUCCESS;
+    free_ellpack_plan(plan);
+    free_ellpack_matrix(bad_b);
+    return test_res;
+}
+
 //testing multiplication results with normal matrix multiplication results
 double run_multiplication_test(FILE * file, uint64_t rows_a, uint64_t cols_a, uint64_t ellpack_cols_a, uint64_t rows_b, uint64_t cols_b, uint64_t ellpack_cols_b, int version){
     fprintf(file, "testing matrix multiplication with version %i:\n", version);
@@ -295,7 +472,12 @@ double run_multiplication_test(FILE * file, uint64_t rows_a, uint64_t cols_a, ui
     if(test_a == NULL || test_b == NULL){
         exit(EXIT_FAILURE);
     }
-    float** result_pointer = allocate_2d_float_array(rows_a,cols_b);
+    SymbolicProduct* symbolic = symbolic_multiplication(test_a, test_b, version == 2);
+    if(symbolic == NULL){
+        exit(EXIT_FAILURE);
+    }
+    EllpackMatrix* result_pointer = allocate_result_matrix(symbolic);
+    free_symbolic_product(symbolic);
     if(result_pointer == NULL){
         exit(EXIT_FAILURE);
     }
@@ -331,7 +513,7 @@ double run_multiplication_test(FILE * file, uint64_t rows_a, uint64_t cols_a, ui
     test_dump_ellpack_matrix(file, test_b);
     fprintf(file, "\n");
     fprintf(file, "result: \n");
-    test_dump_result_to_ellpack(file, result_pointer, rows_a,cols_b);
+    test_dump_result_to_ellpack(file, result_pointer);
     fprintf(file, "\n");
 
     //test multiplication result
@@ -345,7 +527,8 @@ double run_multiplication_test(FILE * file, uint64_t rows_a, uint64_t cols_a, ui
     clock_gettime(CLOCK_MONOTONIC, &end);
     elapsed_time_normal = (end.tv_sec - start.tv_sec) * 1.0e9 + (end.tv_nsec - start.tv_nsec);
 
-    bool test_res = compare(result_pointer, normal_res, rows_a,cols_b);
+    float** normal_result = convert_ellpack_to_normal(result_pointer);
+    bool test_res = compare(normal_result, normal_res, rows_a,cols_b);
     if(test_res){
         fprintf(file, "multiplication successful\n");
         fprintf(file, "accepted float variation tolerance was: 1.0\n");
@@ -354,13 +537,36 @@ double run_multiplication_test(FILE * file, uint64_t rows_a, uint64_t cols_a, ui
         fprintf(file, "accepted float variation tolerance was: 1.0, variations are shown on the console, adjust the tolerance\n");
     }
 
+    //the binary round trip of the operands, and for V1/V2 the same product in the other storages
+    EllpackMatrix* loaded_a = binary_round_trip(test_a);
+    EllpackMatrix* loaded_b = binary_round_trip(test_b);
+    bool round_trip = loaded_a != NULL && loaded_b != NULL && same_ellpack_matrix(test_a, loaded_a) && same_ellpack_matrix(test_b, loaded_b);
+    free_ellpack_matrix(loaded_a);
+    free_ellpack_matrix(loaded_b);
+    fprintf(file, "binary round trip %s\n", round_trip ? "successful" : "failed");
+    if (version != 0) {
+        for (size_t i = 0; i < sizeof(storage_tests) / sizeof(storage_tests[0]); i++) {
+            bool storage_res = run_storage_test(&storage_tests[i], test_a, test_b, normal_res, version);
+            fprintf(file, "%s: multiplication %s\n", storage_tests[i].name, storage_res ? "successful" : "failed");
+        }
+    }
+
+    //plan / execute API
+    bool plan_res = run_plan_test(test_a, test_b, normal_res, version);
+    fprintf(file, "plan, executed with two value slabs: multiplication %s\n", plan_res ? "successful" : "failed");
+    bool plan_error_res = run_plan_error_test(test_a, test_b);
+    fprintf(file, "plan errors (invalid dimensions, invalid result) %s\n", plan_error_res ? "successful" : "failed");
+    bool plan_pattern_res = run_plan_pattern_test(test_a, test_b);
+    fprintf(file, "plan pattern checks (index out of bounds, repeated index, row too long) %s\n", plan_pattern_res ? "successful" : "failed");
+
     fprintf(file, "benchmarking: \n");
     fprintf(file, "ellpack matrix multiplication took: %f seconds\n", elapsed_time / 1.0e9 - 1);
     fprintf(file, "normal matrix multiplication took: %f seconds\n", elapsed_time_normal / 1.0e9 - 1);
 
 
 
-    free_2d_float_array(result_pointer,rows_a);
+    free_2d_float_array(normal_result,rows_a);
+    free_ellpack_matrix(result_pointer);
     free_2d_float_array(normal_a,rows_a);
     free_2d_float_array(normal_b,rows_b);
     free_2d_float_array(normal_res,rows_a);
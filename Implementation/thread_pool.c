@@ -0,0 +1,284 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "thread_pool.h"
+#include "utils.h"
+
+// WorkDeque struct
+// Blocks [head, tail) of the current job not taken yet. The owner takes from the head,
+// thieves take from the tail. One cache line per deque so the locks do not share lines.
+typedef struct
+{
+    pthread_mutex_t lock;
+    uint64_t head;
+    uint64_t tail;
+} __attribute__((aligned(64))) WorkDeque;
+
+typedef struct
+{
+    unsigned int size;
+    pthread_t *threads;
+    WorkDeque *deques;
+
+    pthread_mutex_t lock;
+    pthread_cond_t job_ready;
+    pthread_cond_t job_done;
+    uint64_t generation;   // incremented for every job
+    unsigned int active;   // background workers still busy with the current job
+    char shutdown;
+
+    // current job
+    const uint64_t *block_bounds;
+    RowBlockTask task;
+    void *context;
+} ThreadPool;
+
+static ThreadPool pool;
+static char pool_started = 0;
+static pthread_mutex_t pool_init_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t pool_run_lock = PTHREAD_MUTEX_INITIALIZER; // one job at a time
+
+/*
+ * Take the next block of the worker's own deque, or steal one from the tail of another deque
+ * Returns 0 once every deque is empty
+ */
+static int take_block(unsigned int worker, uint64_t *block)
+{
+    WorkDeque *own = &pool.deques[worker];
+    pthread_mutex_lock(&own->lock);
+    if (own->head < own->tail)
+    {
+        *block = own->head++;
+        pthread_mutex_unlock(&own->lock);
+        return 1;
+    }
+    pthread_mutex_unlock(&own->lock);
+
+    for (unsigned int i = 1; i < pool.size; i++)
+    {
+        WorkDeque *victim = &pool.deques[(worker + i) % pool.size];
+        pthread_mutex_lock(&victim->lock);
+        if (victim->head < victim->tail)
+        {
+            *block = --victim->tail;
+            pthread_mutex_unlock(&victim->lock);
+            return 1;
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return 0;
+}
+
+static void run_job(unsigned int worker)
+{
+    uint64_t block;
+    while (take_block(worker, &block))
+    {
+        pool.task(pool.context, pool.block_bounds[block], pool.block_bounds[block + 1], worker);
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    unsigned int worker = (unsigned int)(uintptr_t)arg;
+    uint64_t seen_generation = 0;
+
+    pthread_mutex_lock(&pool.lock);
+    while (1)
+    {
+        while (!pool.shutdown && pool.generation == seen_generation)
+        {
+            pthread_cond_wait(&pool.job_ready, &pool.lock);
+        }
+        if (pool.shutdown)
+        {
+            break;
+        }
+        seen_generation = pool.generation;
+        pthread_mutex_unlock(&pool.lock);
+
+        run_job(worker);
+
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.active == 0)
+        {
+            pthread_cond_signal(&pool.job_done);
+        }
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+/*
+ * Start the pool with num_threads workers (the caller included), 0 means one per online core.
+ * Returns 'F' if the pool is already running or could not be started.
+ */
+char thread_pool_init(unsigned int num_threads)
+{
+    pthread_mutex_lock(&pool_init_lock);
+    if (pool_started)
+    {
+        pthread_mutex_unlock(&pool_init_lock);
+        return 'F';
+    }
+
+    if (num_threads == 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = cores > 0 ? (unsigned int)cores : 1;
+    }
+
+    pool.size = num_threads;
+    pool.generation = 0;
+    pool.active = 0;
+    pool.shutdown = 0;
+    pool.threads = (pthread_t *)calloc(num_threads, sizeof(pthread_t));
+    pool.deques = (WorkDeque *)aligned_alloc(64, num_threads * sizeof(WorkDeque));
+    if (pool.threads == NULL || pool.deques == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "thread pool");
+        free(pool.threads);
+        free(pool.deques);
+        pthread_mutex_unlock(&pool_init_lock);
+        return 'F';
+    }
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.job_ready, NULL);
+    pthread_cond_init(&pool.job_done, NULL);
+    for (unsigned int i = 0; i < num_threads; i++)
+    {
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+        pool.deques[i].head = 0;
+        pool.deques[i].tail = 0;
+    }
+
+    for (unsigned int i = 1; i < num_threads; i++)
+    {
+        if (pthread_create(&pool.threads[i], NULL, worker_main, (void *)(uintptr_t)i) != 0)
+        {
+            // run with the workers that did start
+            fprintf(stderr, "Warning: could only start %u of %u threads\n", i, num_threads);
+            pool.size = i;
+            break;
+        }
+    }
+
+    pool_started = 1;
+    atexit(thread_pool_shutdown);
+    pthread_mutex_unlock(&pool_init_lock);
+    return 'S';
+}
+
+/*
+ * Number of workers of the pool (caller included), starts the pool with one worker per core if needed
+ */
+unsigned int thread_pool_size(void)
+{
+    if (!pool_started)
+    {
+        thread_pool_init(0);
+    }
+    return pool_started ? pool.size : 1;
+}
+
+/*
+ * Run task over the blocks [block_bounds[i], block_bounds[i + 1]) for i < block_count and wait for all of them
+ * Worker w starts with the w-th contiguous share of the blocks
+ */
+void thread_pool_run(const uint64_t *block_bounds, uint64_t block_count, RowBlockTask task, void *context)
+{
+    unsigned int size = thread_pool_size();
+    if (size == 1)
+    {
+        for (uint64_t block = 0; block < block_count; block++)
+        {
+            task(context, block_bounds[block], block_bounds[block + 1], 0);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool_run_lock);
+    for (unsigned int i = 0; i < size; i++)
+    {
+        pool.deques[i].head = block_count * i / size;
+        pool.deques[i].tail = block_count * (i + 1) / size;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.block_bounds = block_bounds;
+    pool.task = task;
+    pool.context = context;
+    pool.active = size - 1;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.job_ready);
+    pthread_mutex_unlock(&pool.lock);
+
+    run_job(0);
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.active > 0)
+    {
+        pthread_cond_wait(&pool.job_done, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    pthread_mutex_unlock(&pool_run_lock);
+}
+
+/*
+ * Run task over the rows [0, rows) cut into THREAD_POOL_BLOCKS_PER_WORKER equal blocks per worker
+ */
+void thread_pool_run_rows(uint64_t rows, RowBlockTask task, void *context)
+{
+    uint64_t block_count = (uint64_t)thread_pool_size() * THREAD_POOL_BLOCKS_PER_WORKER;
+    if (block_count > rows)
+    {
+        block_count = rows > 0 ? rows : 1;
+    }
+    uint64_t *block_bounds = (uint64_t *)malloc((block_count + 1) * sizeof(uint64_t));
+    if (block_bounds == NULL)
+    {
+        // no memory for the block list, run everything as one block on the caller
+        task(context, 0, rows, 0);
+        return;
+    }
+    for (uint64_t i = 0; i <= block_count; i++)
+    {
+        block_bounds[i] = rows * i / block_count;
+    }
+    thread_pool_run(block_bounds, block_count, task, context);
+    free(block_bounds);
+}
+
+/*
+ * Stop and join the background workers, registered with atexit by thread_pool_init
+ */
+void thread_pool_shutdown(void)
+{
+    pthread_mutex_lock(&pool_init_lock);
+    if (!pool_started)
+    {
+        pthread_mutex_unlock(&pool_init_lock);
+        return;
+    }
+    pthread_mutex_lock(&pool.lock);
+    pool.shutdown = 1;
+    pthread_cond_broadcast(&pool.job_ready);
+    pthread_mutex_unlock(&pool.lock);
+    for (unsigned int i = 1; i < pool.size; i++)
+    {
+        pthread_join(pool.threads[i], NULL);
+    }
+    for (unsigned int i = 0; i < pool.size; i++)
+    {
+        pthread_mutex_destroy(&pool.deques[i].lock);
+    }
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.job_ready);
+    pthread_cond_destroy(&pool.job_done);
+    free(pool.threads);
+    free(pool.deques);
+    pool_started = 0;
+    pthread_mutex_unlock(&pool_init_lock);
+}
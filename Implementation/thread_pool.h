@@ -0,0 +1,27 @@
+#ifndef FINAL_THREAD_POOL_H
+#define FINAL_THREAD_POOL_H
+
+#include <stdint.h>
+
+// Process-lifetime thread pool with work-stealing deques of row blocks.
+// The pool is started once (thread_pool_init or on first use) and reused by every parallel phase.
+// A job is a list of row blocks; every worker starts on its own contiguous share of the blocks and,
+// once that is exhausted, steals blocks from the far end of the other workers' deques.
+// The calling thread takes part as worker 0, so a pool of size N starts N - 1 threads.
+
+#define THREAD_POOL_BLOCKS_PER_WORKER 16 // uniform jobs are cut into this many blocks per worker
+
+// task run for the rows [start, end) by pool worker `worker` (0 <= worker < thread_pool_size())
+typedef void (*RowBlockTask)(void *context, uint64_t start, uint64_t end, unsigned int worker);
+
+char thread_pool_init(unsigned int num_threads);
+
+unsigned int thread_pool_size(void);
+
+void thread_pool_run(const uint64_t *block_bounds, uint64_t block_count, RowBlockTask task, void *context);
+
+void thread_pool_run_rows(uint64_t rows, RowBlockTask task, void *context);
+
+void thread_pool_shutdown(void);
+
+#endif
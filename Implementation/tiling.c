@@ -0,0 +1,490 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "tiling.h"
+#include "optimizations.h"
+#include "accumulator.h"
+#include "thread_pool.h"
+
+#define ERR_INVALID_TILE_SPEC "Error: Invalid tile shape '%s', expected <cols>[,<rows>] with cols >= 1\n"
+
+#define TILE_COLUMN_BYTES (sizeof(float) + sizeof(char))   // dense accumulator value and occupancy flag
+#define TILE_B_ENTRY_BYTES (sizeof(float) + sizeof(uint64_t))
+#define TILE_COLS_ALIGN 64                                 // a tile starts on a cache line of accumulator values
+
+// SortEntry struct, a B row entry while its row is sorted by column
+typedef struct
+{
+    uint64_t col;       // distinct within a row
+    float value;
+} SortEntry;
+
+// TileCursors struct, per worker: the entries of every A entry's B row that the next tile starts at
+typedef struct
+{
+    uint64_t *positions;  // next entry of the B row
+    uint64_t *stops;      // end of the tile's entries, then end of the B row
+    uint64_t capacity;
+} TileCursors;
+
+// TiledMultiplication struct, shared by the workers of one tiled multiplication
+typedef struct
+{
+    const EllpackMatrix *a;
+    const CsrMatrix *b;
+    EllpackMatrix *result;
+    uint64_t tile_cols;
+    SparseAccumulator **accumulators; // one per worker, allocated on its first block
+    TileCursors *cursors;             // one per worker
+    char *status;                     // one per worker, 'F' if it ran out of memory
+} TiledMultiplication;
+
+/*
+ * Parse "<cols>[,<rows>]", rows 0 (or missing) sizes the row blocks from the cache
+ */
+char parse_tile_options(const char *spec, uint64_t *tile_cols, uint64_t *tile_rows)
+{
+    unsigned long long cols, rows = TILE_AUTO;
+    char trailing;
+    int fields = sscanf(spec, "%llu,%llu%c", &cols, &rows, &trailing);
+    if ((fields != 1 && fields != 2) || cols == 0)
+    {
+        fprintf(stderr, ERR_INVALID_TILE_SPEC, spec);
+        return 'F';
+    }
+    if (fields == 1 && sscanf(spec, "%llu%c", &cols, &trailing) != 1)
+    {
+        fprintf(stderr, ERR_INVALID_TILE_SPEC, spec);
+        return 'F';
+    }
+    *tile_cols = cols;
+    *tile_rows = rows;
+    return 'S';
+}
+
+static int compare_sort_entries(const void *lhs, const void *rhs)
+{
+    const SortEntry *l = (const SortEntry *)lhs;
+    const SortEntry *r = (const SortEntry *)rhs;
+    return (l->col > r->col) - (l->col < r->col);
+}
+
+/*
+ * Sort the entries of every CSR row by column, rows that are sorted already are left alone.
+ * Returns 'F' if the sort buffer could not be allocated.
+ */
+static char sort_csr_rows(CsrMatrix *matrix)
+{
+    uint64_t longest = 0;
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        uint64_t length = csr_row_length(matrix, row);
+        longest = length > longest ? length : longest;
+    }
+    SortEntry *entries = (SortEntry *)malloc((longest > 0 ? longest : 1) * sizeof(SortEntry));
+    if (entries == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "tile sort buffer");
+        return 'F';
+    }
+
+    for (uint64_t row = 0; row < matrix->rows; row++)
+    {
+        uint64_t offset = matrix->row_offsets[row];
+        uint64_t length = csr_row_length(matrix, row);
+        uint64_t j = 1;
+        while (j < length && matrix->indices[offset + j - 1] <= matrix->indices[offset + j])
+        {
+            j++;
+        }
+        if (j >= length)
+        {
+            continue;
+        }
+        for (j = 0; j < length; j++)
+        {
+            entries[j].col = matrix->indices[offset + j];
+            entries[j].value = matrix->values[offset + j];
+        }
+        qsort(entries, length, sizeof(SortEntry), compare_sort_entries);
+        for (j = 0; j < length; j++)
+        {
+            matrix->indices[offset + j] = entries[j].col;
+            matrix->values[offset + j] = entries[j].value;
+        }
+    }
+    free(entries);
+    return 'S';
+}
+
+/*
+ * Convert an ELLPACK matrix to the B operand of the tiled multiplication.
+ * Returns NULL if it does not fit into memory.
+ */
+TiledMatrix *ellpack_to_tiled(const EllpackMatrix *matrix, uint64_t tile_cols, uint64_t tile_rows)
+{
+    TiledMatrix *tiled = (TiledMatrix *)calloc(1, sizeof(TiledMatrix));
+    if (tiled == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "tiled matrix structure");
+        return NULL;
+    }
+    tiled->tile_cols = tile_cols;
+    tiled->tile_rows = tile_rows;
+    tiled->csr = ellpack_to_csr(matrix);
+    if (tiled->csr == NULL || sort_csr_rows(tiled->csr) != 'S')
+    {
+        free_tiled_matrix(tiled);
+        return NULL;
+    }
+    return tiled;
+}
+
+/*
+ * Helper method to free memory of a tiled matrix
+ */
+void free_tiled_matrix(TiledMatrix *matrix)
+{
+    if (matrix != NULL)
+    {
+        free_csr_matrix(matrix->csr);
+        free(matrix);
+    }
+}
+
+/*
+ * Cache size of sysconf `name`, fallback if the system does not report it
+ */
+static uint64_t cache_bytes(int name, uint64_t fallback)
+{
+    long bytes = sysconf(name);
+    return bytes > 0 ? (uint64_t)bytes : fallback;
+}
+
+/*
+ * Tile width: the dense accumulator window (value and flag per column) takes 1 / TILE_L2_FRACTION of L2,
+ * the rest is left to the B entries streaming through, the touched list and the hash table. Half of L2 was
+ * measured slower than no tiles at all on uniform 200k x 200k products, a sixteenth 25% faster.
+ * A multiple of a cache line of values, at least one.
+ */
+static uint64_t auto_tile_cols(void)
+{
+    uint64_t cols = cache_bytes(_SC_LEVEL2_CACHE_SIZE, TILE_DEFAULT_L2_BYTES) / TILE_L2_FRACTION / TILE_COLUMN_BYTES;
+    cols -= cols % TILE_COLS_ALIGN;
+    return cols > 0 ? cols : TILE_COLS_ALIGN;
+}
+
+/*
+ * Cut the rows of A into blocks, bounds gets block_count + 1 entries. With tile_rows every block has that many rows.
+ * Otherwise rows are added to a block while the B entries it reads (its flops) fit into half of the worker's share
+ * of the LLC, and with several workers no block takes more than its share of THREAD_POOL_BLOCKS_PER_WORKER blocks
+ * per worker, so the pool has blocks to balance. Returns NULL if the bounds could not be allocated.
+ */
+static uint64_t *tile_row_bounds(const EllpackMatrix *a_matrix, const CsrMatrix *b_matrix, uint64_t tile_rows, unsigned int workers, uint64_t *block_count)
+{
+    uint64_t rows = a_matrix->rows;
+    uint64_t *bounds = (uint64_t *)malloc((rows + 1) * sizeof(uint64_t));
+    if (bounds == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "tile row bounds");
+        return NULL;
+    }
+
+    uint64_t count = 0;
+    bounds[0] = 0;
+    if (tile_rows != TILE_AUTO)
+    {
+        while (rows - bounds[count] > tile_rows)
+        {
+            bounds[count + 1] = bounds[count] + tile_rows;
+            count++;
+        }
+    }
+    else
+    {
+        uint64_t total_flops = 0;
+        for (uint64_t a_row = 0; a_row < rows; a_row++)
+        {
+            uint64_t a_length = ellpack_row_length(a_matrix, a_row);
+            for (uint64_t a_ellpack_col = 0; a_ellpack_col < a_length; a_ellpack_col++)
+            {
+                total_flops += csr_row_length(b_matrix, ellpack_row_indices(a_matrix, a_row)[a_ellpack_col]);
+            }
+        }
+        uint64_t budget = cache_bytes(_SC_LEVEL3_CACHE_SIZE, TILE_DEFAULT_LLC_BYTES) / workers / 2 / TILE_B_ENTRY_BYTES;
+        if (workers > 1)
+        {
+            uint64_t share = total_flops / ((uint64_t)workers * THREAD_POOL_BLOCKS_PER_WORKER);
+            budget = share < budget ? share : budget;
+        }
+
+        uint64_t block_flops = 0;
+        for (uint64_t a_row = 0; a_row < rows; a_row++)
+        {
+            uint64_t flops = 0;
+            uint64_t a_length = ellpack_row_length(a_matrix, a_row);
+            for (uint64_t a_ellpack_col = 0; a_ellpack_col < a_length; a_ellpack_col++)
+            {
+                flops += csr_row_length(b_matrix, ellpack_row_indices(a_matrix, a_row)[a_ellpack_col]);
+            }
+            if (a_row > bounds[count] && block_flops + flops > budget)
+            {
+                bounds[++count] = a_row;
+                block_flops = 0;
+            }
+            block_flops += flops;
+        }
+    }
+    bounds[++count] = rows;
+    *block_count = count;
+    return bounds;
+}
+
+/*
+ * Make room for `entries` cursors
+ */
+static char reserve_cursors(TileCursors *cursors, uint64_t entries)
+{
+    if (entries <= cursors->capacity)
+    {
+        return 'S';
+    }
+    free(cursors->positions);
+    free(cursors->stops);
+    cursors->positions = (uint64_t *)malloc(entries * sizeof(uint64_t));
+    cursors->stops = (uint64_t *)malloc(entries * sizeof(uint64_t));
+    if (cursors->positions == NULL || cursors->stops == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "tile cursors");
+        cursors->capacity = 0;
+        return 'F';
+    }
+    cursors->capacity = entries;
+    return 'S';
+}
+
+/*
+ * Accumulate the part of row a_row of A * B inside the tile [.., tile_end) and append it to the result row.
+ * positions/stops hold a cursor for every entry of the A row, the positions move on to the next tile.
+ */
+static char accumulate_row_tile(const TiledMultiplication *data, SparseAccumulator *spa, uint64_t a_row, uint64_t tile_width, uint64_t tile_end, uint64_t *positions, uint64_t *stops)
+{
+    const CsrMatrix *b_matrix = data->b;
+    const float *a_row_values = ellpack_row_values(data->a, a_row);
+    const uint64_t *a_row_indices = ellpack_row_indices(data->a, a_row);
+    uint64_t a_length = ellpack_row_length(data->a, a_row);
+
+    uint64_t flops = 0;
+    for (uint64_t j = 0; j < a_length; j++)
+    {
+        uint64_t row_end = b_matrix->row_offsets[a_row_indices[j] + 1];
+        uint64_t stop = positions[j];
+        while (stop < row_end && b_matrix->indices[stop] < tile_end)
+        {
+            stop++;
+        }
+        stops[j] = stop;
+        flops += stop - positions[j];
+    }
+    if (flops == 0)
+    {
+        return 'S';
+    }
+
+    AccumulatorKind kind = choose_accumulator(tile_width, flops);
+    if (spa_begin_row(spa, kind, flops) != 'S')
+    {
+        return 'F';
+    }
+    ScaleRowKernel scale_row = current_simd_kernel()->kernel;
+    for (uint64_t j = 0; j < a_length; j++)
+    {
+        uint64_t position = positions[j];
+        uint64_t length = stops[j] - position;
+        if (kind == ACCUMULATOR_DENSE)
+        {
+            scale_row(a_row_values[j], b_matrix->values + position, b_matrix->indices + position, spa->values, length);
+            spa_mark(spa, b_matrix->indices + position, length);
+        }
+        else
+        {
+            spa_scale_row(spa, a_row_values[j], b_matrix->values + position, b_matrix->indices + position, length);
+        }
+        positions[j] = stops[j];
+    }
+    spa_append_row(spa, data->result, a_row);
+    return 'S';
+}
+
+/*
+ * Multiply the A rows [start, end) one column tile after the other, run by pool worker `worker`
+ */
+static void multiply_tiled_block(void *arg, uint64_t start, uint64_t end, unsigned int worker)
+{
+    TiledMultiplication *data = (TiledMultiplication *)arg;
+    const EllpackMatrix *a_matrix = data->a;
+    EllpackMatrix *result = data->result;
+    if (data->status[worker] != 'S')
+    {
+        return;
+    }
+    if (data->accumulators[worker] == NULL)
+    {
+        data->accumulators[worker] = allocate_sparse_accumulator(data->b->cols);
+        if (data->accumulators[worker] == NULL)
+        {
+            data->status[worker] = 'F';
+            return;
+        }
+    }
+    SparseAccumulator *spa = data->accumulators[worker];
+
+    // every entry of the block's A rows starts at the first entry of its B row, the tiles outside the columns
+    // [first_col, end_col) of these B rows have nothing to do for the block (most of them for banded matrices)
+    const CsrMatrix *b_matrix = data->b;
+    TileCursors *cursors = &data->cursors[worker];
+    uint64_t entries = 0;
+    for (uint64_t a_row = start; a_row < end; a_row++)
+    {
+        entries += ellpack_row_length(a_matrix, a_row);
+    }
+    if (reserve_cursors(cursors, entries) != 'S')
+    {
+        data->status[worker] = 'F';
+        return;
+    }
+    uint64_t entry = 0;
+    uint64_t first_col = b_matrix->cols;
+    uint64_t end_col = 0;
+    for (uint64_t a_row = start; a_row < end; a_row++)
+    {
+        uint64_t a_length = ellpack_row_length(a_matrix, a_row);
+        for (uint64_t j = 0; j < a_length; j++)
+        {
+            uint64_t b_row = ellpack_row_indices(a_matrix, a_row)[j];
+            uint64_t b_first = b_matrix->row_offsets[b_row];
+            uint64_t b_end = b_matrix->row_offsets[b_row + 1];
+            cursors->positions[entry++] = b_first;
+            if (b_end > b_first)
+            {
+                first_col = b_matrix->indices[b_first] < first_col ? b_matrix->indices[b_first] : first_col;
+                end_col = b_matrix->indices[b_end - 1] >= end_col ? b_matrix->indices[b_end - 1] + 1 : end_col;
+            }
+        }
+        result->row_lengths[a_row] = 0;
+    }
+
+    uint64_t tile_end;
+    for (uint64_t tile_first = first_col - first_col % data->tile_cols; tile_first < end_col; tile_first = tile_end)
+    {
+        tile_end = b_matrix->cols - tile_first > data->tile_cols ? tile_first + data->tile_cols : b_matrix->cols;
+        spa_set_window(spa, tile_first, tile_end);
+        entry = 0;
+        for (uint64_t a_row = start; a_row < end; a_row++)
+        {
+            if (accumulate_row_tile(data, spa, a_row, tile_end - tile_first, tile_end, cursors->positions + entry, cursors->stops + entry) != 'S')
+            {
+                data->status[worker] = 'F';
+                return;
+            }
+            entry += ellpack_row_length(a_matrix, a_row);
+        }
+    }
+
+    // the rows were only appended to, clear what is left of them from a previous pass
+    for (uint64_t a_row = start; a_row < end; a_row++)
+    {
+        float *row_values = ellpack_row_values(result, a_row);
+        uint64_t *row_indices = ellpack_row_indices(result, a_row);
+        for (uint64_t j = result->row_lengths[a_row]; j < result->ellpack_cols; j++)
+        {
+            row_values[j] = 0.0F;
+            row_indices[j] = 0;
+        }
+    }
+}
+
+/*
+ * Numeric phase of A * B with A in ELLPACK and B tiled, on the calling thread (workers == 1) or on the thread pool
+ */
+static void tiled_multiplication(const EllpackMatrix *a_matrix, const TiledMatrix *b_matrix, EllpackMatrix *result, unsigned int workers)
+{
+    TiledMultiplication data;
+    data.a = a_matrix;
+    data.b = b_matrix->csr;
+    data.result = result;
+    data.tile_cols = b_matrix->tile_cols != TILE_AUTO ? b_matrix->tile_cols : auto_tile_cols();
+    data.accumulators = (SparseAccumulator **)calloc(workers, sizeof(SparseAccumulator *));
+    data.cursors = (TileCursors *)calloc(workers, sizeof(TileCursors));
+    data.status = (char *)malloc(workers * sizeof(char));
+
+    char status = 'F';
+    uint64_t block_count = 0;
+    uint64_t *bounds = NULL;
+    if (a_matrix->cols != b_matrix->csr->rows)
+    {
+        fprintf(stderr, ERR_INVALID_MATRIX_DIMENSIONS, a_matrix->cols, b_matrix->csr->rows);
+    }
+    else if (data.accumulators == NULL || data.cursors == NULL || data.status == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "thread data");
+    }
+    else if ((bounds = tile_row_bounds(a_matrix, b_matrix->csr, b_matrix->tile_rows, workers, &block_count)) != NULL)
+    {
+        memset(data.status, 'S', workers);
+        if (workers == 1)
+        {
+            for (uint64_t block = 0; block < block_count; block++)
+            {
+                multiply_tiled_block(&data, bounds[block], bounds[block + 1], 0);
+            }
+        }
+        else
+        {
+            thread_pool_run(bounds, block_count, multiply_tiled_block, &data);
+        }
+        status = 'S';
+        for (unsigned int i = 0; i < workers; i++)
+        {
+            status = data.status[i] != 'S' ? 'F' : status;
+        }
+    }
+
+    for (unsigned int i = 0; data.accumulators != NULL && data.cursors != NULL && i < workers; i++)
+    {
+        free_sparse_accumulator(data.accumulators[i]);
+        free(data.cursors[i].positions);
+        free(data.cursors[i].stops);
+    }
+    free(data.accumulators);
+    free(data.cursors);
+    free(data.status);
+    free(bounds);
+    if (status != 'S')
+    {
+        free_ellpack_matrix((EllpackMatrix *)a_matrix);
+        free_tiled_matrix((TiledMatrix *)b_matrix);
+        free_ellpack_matrix(result);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * function to multiply an EllpackMatrix by a TiledMatrix on the calling thread and save it to the result pointer (EllpackMatrix)
+ */
+void matr_mult_tiled(const void *a, const void *b, void *result)
+{
+    tiled_multiplication((const EllpackMatrix *)a, (const TiledMatrix *)b, (EllpackMatrix *)result, 1);
+}
+
+/*
+ * function to multiply an EllpackMatrix by a TiledMatrix on the thread pool
+ */
+void matr_mult_tiled_parallel(const void *a, const void *b, void *result)
+{
+    const EllpackMatrix *a_matrix = (const EllpackMatrix *)a;
+    unsigned int workers = thread_pool_size();
+    tiled_multiplication(a_matrix, (const TiledMatrix *)b, (EllpackMatrix *)result, a_matrix->rows <= 5 * workers ? 1 : workers);
+}
@@ -0,0 +1,42 @@
+#ifndef FINAL_TILING_H
+#define FINAL_TILING_H
+
+#include <stdint.h>
+#include "utils.h"
+#include "csr.h"
+
+// Column-tiled multiplication
+// The columns of B are cut into tiles and the rows of A into blocks. A block runs one column tile after the other:
+// every A row of the block only takes the entries of its B rows inside the tile, so the accumulator only touches
+// a tile wide window of the result row (sized to stay in L2), and the B rows of the block are read from the last
+// level cache again for every tile (the blocks are sized to keep them there). The tiles of a result row are appended
+// in column order, the row and the order of every sum are the same as without tiles.
+// B is kept in CSR with the entries of every row sorted by column, so the entries of a row inside a tile are
+// contiguous and start where the ones of the previous tile ended.
+
+#define TILE_AUTO 0                        // size taken from the cache sizes (sysconf) at multiplication time
+#define TILE_DEFAULT_L2_BYTES (256 << 10)  // cache sizes if sysconf does not know them
+#define TILE_DEFAULT_LLC_BYTES (8 << 20)
+#ifndef TILE_L2_FRACTION
+#define TILE_L2_FRACTION 16                // the accumulator window of a tile takes this part of L2
+#endif
+
+// TiledMatrix struct, B of the column-tiled multiplication (A stays ELLPACK)
+typedef struct
+{
+    CsrMatrix *csr;      // rows sorted by column
+    uint64_t tile_cols;  // columns per tile, TILE_AUTO: 1 / TILE_L2_FRACTION of L2 for the accumulator window
+    uint64_t tile_rows;  // A rows per block, TILE_AUTO: as many as keep the B entries they read in the LLC
+} TiledMatrix;
+
+char parse_tile_options(const char *spec, uint64_t *tile_cols, uint64_t *tile_rows);
+
+TiledMatrix *ellpack_to_tiled(const EllpackMatrix *matrix, uint64_t tile_cols, uint64_t tile_rows);
+
+void free_tiled_matrix(TiledMatrix *matrix);
+
+void matr_mult_tiled(const void *a, const void *b, void *result);
+
+void matr_mult_tiled_parallel(const void *a, const void *b, void *result);
+
+#endif
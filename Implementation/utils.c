@@ -6,70 +6,265 @@
 #include <ctype.h>
 #include <limits.h>
 #include "utils.h"
+#include "ellpack_binary.h"
+#include "ellpack_writer.h"
 #include <math.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-EllpackMatrix *load_ellpack_matrix(const char *filename)
+// Parsing of the mapped input file
+// Tokens are parsed in place: a token is the text between two commas (or a comma and the line end),
+// empty tokens are skipped like strtok did and surrounding blanks are ignored.
+
+#define TOKEN_PRINT_MAX 64 // longest token printed in an error message
+
+// TextLine struct, the part of a line not parsed yet
+typedef struct
 {
-    FILE *file;
-    char *line = NULL;
-    size_t len = 0;
+    const char *pos;
+    const char *end; // the '\n' of the line or the end of the file
+} TextLine;
+
+static inline char is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
 
-    if (NULL == (file = fopen(filename, "r")))
+/*
+ * Start the line at *pos, returns 'F' if the file ends before it. *pos is moved to the next line.
+ */
+static char begin_line(const char **pos, const char *file_end, TextLine *line)
+{
+    if (*pos >= file_end)
     {
-        fprintf(stderr, ERR_OPEN_FILE_FAILED, filename);
-        return NULL;
+        return 'F';
+    }
+    const char *newline = (const char *)memchr(*pos, '\n', (size_t)(file_end - *pos));
+    line->pos = *pos;
+    line->end = newline != NULL ? newline : file_end;
+    *pos = newline != NULL ? newline + 1 : file_end;
+    return 'S';
+}
+
+/*
+ * Next non-empty token of the line without its surrounding blanks, returns 'F' at the end of the line
+ */
+static char next_token(TextLine *line, const char **token, size_t *length)
+{
+    const char *pos = line->pos;
+    while (1)
+    {
+        while (pos < line->end && (*pos == ',' || is_blank(*pos)))
+        {
+            pos++;
+        }
+        if (pos == line->end)
+        {
+            line->pos = pos;
+            return 'F';
+        }
+        const char *start = pos;
+        while (pos < line->end && *pos != ',')
+        {
+            pos++;
+        }
+        const char *stop = pos;
+        while (stop > start && is_blank(stop[-1]))
+        {
+            stop--;
+        }
+        if (stop > start)
+        {
+            *token = start;
+            *length = (size_t)(stop - start);
+            line->pos = pos;
+            return 'S';
+        }
+    }
+}
+
+/*
+ * Copy a token into a NUL-terminated buffer for an error message, long tokens are cut
+ */
+static const char *token_for_print(const char *token, size_t length, char buffer[TOKEN_PRINT_MAX])
+{
+    if (length >= TOKEN_PRINT_MAX)
+    {
+        length = TOKEN_PRINT_MAX - 1;
+    }
+    memcpy(buffer, token, length);
+    buffer[length] = '\0';
+    return buffer;
+}
+
+/*
+ * Parse an unsigned decimal integer that spans the whole token, no sign other than '+' is accepted
+ */
+static char parse_uint64_token(const char *token, size_t length, uint64_t *value)
+{
+    const char *pos = token;
+    const char *end = token + length;
+    if (pos < end && *pos == '+')
+    {
+        pos++;
+    }
+    if (pos == end)
+    {
+        return 'F';
+    }
+
+    uint64_t result = 0;
+    for (; pos < end; pos++)
+    {
+        unsigned int digit = (unsigned int)(*pos - '0');
+        if (digit > 9)
+        {
+            return 'F';
+        }
+        // overflow
+        if (result > (UINT64_MAX - digit) / 10)
+        {
+            return 'F';
+        }
+        result = result * 10 + digit;
+    }
+    *value = result;
+    return 'S';
+}
+
+/*
+ * Parse a float that spans the whole token, with the same result as strtof.
+ * Plain decimals ([+-]digits[.digits][e[+-]digits]) whose significant digits fit in 24 bits and whose
+ * decimal exponent is at most 10 in magnitude are converted with one float multiplication or division:
+ * both operands are exact, so the single rounding gives the correctly rounded value, like strtof.
+ * Everything else (long mantissas, hex floats, inf/nan, ...) is handed to strtof.
+ */
+static char parse_float_token(const char *token, size_t length, float *value)
+{
+    static const float powers_of_ten[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+    const char *pos = token;
+    const char *end = token + length;
+
+    char negative = 0;
+    if (pos < end && (*pos == '+' || *pos == '-'))
+    {
+        negative = *pos == '-';
+        pos++;
+    }
+
+    uint64_t mantissa = 0;
+    int64_t exponent = 0;
+    uint64_t digits = 0;
+    char fast = 1;
+    for (; pos < end && (unsigned int)(*pos - '0') <= 9; pos++, digits++)
+    {
+        if (mantissa > (1 << 24) / 10)
+        {
+            fast = 0;
+            break;
+        }
+        mantissa = mantissa * 10 + (uint64_t)(*pos - '0');
+    }
+    if (fast && pos < end && *pos == '.')
+    {
+        for (pos++; pos < end && (unsigned int)(*pos - '0') <= 9; pos++, digits++)
+        {
+            if (mantissa > (1 << 24) / 10)
+            {
+                fast = 0;
+                break;
+            }
+            mantissa = mantissa * 10 + (uint64_t)(*pos - '0');
+            exponent--;
+        }
+    }
+    if (fast && digits > 0 && pos < end && (*pos == 'e' || *pos == 'E'))
+    {
+        pos++;
+        char negative_exponent = 0;
+        if (pos < end && (*pos == '+' || *pos == '-'))
+        {
+            negative_exponent = *pos == '-';
+            pos++;
+        }
+        int64_t written_exponent = 0;
+        const char *exponent_start = pos;
+        for (; pos < end && (unsigned int)(*pos - '0') <= 9 && written_exponent < 1000; pos++)
+        {
+            written_exponent = written_exponent * 10 + (*pos - '0');
+        }
+        fast = pos > exponent_start;
+        exponent += negative_exponent ? -written_exponent : written_exponent;
     }
 
+    if (fast && digits > 0 && pos == end && mantissa <= (1 << 24) && exponent >= -10 && exponent <= 10)
+    {
+        float result = (float)mantissa;
+        result = exponent >= 0 ? result * powers_of_ten[exponent] : result / powers_of_ten[-exponent];
+        *value = negative ? -result : result;
+        return 'S';
+    }
+
+    // slow path, strtof needs a NUL-terminated copy (the mapping is not terminated)
+    char buffer[128];
+    if (length >= sizeof(buffer))
+    {
+        return 'F';
+    }
+    memcpy(buffer, token, length);
+    buffer[length] = '\0';
+    char *endptr;
+    *value = strtof(buffer, &endptr);
+    return *endptr == '\0' ? 'S' : 'F';
+}
+
+/*
+ * Parse the three lines of an ELLPACK text file in [data, data_end)
+ */
+static EllpackMatrix *parse_ellpack_text(const char *data, const char *data_end, const char *filename)
+{
+    char print_buffer[TOKEN_PRINT_MAX];
+    const char *token;
+    size_t length;
+    TextLine line;
+
     // ######### FIRST SECTION #########
 
     // process first line
     // format: "<rows>,<cols>,<noEllpackRows>"
-    if (getline(&line, &len, file) == -1)
+    if (begin_line(&data, data_end, &line) != 'S')
     {
         fprintf(stderr, ERR_READ_LINE_FAILED, 1, filename);
-        free(line);
-        fclose(file);
         return NULL;
     }
 
-    // split the line into tokens by ","
     // only process the first 3 tokens and convert them into uint64
-    char *token = strtok(line, ",");
     uint64_t i = 0;
     uint64_t matr_params[3];
     matr_params[0] = -1; // dummy val
     matr_params[1] = -1;
-    matr_params[2] = -1; 
-    while (token != NULL && i < 3)
+    matr_params[2] = -1;
+    while (i < 3 && next_token(&line, &token, &length) == 'S')
     {
-        char cleaned_token[64] = {0};
-        remove_invalid_chars(cleaned_token, token);
-
-        if (convert_to_uint64(cleaned_token, &matr_params[i]) != 'S')
+        if (parse_uint64_token(token, length, &matr_params[i]) != 'S')
         {
-            fprintf(stderr, ERR_CONVERT_UINT64_FAILED, token);
-            free(line);
-            fclose(file);
+            fprintf(stderr, ERR_CONVERT_UINT64_FAILED, token_for_print(token, length, print_buffer));
             return NULL;
         }
-        // the dimensions of the matrix cannot be zero
-        if (matr_params[i] == 0)
+        // the dimensions of the matrix cannot be zero, ellpack_cols can (a matrix without entries, e.g. an empty product)
+        if (matr_params[i] == 0 && i < 2)
         {
             fprintf(stderr, ERR_ZERO_DIMENSION);
-            free(line);
-            fclose(file);
             return NULL;
         }
-
         i++;
-        token = strtok(NULL, ",");
     }
 
     if (matr_params[2] > matr_params[1]) {
         fprintf(stderr, ERR_INVALID_ELLPACK_COLS);
-        free(line);
-        fclose(file);
         return NULL;
     }
 
@@ -77,8 +272,6 @@ EllpackMatrix *load_ellpack_matrix(const char *filename)
     if (i != 3)
     {
         fprintf(stderr, ERR_UNEXPECTED_TOKEN_NUMBER, (uint64_t)3, i);
-        free(line);
-        fclose(file);
         return NULL;
     }
 
@@ -86,68 +279,48 @@ EllpackMatrix *load_ellpack_matrix(const char *filename)
     EllpackMatrix *matrix = allocate_ellpack_matrix(matr_params[0], matr_params[1], matr_params[2]);
     if (matrix == NULL)
     {
-        free(line);
-        fclose(file);
         return NULL;
     }
 
     // ######### SECOND SECTION #########
 
-    // read the second line, which contains the values of the ELLPACK matrix
-    if (getline(&line, &len, file) == -1)
+    // the second line contains the values of the ELLPACK matrix
+    if (begin_line(&data, data_end, &line) != 'S')
     {
         fprintf(stderr, ERR_READ_LINE_FAILED, 2, filename);
         free_ellpack_matrix(matrix);
-        free(line);
-        fclose(file);
         return NULL;
     }
 
-    // split the line into tokens by ","
-    token = strtok(line, ",");
-    uint64_t row = 0;
+    // without ellpack_cols there are no tokens, the values and indices lines are empty
+    uint64_t row = matrix->ellpack_cols == 0 ? matrix->rows : 0;
     uint64_t col = 0;
-    while (token != NULL)
+    float *row_values = matrix->values;
+    // stop reading if all rows are read already
+    while (row < matrix->rows && next_token(&line, &token, &length) == 'S')
     {
-        if (row == matrix->rows)
+        if (length == 1 && token[0] == '*')
         {
-            // stop reading if all rows are read already
-            break;
-        }
-
-        char cleaned_token[64] = {0};
-        remove_invalid_chars(cleaned_token, token);
-        if (strcmp(cleaned_token, "*") == 0)
-        {
-            matrix->values[row][col] = 0.0F; // default '*' to 0.0
+            row_values[col] = 0.0F; // padding, the row ends at its first '*'
         }
         else
         {
-            char *endptr;
-            float value = strtof(cleaned_token, &endptr);
-            if (*endptr != '\0')
+            float value;
+            if (parse_float_token(token, length, &value) != 'S' || isinf(value) || isnan(value))
             {
-                fprintf(stderr, ERR_CONVERT_TO_FLOAT_FAILED, token);
-                free_ellpack_matrix(matrix);
-                free(line);
-                fclose(file);
-                return NULL;
-            }
-            if (isinf(value)) {
-                fprintf(stderr, ERR_CONVERT_TO_FLOAT_FAILED, token);
+                fprintf(stderr, ERR_CONVERT_TO_FLOAT_FAILED, token_for_print(token, length, print_buffer));
                 free_ellpack_matrix(matrix);
-                free(line);
-                fclose(file);
                 return NULL;
             }
-            if (isnan(value)) {
-                fprintf(stderr, ERR_CONVERT_TO_FLOAT_FAILED, token);
+            // the stored entries of a row are a prefix, every value (explicit zeros too) is one of them
+            if (matrix->row_lengths[row] != col)
+            {
+                fprintf(stderr, ERR_VALUE_AFTER_PADDING, row);
                 free_ellpack_matrix(matrix);
-                free(line);
-                fclose(file);
                 return NULL;
             }
-            matrix->values[row][col] = value;
+            row_values[col] = value;
+            matrix->row_lengths[row] = col + 1;
         }
         col++;
 
@@ -156,8 +329,8 @@ EllpackMatrix *load_ellpack_matrix(const char *filename)
         {
             col = 0;
             row++;
+            row_values += matrix->stride;
         }
-        token = strtok(NULL, ",");
     }
 
     // check if the number of tokens is correct
@@ -165,97 +338,77 @@ EllpackMatrix *load_ellpack_matrix(const char *filename)
     {
         fprintf(stderr, ERR_UNEXPECTED_ROW_NUMBER, matrix->rows, row);
         free_ellpack_matrix(matrix);
-        free(line);
-        fclose(file);
         return NULL;
     }
 
     // ######### THIRD SECTION #########
 
-    // read the third line, which contains the indices of the ELLPACK matrix
-    if (getline(&line, &len, file) == -1)
+    // the third line contains the indices of the ELLPACK matrix
+    if (begin_line(&data, data_end, &line) != 'S')
     {
         fprintf(stderr, ERR_READ_LINE_FAILED, 3, filename);
         free_ellpack_matrix(matrix);
-        free(line);
-        fclose(file);
         return NULL;
     }
 
-    // split the line into tokens by ","
-    token = strtok(line, ",");
-    row = 0;
-    col = 0;
-    char *appeared = (char *)calloc(matrix->cols, sizeof(char));
+    // appeared[index] == row + 1 if index already occurred in row, so the array never has to be cleared
+    uint64_t *appeared = (uint64_t *)calloc(matrix->cols, sizeof(uint64_t));
     if (appeared == NULL) {
         fprintf(stderr, "Failed to allocate `appeared` array for checking duplicate indices.");
         free_ellpack_matrix(matrix);
-        free(line);
-        fclose(file);
         return NULL;
     }
-    while (token != NULL)
+    row = matrix->ellpack_cols == 0 ? matrix->rows : 0;
+    col = 0;
+    uint64_t *row_indices = matrix->indices;
+    while (row < matrix->rows && next_token(&line, &token, &length) == 'S')
     {
-        if (row == matrix->rows)
+        // an index is '*' exactly where its value is
+        char padding = length == 1 && token[0] == '*';
+        if (padding != (col >= matrix->row_lengths[row]))
         {
-            // stop reading if all rows are read already
-            break;
+            fprintf(stderr, ERR_PADDING_MISMATCH, col, row);
+            free(appeared);
+            free_ellpack_matrix(matrix);
+            return NULL;
         }
-
-        if (strcmp(token, "*") == 0)
+        if (padding)
         {
-            matrix->indices[row][col] = 0; // default '*' to 0
+            row_indices[col] = 0;
         }
         else
         {
-            char cleaned_token[64] = {0};
-            remove_invalid_chars(cleaned_token, token);
             uint64_t value = 0;
-            if (convert_to_uint64(cleaned_token, &value) != 'S')
+            if (parse_uint64_token(token, length, &value) != 'S')
             {
-                fprintf(stderr, ERR_CONVERT_UINT64_FAILED, token);
-                free_ellpack_matrix(matrix);
-                free(line);
-                fclose(file);
+                fprintf(stderr, ERR_CONVERT_UINT64_FAILED, token_for_print(token, length, print_buffer));
                 free(appeared);
+                free_ellpack_matrix(matrix);
                 return NULL;
             }
             if (value >= matrix->cols) {
                 fprintf(stderr, ERR_INVALID_INDEX, value);
-                free_ellpack_matrix(matrix);
-                free(line);
-                fclose(file);
                 free(appeared);
+                free_ellpack_matrix(matrix);
                 return NULL;
             }
             // check for duplicate indices
-            if (appeared[value] == 1 && matrix->values[row][col] != 0.0F) {
+            if (appeared[value] == row + 1) {
                 fprintf(stderr, ERR_DUPLICATE_INDEX, value);
                 free(appeared);
                 free_ellpack_matrix(matrix);
-                free(line);
-                fclose(file);
                 return NULL;
             }
-            matrix->indices[row][col] = value;
-            appeared[value] = 1;
+            row_indices[col] = value;
+            appeared[value] = row + 1;
         }
         col++;
         if (col == matrix->ellpack_cols)
         {
             col = 0;
             row++;
-            free(appeared);
-            appeared = (char *)calloc(matrix->cols, sizeof(char));
-            if (appeared == NULL) {
-                fprintf(stderr, "Failed to allocate `appeared` array for checking duplicate indices.");
-                free_ellpack_matrix(matrix);
-                free(line);
-                fclose(file);
-                return NULL;
-            }
+            row_indices += matrix->stride;
         }
-        token = strtok(NULL, ",");
     }
 
     // free the array for checking duplicate indices
@@ -266,223 +419,150 @@ EllpackMatrix *load_ellpack_matrix(const char *filename)
     {
         fprintf(stderr, ERR_UNEXPECTED_ROW_NUMBER, matrix->rows, row);
         free_ellpack_matrix(matrix);
-        free(line);
-        fclose(file);
         return NULL;
     }
 
-    free(line);
-    fclose(file);
     return matrix;
 }
 
-//convert normal result matrix to ellpack format and write it to result.txt
-char dump_result_to_ellpack(const char *filename, float **result_matrix, uint64_t rows, uint64_t cols) {
-
-    // check whether overflow occurred during multiplication
-    for (uint64_t i = 0; i < rows; i++) {
-        for (uint64_t j = 0; j < cols; j++) {
-            if (isinf(result_matrix[i][j])) {
-                fprintf(stderr, ERR_OVERFLOW);
-                return 'F';
-            }
-        }
-    }
-
-    // calculate ellpack_cols
-    uint64_t ellpack_cols = 0;
-    for (uint64_t i = 0; i < rows; i++) {
-        uint64_t nonZero = 0;
-        for (uint64_t j = 0; j < cols; j++) {
-            if (result_matrix[i][j] != 0) {
-                nonZero++;
-            }
-        }
-        if (nonZero > ellpack_cols) {
-            ellpack_cols = nonZero;
-        }
+/*
+ * Map a whole file read-only, returns NULL (after printing the reason) if it can not be opened or is empty
+ */
+static char *map_input_file(const char *filename, size_t *file_size)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1)
+    {
+        fprintf(stderr, ERR_OPEN_FILE_FAILED, filename);
+        return NULL;
     }
-
-    FILE *file = fopen(filename, "w");
-    if (file == NULL) {
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1)
+    {
         fprintf(stderr, ERR_OPEN_FILE_FAILED, filename);
-        return 'F';
+        close(fd);
+        return NULL;
     }
-
-    // write <noRows>,<noCols>,<noEllpackCol> to the first line
-    fprintf(file, "%"PRIu64",%"PRIu64",%"PRIu64"\n", rows, cols, ellpack_cols);
-
-    uint64_t *index_array = malloc(rows * ellpack_cols * sizeof(uint64_t));
-    if (index_array == NULL) {
-        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "failed to allocate memory for index_array");
-        return 'F';
+    *file_size = (size_t)file_stat.st_size;
+    if (*file_size == 0)
+    {
+        fprintf(stderr, ERR_READ_LINE_FAILED, 1, filename);
+        close(fd);
+        return NULL;
     }
-    uint64_t array_index = 0;
-
-    // write matrix values in ellpack-format to the second line
-    for (uint64_t i = 0; i < rows; i++) {
-        uint64_t pos = 0;
-        for (uint64_t j = 0; j < cols; j++) {
-            if (result_matrix[i][j] != 0) {
-                if (pos > 0) {
-                    fprintf(file, ",");
-                }
-                fprintf(file, "%.1f", result_matrix[i][j]);
-                index_array[array_index++] = j;
-                pos++;
-            }
-        }
-        if (pos == ellpack_cols && i < rows - 1) //at the end of a row and not last row
-        {
-            fprintf(file, ",");
-        }
-        // fill unused places with *
-        bool filled_unused = false;
-
-        if (pos < ellpack_cols) {
-            filled_unused = true;
-        }
-
-        while (pos < ellpack_cols) //row not full
-        {
-            if (pos > 0) {
-                fprintf(file, ",*");
-            } else {
-                fprintf(file, "*");
-            }
-            index_array[array_index++] = -1;
-            pos++;
-
-        }
-        if (filled_unused && i < rows - 1) { //at the end of a row but not last row
-            fprintf(file, ",");
-        }
+    char *file_data = (char *)mmap(NULL, *file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file_data == MAP_FAILED)
+    {
+        fprintf(stderr, ERR_OPEN_FILE_FAILED, filename);
+        return NULL;
+    }
+    return file_data;
+}
 
+/*
+ * Load an ELLPACK matrix from a text or binary file, the format is detected by the magic number of binary files.
+ * The file is mapped read-only: text is parsed in place without copying any line or token,
+ * a binary file is used as the matrix directly (see ellpack_binary.h).
+ * Returns NULL (after printing the reason) if the file can not be read or is not a valid ELLPACK matrix.
+ */
+EllpackMatrix *load_ellpack_matrix(const char *filename)
+{
+    size_t file_size;
+    char *file_data = map_input_file(filename, &file_size);
+    if (file_data == NULL)
+    {
+        return NULL;
     }
-    fprintf(file, "\n");
 
-    // write indices to the third line
-    for (uint64_t i = 0; i < array_index; i++)
+    // binary files are used in place, the matrix keeps the mapping
+    if (is_ellpack_binary(file_data, file_size))
     {
-        if (i > 0)
-        {
-            fprintf(file, ",");
-        }
-        if (index_array[i] == -1ULL) // comparison of integers of different signs: 'uint64_t'
-        {
-            fprintf(file, "*");
-        }
-        else
+        madvise(file_data, file_size, MADV_WILLNEED);
+        EllpackMatrix *matrix = map_ellpack_binary(file_data, file_size, filename);
+        if (matrix == NULL)
         {
-            fprintf(file, "%"PRIu64"", index_array[i]);
+            munmap(file_data, file_size);
         }
+        return matrix;
     }
 
-    fprintf(file, "\n");
-    fclose(file);
-
-    free(index_array);
-    return 'S';
+    madvise(file_data, file_size, MADV_SEQUENTIAL);
+    EllpackMatrix *matrix = parse_ellpack_text(file_data, file_data + file_size, filename);
+    munmap(file_data, file_size);
+    return matrix;
 }
 
-//write ellpack matrix directly to output file
-void dump_ellpack_matrix(const char *filename, const EllpackMatrix *matrix)
-{
-    FILE *file = fopen(filename, "w");
-    if (file == NULL)
-    {
-        fprintf(stderr, ERR_OPEN_FILE_FAILED, filename);
-        return;
-    }
-
-    // write <noRows>,<noCols>,<noEllpackCol> to the first line
-    fprintf(file, "%"PRIu64",%"PRIu64",%"PRIu64"\n", matrix->rows, matrix->cols, matrix->ellpack_cols);
+//write the sparse product to the output file, padding slots (zero values) are written as *
+//the stored entries of a row are a prefix, so the written ellpack_cols is the longest non-zero prefix
+//(smaller than result->ellpack_cols if sums cancelled out)
+char dump_result_to_ellpack(const char *filename, const EllpackMatrix *result) {
 
-    // write matrix values to the second line
-    for (uint64_t i = 0; i < matrix->rows; i++) {
-        for (uint64_t j = 0; j < matrix->ellpack_cols; j++) {
-            if (i == matrix->rows - 1 && j == matrix->ellpack_cols - 1) {
-                fprintf(file, "%.1f", matrix->values[i][j]);
-            } else {
-                fprintf(file, "%.1f,", matrix->values[i][j]);
+    // check whether overflow occurred during multiplication and calculate ellpack_cols
+    uint64_t ellpack_cols = 0;
+    for (uint64_t i = 0; i < result->rows; i++) {
+        const float *row_values = ellpack_row_values(result, i);
+        uint64_t length = ellpack_row_length(result, i);
+        for (uint64_t j = 0; j < length; j++) {
+            if (isinf(row_values[j])) {
+                fprintf(stderr, ERR_OVERFLOW);
+                return 'F';
             }
         }
-    }
-    fprintf(file, "\n");
-
-    // write indices to the third line
-    for (uint64_t i = 0; i < matrix->rows; i++) {
-        for (uint64_t j = 0; j < matrix->ellpack_cols; j++) {
-            {
-                if(i == matrix->rows - 1 && j == matrix->ellpack_cols - 1){
-                    fprintf(file, "%"PRIu64"", matrix->indices[i][j]);
-                }else{
-                    fprintf(file, "%"PRIu64",", matrix->indices[i][j]);
-                }
-            }
+        if (length > ellpack_cols) {
+            ellpack_cols = length;
         }
     }
-    fprintf(file, "\n");
 
-    fclose(file);
+    return write_ellpack_text(filename, result, ellpack_cols, ELLPACK_TEXT_RESULT);
+}
+
+//write ellpack matrix directly to output file in the input format, the text the loader reads back
+//padding ('*' slots) is written as *, values with the fewest digits that load back to the same float
+char dump_ellpack_matrix(const char *filename, const EllpackMatrix *matrix)
+{
+    return write_ellpack_text(filename, matrix, matrix->ellpack_cols, ELLPACK_TEXT_INPUT);
 }
 
 /*
- * Remove white spaces and `\n` from a string
+ * Helper method to compute the padded row stride for a given ellpack_cols
+ * The stride is rounded up to ELLPACK_ROW_PAD so every row starts on a cache line
+ * and SIMD kernels can load whole registers without crossing into the next row
  */
-void remove_invalid_chars(char *dest, const char *src)
+uint64_t ellpack_row_stride(uint64_t ellpack_cols)
 {
-    while (*src)
-    {
-        if (strcmp((const char *)src, " ") != 0 && strcmp((const char *)src, "\n") != 0)
-        {
-            *dest++ = *src;
-        }
-        src++;
-    }
-    *dest = '\0';
+    return (ellpack_cols + ELLPACK_ROW_PAD - 1) / ELLPACK_ROW_PAD * ELLPACK_ROW_PAD;
 }
 
 /*
- * Helper method to convert a string into uint64
+ * Helper method to allocate a zeroed, cache-line aligned slab of count elements
+ * Returns NULL on overflow of the byte size or if the allocation fails
  */
-char convert_to_uint64(const char *str, uint64_t *value)
+void *allocate_aligned_slab(uint64_t count, size_t element_size)
 {
-    // check for negative sign
-    for (u_int64_t i = 0; i < sizeof(str); i++) {
-        if (str[i] == '-') {
-            return 'F';
-        }
-    }
-
-    // the string is empty
-    if (str[0] == '\0')
+    if (count > SIZE_MAX / element_size)
     {
-        return 'F';
+        return NULL;
     }
-
-    char *endptr;
-    errno = 0;
-    uint64_t ull_value = strtoull(str, &endptr, 10);
-
-    // input is invalid
-    if (*endptr != '\0')
+    size_t bytes = count * element_size;
+    // aligned_alloc requires the size to be a multiple of the alignment
+    bytes = (bytes + ELLPACK_ALIGNMENT - 1) / ELLPACK_ALIGNMENT * ELLPACK_ALIGNMENT;
+    if (bytes == 0)
     {
-        return 'F';
+        bytes = ELLPACK_ALIGNMENT;
     }
-    // overflow during the conversion
-    else if (errno == ERANGE && ull_value == ULLONG_MAX)
+    void *slab = aligned_alloc(ELLPACK_ALIGNMENT, bytes);
+    if (slab != NULL)
     {
-        return 'F';
+        memset(slab, 0, bytes);
     }
-
-    *value = (uint64_t)ull_value;
-    return 'S';
+    return slab;
 }
 
 /*
  * Helper method to allocate memory for an ELLPACK matrix
- * Using calloc() to initialize the values and indices array so the values default to zero
+ * values and indices are each one contiguous, cache-line aligned slab of rows * stride entries,
+ * zero-initialized so the values default to zero
  */
 EllpackMatrix *allocate_ellpack_matrix(uint64_t rows, uint64_t cols, uint64_t ellpack_cols)
 {
@@ -498,95 +578,245 @@ EllpackMatrix *allocate_ellpack_matrix(uint64_t rows, uint64_t cols, uint64_t el
     matrix->rows = rows;
     matrix->cols = cols;
     matrix->ellpack_cols = ellpack_cols;
+    matrix->stride = ellpack_row_stride(ellpack_cols);
+    matrix->mapping = NULL;
+    matrix->mapping_size = 0;
+    matrix->index_bits = 64;
+    matrix->indices32 = NULL;
+    matrix->index_bases = NULL;
+    matrix->index_deltas = NULL;
+
+    // guard rows * stride against overflow before allocating the slabs
+    if (matrix->stride != 0 && rows > UINT64_MAX / matrix->stride)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "matrix values/indices array");
+        free(matrix);
+        return NULL;
+    }
 
-    // allocate memory for the values and indices arrays
-    matrix->values = (float **)calloc(rows, sizeof(float *));
-    matrix->indices = (uint64_t **)calloc(rows, sizeof(uint64_t *));
-    if (matrix->values == NULL || matrix->indices == NULL)
+    // allocate the values and indices slabs, all rows start empty
+    matrix->values = (float *)allocate_aligned_slab(rows * matrix->stride, sizeof(float));
+    matrix->indices = (uint64_t *)allocate_aligned_slab(rows * matrix->stride, sizeof(uint64_t));
+    matrix->row_lengths = (uint64_t *)calloc(rows, sizeof(uint64_t));
+    if (matrix->values == NULL || matrix->indices == NULL || matrix->row_lengths == NULL)
     {
         fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "matrix values/indices array");
         free(matrix->values);
         free(matrix->indices);
+        free(matrix->row_lengths);
         free(matrix);
         return NULL;
     }
 
-    // allocate memory for each row in the values and indices arrays
-    for (uint64_t i = 0; i < rows; i++)
+    return matrix;
+}
+
+/*
+ * Helper method to free memory of an ELLPACK matrix
+ */
+void free_ellpack_matrix(EllpackMatrix *matrix)
+{
+    if (matrix != NULL)
     {
-        matrix->values[i] = (float *)calloc(ellpack_cols, sizeof(float));
-        matrix->indices[i] = (uint64_t *)calloc(ellpack_cols, sizeof(uint64_t));
-        if (matrix->values[i] == NULL || matrix->indices[i] == NULL)
+        if (matrix->mapping != NULL)
+        {
+            munmap(matrix->mapping, matrix->mapping_size);
+        }
+        else
         {
-            fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "inner array of matrix values/indices array");
-            for (uint64_t j = 0; j <= i; j++)
-            {
-                free(matrix->values[j]);
-                free(matrix->indices[j]);
-            }
             free(matrix->values);
             free(matrix->indices);
-            free(matrix);
-            return NULL;
         }
+        free(matrix->row_lengths);
+        free(matrix->indices32);
+        free(matrix->index_bases);
+        free(matrix->index_deltas);
+        free(matrix);
     }
+}
 
+/*
+ * Allocate a rows x cols dense matrix of zeros in the given layout
+ */
+DenseMatrix *allocate_dense_matrix(uint64_t rows, uint64_t cols, DenseLayout layout)
+{
+    DenseMatrix *matrix = (DenseMatrix *)malloc(sizeof(DenseMatrix));
+    if (matrix == NULL || (cols != 0 && rows > UINT64_MAX / cols))
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "dense matrix");
+        free(matrix);
+        return NULL;
+    }
+    matrix->rows = rows;
+    matrix->cols = cols;
+    matrix->layout = layout;
+    matrix->values = (float *)allocate_aligned_slab(rows * cols, sizeof(float));
+    if (matrix->values == NULL)
+    {
+        fprintf(stderr, ERR_MEMORY_ALLOCATION_FAILED_FAILED, "dense matrix values");
+        free(matrix);
+        return NULL;
+    }
     return matrix;
 }
 
 /*
- * Helper method to free memory of an ELLPACK matrix
+ * Load a dense matrix (or vector) text file into the given layout, the file is always written row by row.
+ * Returns NULL (after printing the reason) if the file can not be read or is not a valid dense matrix.
  */
-void free_ellpack_matrix(EllpackMatrix *matrix)
+DenseMatrix *load_dense_matrix(const char *filename, DenseLayout layout)
 {
-    if (matrix != NULL)
+    size_t file_size;
+    char *file_data = map_input_file(filename, &file_size);
+    if (file_data == NULL)
     {
-        for (uint64_t i = 0; i < matrix->rows; i++)
+        return NULL;
+    }
+    madvise(file_data, file_size, MADV_SEQUENTIAL);
+    const char *data = file_data;
+    const char *data_end = file_data + file_size;
+    char print_buffer[TOKEN_PRINT_MAX];
+    const char *token;
+    size_t length;
+    TextLine line;
+    DenseMatrix *matrix = NULL;
+
+    // first line: "<rows>,<cols>"
+    uint64_t dimensions[2];
+    uint64_t i = 0;
+    if (begin_line(&data, data_end, &line) != 'S')
+    {
+        fprintf(stderr, ERR_READ_LINE_FAILED, 1, filename);
+        munmap(file_data, file_size);
+        return NULL;
+    }
+    while (i < 2 && next_token(&line, &token, &length) == 'S')
+    {
+        if (parse_uint64_token(token, length, &dimensions[i]) != 'S')
         {
-            free(matrix->values[i]);
-            free(matrix->indices[i]);
+            fprintf(stderr, ERR_CONVERT_UINT64_FAILED, token_for_print(token, length, print_buffer));
+            munmap(file_data, file_size);
+            return NULL;
+        }
+        if (dimensions[i] == 0)
+        {
+            fprintf(stderr, ERR_ZERO_DIMENSION);
+            munmap(file_data, file_size);
+            return NULL;
+        }
+        i++;
+    }
+    if (i != 2)
+    {
+        fprintf(stderr, ERR_UNEXPECTED_TOKEN_NUMBER, (uint64_t)2, i);
+        munmap(file_data, file_size);
+        return NULL;
+    }
+    matrix = allocate_dense_matrix(dimensions[0], dimensions[1], layout);
+    if (matrix == NULL)
+    {
+        munmap(file_data, file_size);
+        return NULL;
+    }
+
+    // second line: the values row by row
+    if (begin_line(&data, data_end, &line) != 'S')
+    {
+        fprintf(stderr, ERR_READ_LINE_FAILED, 2, filename);
+        free_dense_matrix(matrix);
+        munmap(file_data, file_size);
+        return NULL;
+    }
+    uint64_t row = 0;
+    uint64_t col = 0;
+    while (row < matrix->rows && next_token(&line, &token, &length) == 'S')
+    {
+        float value;
+        if (parse_float_token(token, length, &value) != 'S' || isinf(value) || isnan(value))
+        {
+            fprintf(stderr, ERR_CONVERT_TO_FLOAT_FAILED, token_for_print(token, length, print_buffer));
+            free_dense_matrix(matrix);
+            munmap(file_data, file_size);
+            return NULL;
+        }
+        matrix->values[dense_offset(matrix, row, col)] = value;
+        if (++col == matrix->cols)
+        {
+            col = 0;
+            row++;
         }
-        free(matrix->values);
-        free(matrix->indices);
-        free(matrix);
     }
+    munmap(file_data, file_size);
+    if (row != matrix->rows)
+    {
+        fprintf(stderr, ERR_UNEXPECTED_ROW_NUMBER, matrix->rows, row);
+        free_dense_matrix(matrix);
+        return NULL;
+    }
+    return matrix;
 }
 
-float **allocate_matrix_array(uint64_t rows, uint64_t cols)
+/*
+ * Write a dense matrix in the file format of load_dense_matrix (row by row whatever its layout), every value with
+ * the shortest text that loads back to the same float. Returns 'F' if a value overflowed or the file can not be written.
+ */
+char dump_dense_matrix(const char *filename, const DenseMatrix *matrix)
 {
-    float **arr = (float **)calloc(rows, sizeof(float *));
-    if (arr == NULL)
+    uint64_t count = matrix->rows * matrix->cols;
+    for (uint64_t i = 0; i < count; i++)
     {
-        fprintf(stderr, "Memory allocation failed for row pointers\n");
-        return NULL;
+        if (isinf(matrix->values[i]))
+        {
+            fprintf(stderr, ERR_OVERFLOW);
+            return 'F';
+        }
     }
 
-    for (uint64_t i = 0; i < rows; i++)
+    FILE *file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, ERR_OPEN_FILE_FAILED, filename);
+        return 'F';
+    }
+    char buffer[WRITER_BLOCK_BYTES / 16];
+    char *out = buffer;
+    out += snprintf(buffer, sizeof(buffer), "%" PRIu64 ",%" PRIu64 "\n", matrix->rows, matrix->cols);
+    char failed = 0;
+    for (uint64_t row = 0; row < matrix->rows && !failed; row++)
     {
-        arr[i] = (float *)calloc(cols, sizeof(float));
-        if (arr[i] == NULL)
+        for (uint64_t col = 0; col < matrix->cols; col++)
         {
-            fprintf(stderr, "Memory allocation failed for columns in row %"PRIu64"\n", i);
-            // free previously allocated memory before exiting
-            for (uint64_t j = 0; j < i; j++)
+            if (out + WRITER_MAX_TOKEN + 2 > buffer + sizeof(buffer))
             {
-                free(arr[j]);
+                failed = fwrite(buffer, 1, (size_t)(out - buffer), file) != (size_t)(out - buffer);
+                out = buffer;
             }
-            free(arr);
-            return NULL;
+            if (row != 0 || col != 0)
+            {
+                *out++ = ',';
+            }
+            out = format_float_shortest(out, matrix->values[dense_offset(matrix, row, col)]);
         }
     }
-
-    return arr;
+    *out++ = '\n';
+    failed = failed || fwrite(buffer, 1, (size_t)(out - buffer), file) != (size_t)(out - buffer);
+    failed = fclose(file) != 0 || failed;
+    if (failed)
+    {
+        fprintf(stderr, ERR_WRITE_FILE_FAILED, filename);
+        return 'F';
+    }
+    return 'S';
 }
 
-void free_matrix_array(uint64_t rows, float **arr)
+/*
+ * Helper method to free memory of a dense matrix
+ */
+void free_dense_matrix(DenseMatrix *matrix)
 {
-    for (uint64_t i = 0; i < rows; i++)
+    if (matrix != NULL)
     {
-        free(arr[i]);
-        arr[i] = NULL;
+        free(matrix->values);
+        free(matrix);
     }
-    free(arr);
-    arr = NULL;
 }
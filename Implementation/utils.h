@@ -1,6 +1,7 @@
 #ifndef FINAL_UTILS_H
 #define FINAL_UTILS_H
 #include <inttypes.h>
+#include <stddef.h>
 // Error message format strings
 
 #define ERR_OPEN_FILE_FAILED "Error: Failed to open %s\n"
@@ -16,36 +17,130 @@
 #define ERR_INVALID_INDEX "Error: The index %"PRIu64" is out of bounds\n"
 #define ERR_INVALID_ELLPACK_COLS "Error: EllpackCols should be less than the column dimension of the matrix\n"
 #define ERR_DUPLICATE_INDEX "Error: The index %"PRIu64" is duplicated\n"
+#define ERR_INVALID_BINARY_FILE "Error: %s is not a valid binary ELLPACK file (%s)\n"
+#define ERR_WRITE_FILE_FAILED "Error: Failed to write %s\n"
+#define ERR_VALUE_AFTER_PADDING "Error: Row %"PRIu64" has a value after a padding slot (*)\n"
+#define ERR_PADDING_MISMATCH "Error: Entry %"PRIu64" of row %"PRIu64" is padding (*) in only one of the values and the indices\n"
+
+// Storage layout of the ELLPACK slabs
+
+#define ELLPACK_ALIGNMENT 64 // slabs start on a cache line
+#define ELLPACK_ROW_PAD 16   // row stride is a multiple of 16 entries (one cache line of floats, a full AVX-512 register)
+#define INDEX_DELTA_BLOCK 16 // entries per 32-bit base column of 16-bit delta indices, divides ELLPACK_ROW_PAD
 
 // EllpackMatrix structure
+// values and indices are single contiguous slabs of rows * stride entries,
+// row i starts at offset i * stride. Entries past ellpack_cols in a row are zero.
+// row_lengths[i] is the number of valid entries of row i, they come first in the row and every slot after them is
+// padding (value 0 at index 0). A valid entry may hold an explicit zero. Whoever fills the rows keeps it up to date.
+// A matrix loaded from a binary file keeps its slabs in the file mapping (read-only).
+// The numeric phase of V1/V2 may narrow the indices (see compact_indices.h), they are then read with ellpack_index:
+// index_bits 32 keeps them in indices32, 16 as index_bases[offset / INDEX_DELTA_BLOCK] + index_deltas[offset].
 
 typedef struct
 {
     uint64_t rows;
     uint64_t cols;
     uint64_t ellpack_cols;
-    float **values;
-    uint64_t **indices;
+    uint64_t stride;
+    float *values;
+    uint64_t *indices;     // NULL once the indices were narrowed
+    uint64_t *row_lengths;
+    void *mapping;         // file mapping the slabs point into, NULL if they were allocated
+    uint64_t mapping_size;
+    unsigned int index_bits; // 64, 32 or 16
+    uint32_t *indices32;
+    uint32_t *index_bases;   // one per INDEX_DELTA_BLOCK entries
+    uint16_t *index_deltas;
 } EllpackMatrix;
 
-// Helper methods
+/*
+ * Row accessors into the contiguous slabs
+ */
+static inline float *ellpack_row_values(const EllpackMatrix *matrix, uint64_t row)
+{
+    return matrix->values + row * matrix->stride;
+}
+
+static inline uint64_t *ellpack_row_indices(const EllpackMatrix *matrix, uint64_t row)
+{
+    return matrix->indices + row * matrix->stride;
+}
+
+/*
+ * Column of entry `entry` of a row in any index width
+ */
+static inline uint64_t ellpack_index(const EllpackMatrix *matrix, uint64_t row, uint64_t entry)
+{
+    uint64_t offset = row * matrix->stride + entry;
+    switch (matrix->index_bits)
+    {
+    case 32:
+        return matrix->indices32[offset];
+    case 16:
+        return matrix->index_bases[offset / INDEX_DELTA_BLOCK] + matrix->index_deltas[offset];
+    default:
+        return matrix->indices[offset];
+    }
+}
+
+/*
+ * Number of valid entries of a row
+ */
+static inline uint64_t ellpack_row_length(const EllpackMatrix *matrix, uint64_t row)
+{
+    return matrix->row_lengths[row];
+}
+
+// Dense matrices of the sparse x dense products (see spmm.h)
+// A file holds "<rows>,<cols>" on the first line and the rows * cols values row by row on the second, a vector
+// is a matrix with one column. In memory the values are one slab in either layout.
+
+typedef enum
+{
+    DENSE_ROW_MAJOR, // element (row, col) at row * cols + col
+    DENSE_COL_MAJOR  // element (row, col) at col * rows + row
+} DenseLayout;
+
+// DenseMatrix structure
+typedef struct
+{
+    uint64_t rows;
+    uint64_t cols;
+    DenseLayout layout;
+    float *values;
+} DenseMatrix;
 
-void remove_invalid_chars(char *dest, const char *src);
+/*
+ * Position of element (row, col) in the values of a dense matrix
+ */
+static inline uint64_t dense_offset(const DenseMatrix *matrix, uint64_t row, uint64_t col)
+{
+    return matrix->layout == DENSE_ROW_MAJOR ? row * matrix->cols + col : col * matrix->rows + row;
+}
 
-char convert_to_uint64(const char *str, uint64_t *value);
+// Helper methods
 
 EllpackMatrix *load_ellpack_matrix(const char *filename);
 
-char dump_result_to_ellpack(const char *filename, float **result_matrix, uint64_t rows, uint64_t cols);
+char dump_result_to_ellpack(const char *filename, const EllpackMatrix *result);
 
-void dump_ellpack_matrix(const char *filename, const EllpackMatrix *matrix);
+char dump_ellpack_matrix(const char *filename, const EllpackMatrix *matrix);
 
 EllpackMatrix *allocate_ellpack_matrix(uint64_t rows, uint64_t cols, uint64_t ellpack_cols);
 
+uint64_t ellpack_row_stride(uint64_t ellpack_cols);
+
+void *allocate_aligned_slab(uint64_t count, size_t element_size);
+
 void free_ellpack_matrix(EllpackMatrix *matrix);
 
-float **allocate_matrix_array(uint64_t rows, uint64_t cols);
+DenseMatrix *allocate_dense_matrix(uint64_t rows, uint64_t cols, DenseLayout layout);
+
+DenseMatrix *load_dense_matrix(const char *filename, DenseLayout layout);
+
+char dump_dense_matrix(const char *filename, const DenseMatrix *matrix);
 
-void free_matrix_array(uint64_t rows, float **arr);
+void free_dense_matrix(DenseMatrix *matrix);
 
 #endif